@@ -0,0 +1,9 @@
+MOVC R1,#0
+MOVC R5,#100
+MOVC R2,#3
+ADD R1,R1,R2
+EX-OR R3,R1,R5
+ADDL R4,R3,#7
+SUBL R5,R5,#1
+BNZ #-16
+HALT
@@ -0,0 +1,304 @@
+/*
+ * apex_bus.c
+ * Contains APEX shared memory bus implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_bus.h"
+#include "apex_macros.h"
+
+void
+bus_init(Memory_Bus *bus, int num_cores, int deferred)
+{
+    memset(bus, 0, sizeof(Memory_Bus));
+    bus->num_cores = num_cores;
+    bus->deferred = deferred;
+    bus->last_grant = num_cores - 1;
+}
+
+void
+bus_attach(Memory_Bus *bus, int core, DCache *cache, MSHR *mshrs)
+{
+    bus->caches[core] = cache;
+    bus->mshrs[core] = mshrs;
+}
+
+/* Returns the miss of a core that has queued longest, if any */
+static MSHR *
+oldest_request(MSHR *mshrs)
+{
+    MSHR *oldest = NULL;
+    int i;
+
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        if (mshrs[i].valid && mshrs[i].bus_wait
+            && (!oldest || mshrs[i].request_cycle < oldest->request_cycle))
+        {
+            oldest = &mshrs[i];
+        }
+    }
+
+    return oldest;
+}
+
+/*
+ * Shows a request that won the bus to the other cores. Their cached copies
+ * change state right away. A copy still on its way to another core only
+ * changes once that core has used it, and *arrival is set to the last
+ * cycle such a copy arrives, 0 when there is none. Returns TRUE when
+ * another core keeps a copy.
+ */
+static int
+snoop_others(Memory_Bus *bus, int core, int line, enum Bus_Request request,
+             int *arrival)
+{
+    MSHR *pending;
+    int other, shared = FALSE;
+
+    *arrival = 0;
+    for (other = 0; other < bus->num_cores; ++other)
+    {
+        if (other == core)
+        {
+            continue;
+        }
+
+        pending = mshr_find(bus->mshrs[other], line);
+        if (pending && !pending->bus_wait)
+        {
+            if (pending->snooped < 0 || request != BUS_READ)
+            {
+                pending->snooped = request;
+            }
+            if (pending->ready_cycle > *arrival)
+            {
+                *arrival = pending->ready_cycle;
+            }
+            shared = TRUE;
+            continue;
+        }
+
+        if (dcache_probe(bus->caches[other], line))
+        {
+            dcache_snoop(bus->caches[other], line, request);
+            shared = TRUE;
+        }
+    }
+
+    return shared;
+}
+
+/*
+ * Snoops a miss that won the bus and settles how it arrives. It waits for
+ * copies still on their way to other cores. Returns the cycles it holds
+ * the bus.
+ */
+static int
+snoop(Memory_Bus *bus, int core, MSHR *mshr)
+{
+    DCache *cache = bus->caches[core];
+    int shared, arrival;
+
+    /* An upgrade whose shared copy went away while it queued needs the line */
+    if (mshr->request == BUS_UPGRADE && !dcache_probe(cache, mshr->line))
+    {
+        if (dcache_invalidated(cache, mshr->line))
+        {
+            cache->coherence_misses++;
+        }
+        mshr->request = BUS_READ_EXCLUSIVE;
+        mshr->ready_cycle += DCACHE_MISS_LATENCY - BUS_UPGRADE_CYCLES;
+    }
+    bus->requests[mshr->request]++;
+
+    shared = snoop_others(bus, core, mshr->line, mshr->request, &arrival);
+    if (mshr->ready_cycle <= arrival)
+    {
+        mshr->ready_cycle = arrival + 1;
+    }
+    if (mshr->request == BUS_READ && shared)
+    {
+        mshr->fill_state = LINE_SHARED;
+    }
+    return (mshr->request == BUS_UPGRADE) ? BUS_UPGRADE_CYCLES
+                                          : BUS_LINE_CYCLES;
+}
+
+/*
+ * Runs at the end of every cycle, once all cores have queued their misses.
+ * When the bus is free for the next cycle it goes to the first core after
+ * the one granted last that has something to send, so no core can starve
+ * the others. A core sends its oldest miss, which arrives as much later as
+ * it waited, and writes modified lines back only when no miss is waiting.
+ */
+void
+bus_arbitrate(Memory_Bus *bus, int clock)
+{
+    MSHR *mshr;
+    int i, core, cycles;
+
+    if (bus->busy_until > clock)
+    {
+        bus->busy_cycles++;
+    }
+
+    if (bus->busy_until > clock + 1)
+    {
+        return;
+    }
+
+    for (i = 1; i <= bus->num_cores; ++i)
+    {
+        core = (bus->last_grant + i) % bus->num_cores;
+        mshr = oldest_request(bus->mshrs[core]);
+        if (mshr)
+        {
+            mshr->bus_wait = FALSE;
+            mshr->ready_cycle += clock - mshr->request_cycle;
+            bus->wait_cycles[core] += clock - mshr->request_cycle;
+            cycles = snoop(bus, core, mshr);
+        }
+        else if (bus->caches[core]->pending_writebacks)
+        {
+            bus->caches[core]->pending_writebacks--;
+            bus->requests[BUS_WRITEBACK]++;
+            cycles = BUS_LINE_CYCLES;
+        }
+        else
+        {
+            continue;
+        }
+
+        bus->transactions[core]++;
+        bus->busy_until = clock + 1 + cycles;
+        bus->last_grant = core;
+        return;
+    }
+}
+
+/* Logs a transaction a core started without the bus, only touches the
+ * core's own log so cores running in parallel can call it */
+void
+bus_record(Memory_Bus *bus, int core, int cycle, int line,
+           enum Bus_Request request)
+{
+    Bus_Log *log = &bus->logs[core];
+    Bus_Record *records;
+
+    if (log->count == log->capacity)
+    {
+        records = realloc(log->records, (log->capacity ? log->capacity * 2 : 64)
+                                            * sizeof(Bus_Record));
+        if (!records)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for bus log\n");
+            exit(1);
+        }
+        log->records = records;
+        log->capacity = log->capacity ? log->capacity * 2 : 64;
+    }
+
+    log->records[log->count].cycle = cycle;
+    log->records[log->count].line = line;
+    log->records[log->count].request = request;
+    log->count++;
+}
+
+/* Puts a transfer sent at cycle on the bus, returns the cycles it waited */
+static int
+occupy(Memory_Bus *bus, int cycle, int cycles)
+{
+    int grant = cycle;
+
+    if (bus->busy_until - 1 > grant)
+    {
+        grant = bus->busy_until - 1;
+    }
+    bus->busy_until = grant + 1 + cycles;
+    bus->busy_cycles += cycles;
+    return grant - cycle;
+}
+
+/*
+ * Replays the transactions the cores logged during the quantum, oldest
+ * first and lower cores first within a cycle. Each one is snooped by the
+ * other cores as if it had been granted then, and the cycles it would have
+ * waited are charged to its core. Writebacks go last.
+ */
+void
+bus_replay(Memory_Bus *bus)
+{
+    int next[MAX_CORES] = { 0 };
+    Bus_Record *record;
+    int c, core, wait, arrival;
+
+    for (c = 0; c < bus->num_cores; ++c)
+    {
+        bus->stall_cycles[c] = 0;
+    }
+
+    while (TRUE)
+    {
+        core = -1;
+        for (c = 0; c < bus->num_cores; ++c)
+        {
+            if (next[c] < bus->logs[c].count
+                && (core < 0 || bus->logs[c].records[next[c]].cycle
+                                    < bus->logs[core].records[next[core]].cycle))
+            {
+                core = c;
+            }
+        }
+        if (core < 0)
+        {
+            break;
+        }
+
+        record = &bus->logs[core].records[next[core]++];
+        wait = occupy(bus, record->cycle,
+                      (record->request == BUS_UPGRADE) ? BUS_UPGRADE_CYCLES
+                                                       : BUS_LINE_CYCLES);
+        bus->stall_cycles[core] += wait;
+        bus->wait_cycles[core] += wait;
+        bus->transactions[core]++;
+        bus->requests[record->request]++;
+
+        /* The core took the line exclusive, others turned out to share it */
+        if (snoop_others(bus, core, record->line, record->request, &arrival)
+            && record->request == BUS_READ
+            && dcache_state(bus->caches[core], record->line) == LINE_EXCLUSIVE)
+        {
+            dcache_snoop(bus->caches[core], record->line, BUS_READ);
+        }
+    }
+
+    for (c = 0; c < bus->num_cores; ++c)
+    {
+        bus->logs[c].count = 0;
+        while (bus->caches[c]->pending_writebacks)
+        {
+            bus->caches[c]->pending_writebacks--;
+            occupy(bus, bus->busy_until, BUS_LINE_CYCLES);
+            bus->transactions[c]++;
+            bus->requests[BUS_WRITEBACK]++;
+        }
+    }
+}
+
+void
+bus_free(Memory_Bus *bus)
+{
+    int c;
+
+    for (c = 0; c < bus->num_cores; ++c)
+    {
+        free(bus->logs[c].records);
+    }
+}
@@ -0,0 +1,66 @@
+/*
+ * apex_bus.h
+ * Contains APEX shared memory bus declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_BUS_H_
+#define _APEX_BUS_H_
+
+#include "apex_macros.h"
+#include "apex_cache.h"
+
+/* Transaction a core sent without waiting for the bus, replayed on it at
+ * the end of the quantum */
+typedef struct Bus_Record
+{
+    int cycle;
+    int line;
+    enum Bus_Request request;
+} Bus_Record;
+
+typedef struct Bus_Log
+{
+    Bus_Record *records;
+    int count;
+    int capacity;
+} Bus_Log;
+
+/*
+ * Bus between the cores and data memory. Misses queue for it in their
+ * MSHRs, and at the end of every cycle the arbiter lets one of them start
+ * its transfer, which then holds the bus for BUS_LINE_CYCLES. Every core
+ * snoops the transfers to keep its data cache coherent.
+ *
+ * When the cores run several cycles between meeting points they cannot
+ * wait for each other's grants. Their misses then start right away and are
+ * logged, and at the meeting point the log is replayed on the bus in cycle
+ * order. Each core is charged the cycles its transfers would have waited,
+ * to stall at the start of the next quantum.
+ */
+typedef struct Memory_Bus
+{
+    int num_cores;
+    DCache *caches[MAX_CORES];
+    MSHR *mshrs[MAX_CORES];
+    int deferred;                  /* Cores log transfers for bus_replay */
+    Bus_Log logs[MAX_CORES];
+    int stall_cycles[MAX_CORES];   /* Wait charged by the last replay */
+    int last_grant;                /* Core granted last, for round robin */
+    int busy_until;                /* First cycle after the current transfer */
+    int busy_cycles;
+    int requests[4];               /* Transactions of each Bus_Request kind */
+    int transactions[MAX_CORES];
+    int wait_cycles[MAX_CORES];    /* Cycles the core's misses queued */
+} Memory_Bus;
+
+void bus_init(Memory_Bus *bus, int num_cores, int deferred);
+void bus_attach(Memory_Bus *bus, int core, DCache *cache, MSHR *mshrs);
+void bus_arbitrate(Memory_Bus *bus, int clock);
+void bus_record(Memory_Bus *bus, int core, int cycle, int line,
+                enum Bus_Request request);
+void bus_replay(Memory_Bus *bus);
+void bus_free(Memory_Bus *bus);
+#endif
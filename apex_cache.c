@@ -0,0 +1,361 @@
+/*
+ * apex_cache.c
+ * Contains APEX data cache and MSHR implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_cache.h"
+#include "apex_macros.h"
+
+void
+dcache_init(DCache *cache)
+{
+    memset(cache, 0, sizeof(DCache));
+}
+
+/* Converts a data memory address into the number of the line holding it */
+int
+dcache_line(int address)
+{
+    return (int)((unsigned int)address / DCACHE_LINE_SIZE);
+}
+
+/* Returns the way holding a line, NULL when it is not cached */
+static DCache_Line *
+find_line(DCache *cache, int line)
+{
+    DCache_Line *set = cache->lines[line % DCACHE_NUM_SETS];
+    int way;
+
+    for (way = 0; way < DCACHE_ASSOC; ++way)
+    {
+        if (set[way].state != LINE_INVALID
+            && set[way].tag == line / DCACHE_NUM_SETS)
+        {
+            return &set[way];
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Looks up the tag store. On a hit the line becomes most recently used, and
+ * is marked modified for writes. A shared line does not hit for a write,
+ * it has to be upgraded first. Statistics are left to the caller, since a
+ * stalled access may look up the same line several times.
+ */
+int
+dcache_lookup(DCache *cache, int address, int is_write)
+{
+    DCache_Line *entry = find_line(cache, dcache_line(address));
+
+    if (!entry || (is_write && entry->state == LINE_SHARED))
+    {
+        return FALSE;
+    }
+
+    entry->last_used = ++cache->access_count;
+    if (is_write)
+    {
+        entry->state = LINE_MODIFIED;
+    }
+    if (entry->prefetched != FILL_DEMAND)
+    {
+        cache->prefetch_hits[entry->prefetched]++;
+        entry->prefetched = FILL_DEMAND;
+    }
+    return TRUE;
+}
+
+/* Checks whether a line is present without touching LRU state, used by the
+ * prefetchers to skip lines the cache already holds */
+int
+dcache_probe(const DCache *cache, int line)
+{
+    return dcache_state(cache, line) != LINE_INVALID;
+}
+
+/* Returns the MESI state of a line, LINE_INVALID when it is not cached */
+enum Line_State
+dcache_state(const DCache *cache, int line)
+{
+    const DCache_Line *set = cache->lines[line % DCACHE_NUM_SETS];
+    int way;
+
+    for (way = 0; way < DCACHE_ASSOC; ++way)
+    {
+        if (set[way].state != LINE_INVALID
+            && set[way].tag == line / DCACHE_NUM_SETS)
+        {
+            return set[way].state;
+        }
+    }
+
+    return LINE_INVALID;
+}
+
+/* Checks whether a missing line was last invalidated by another core, which
+ * makes the miss a coherence miss */
+int
+dcache_invalidated(const DCache *cache, int line)
+{
+    const DCache_Line *set = cache->lines[line % DCACHE_NUM_SETS];
+    int way;
+
+    for (way = 0; way < DCACHE_ASSOC; ++way)
+    {
+        if (set[way].state == LINE_INVALID && set[way].invalidated
+            && set[way].tag == line / DCACHE_NUM_SETS)
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Installs a line returned by memory, evicting the least recently used way.
+ * A modified victim has to be written back over the bus. A line that is
+ * still held, after an upgrade, only changes state.
+ */
+void
+dcache_fill(DCache *cache, int line, enum FillSource prefetched,
+            enum Line_State state)
+{
+    DCache_Line *set = cache->lines[line % DCACHE_NUM_SETS];
+    DCache_Line *victim = find_line(cache, line);
+    int way;
+
+    if (victim)
+    {
+        victim->state = state;
+        victim->last_used = ++cache->access_count;
+        return;
+    }
+
+    victim = &set[0];
+    for (way = 0; way < DCACHE_ASSOC; ++way)
+    {
+        if (set[way].state == LINE_INVALID)
+        {
+            victim = &set[way];
+            break;
+        }
+
+        if (set[way].last_used < victim->last_used)
+        {
+            victim = &set[way];
+        }
+    }
+
+    if (victim->state == LINE_MODIFIED)
+    {
+        cache->writebacks++;
+        cache->pending_writebacks++;
+    }
+
+    if (victim->state != LINE_INVALID && victim->prefetched != FILL_DEMAND)
+    {
+        cache->unused_prefetches[victim->prefetched]++;
+    }
+
+    /* The line is back, an older invalidation no longer explains a miss */
+    for (way = 0; way < DCACHE_ASSOC; ++way)
+    {
+        if (set[way].tag == line / DCACHE_NUM_SETS)
+        {
+            set[way].invalidated = FALSE;
+        }
+    }
+
+    victim->state = state;
+    victim->invalidated = FALSE;
+    victim->prefetched = prefetched;
+    victim->tag = line / DCACHE_NUM_SETS;
+    victim->last_used = ++cache->access_count;
+}
+
+/*
+ * Applies another core's bus request to this cache. A read leaves a shared
+ * copy, a request to write invalidates it. A modified copy is flushed back
+ * to memory either way.
+ */
+void
+dcache_snoop(DCache *cache, int line, enum Bus_Request request)
+{
+    DCache_Line *entry = find_line(cache, line);
+
+    if (!entry)
+    {
+        return;
+    }
+
+    if (entry->state == LINE_MODIFIED)
+    {
+        cache->flushes++;
+        cache->pending_writebacks++;
+    }
+
+    if (request == BUS_READ)
+    {
+        entry->state = LINE_SHARED;
+        return;
+    }
+
+    if (entry->prefetched != FILL_DEMAND)
+    {
+        cache->unused_prefetches[entry->prefetched]++;
+        entry->prefetched = FILL_DEMAND;
+    }
+    entry->state = LINE_INVALID;
+    entry->invalidated = TRUE;
+    cache->invalidations++;
+}
+
+/* Returns the MSHR already fetching this line, if any */
+MSHR *
+mshr_find(MSHR *mshrs, int line)
+{
+    int i;
+
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        if (mshrs[i].valid && mshrs[i].line == line)
+        {
+            return &mshrs[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Claims a free MSHR for a new miss, returns NULL when all are busy. The
+ * line arrives exclusive, or modified when it is fetched to write */
+MSHR *
+mshr_allocate(MSHR *mshrs, int line, int ready_cycle,
+              enum Bus_Request request)
+{
+    int i;
+
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        if (!mshrs[i].valid)
+        {
+            mshrs[i].valid = TRUE;
+            mshrs[i].line = line;
+            mshrs[i].ready_cycle = ready_cycle;
+            mshrs[i].prefetch = FILL_DEMAND;
+            mshrs[i].bus_wait = FALSE;
+            mshrs[i].request = request;
+            mshrs[i].fill_state = (request == BUS_READ) ? LINE_EXCLUSIVE
+                                                        : LINE_MODIFIED;
+            mshrs[i].snooped = -1;
+            mshrs[i].num_targets = 0;
+            return &mshrs[i];
+        }
+    }
+
+    return NULL;
+}
+
+int
+mshr_outstanding(const MSHR *mshrs)
+{
+    int i, count = 0;
+
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        if (mshrs[i].valid)
+        {
+            count++;
+        }
+    }
+
+    return count;
+}
+
+/* Forgets the newest load waiting on the line for this register, its value
+ * reached the register some other way */
+void
+mshr_drop_target(MSHR *mshr, int thread, int rd)
+{
+    int i;
+
+    for (i = mshr->num_targets - 1; i >= 0; --i)
+    {
+        if (mshr->targets[i].thread == thread && mshr->targets[i].rd == rd)
+        {
+            memmove(&mshr->targets[i], &mshr->targets[i + 1],
+                    (mshr->num_targets - i - 1) * sizeof(MSHR_Target));
+            mshr->num_targets--;
+            return;
+        }
+    }
+}
+
+/* Appends a retired store, returns FALSE when the buffer is full */
+int
+store_buffer_push(Store_Buffer *sb, int address, int value)
+{
+    Store_Buffer_Entry *entry;
+
+    if (sb->count == STORE_BUFFER_SIZE)
+    {
+        return FALSE;
+    }
+
+    entry = &sb->entries[(sb->head + sb->count) % STORE_BUFFER_SIZE];
+    entry->address = address;
+    entry->value = value;
+    sb->count++;
+    return TRUE;
+}
+
+/*
+ * Looks for a buffered store to this address, youngest first, so a load
+ * sees the last value written to it. Returns TRUE and the value on a match.
+ */
+int
+store_buffer_search(const Store_Buffer *sb, int address, int *value)
+{
+    int i;
+    const Store_Buffer_Entry *entry;
+
+    for (i = sb->count - 1; i >= 0; --i)
+    {
+        entry = &sb->entries[(sb->head + i) % STORE_BUFFER_SIZE];
+        if (entry->address == address)
+        {
+            *value = entry->value;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+Store_Buffer_Entry *
+store_buffer_head(Store_Buffer *sb)
+{
+    if (!sb->count)
+    {
+        return NULL;
+    }
+
+    return &sb->entries[sb->head];
+}
+
+void
+store_buffer_pop(Store_Buffer *sb)
+{
+    sb->head = (sb->head + 1) % STORE_BUFFER_SIZE;
+    sb->count--;
+}
@@ -0,0 +1,133 @@
+/*
+ * apex_cache.h
+ * Contains APEX data cache and MSHR declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_CACHE_H_
+#define _APEX_CACHE_H_
+
+#include "apex_macros.h"
+
+/* What brought a line into the cache, so prefetches can be credited when
+ * demand later uses the line */
+enum FillSource
+{   FILL_DEMAND,
+    FILL_HW_PREFETCH,
+    FILL_SW_PREFETCH,
+    FILL_RUNAHEAD
+};
+
+/* MESI state of a cached line. Without other cores to share with, lines
+ * are only ever exclusive or modified */
+enum Line_State
+{
+    LINE_INVALID,
+    LINE_SHARED,
+    LINE_EXCLUSIVE,
+    LINE_MODIFIED
+};
+
+/* Bus transactions. A miss asks for a line to read or to write, or for
+ * write permission on a shared line it holds. Modified lines go back to
+ * memory when they are evicted or another core snoops them */
+enum Bus_Request
+{
+    BUS_READ,
+    BUS_READ_EXCLUSIVE,
+    BUS_UPGRADE,
+    BUS_WRITEBACK
+};
+
+/* Store that has retired from Memory but not yet written the data cache */
+typedef struct Store_Buffer_Entry
+{
+    int address;
+    int value;
+} Store_Buffer_Entry;
+
+/* FIFO of retired stores, drained in program order */
+typedef struct Store_Buffer
+{
+    Store_Buffer_Entry entries[STORE_BUFFER_SIZE];
+    int head;                      /* Index of the oldest store */
+    int count;
+    int forwards;                  /* Loads served from the buffer */
+    int full_stalls;               /* Cycles a store found the buffer full */
+    int drain_cycles;              /* Cycles HALT waited for the buffer */
+} Store_Buffer;
+
+/* Tag store entry of the data cache. Data itself always lives in data
+ * memory, the cache only models which lines would hit */
+typedef struct DCache_Line
+{
+    enum Line_State state;
+    int invalidated;               /* Taken away by another core's write */
+    enum FillSource prefetched;    /* Prefetch that brought it in, until used */
+    int tag;
+    int last_used;
+} DCache_Line;
+
+/* Model of a set associative, write-back, write-allocate data cache */
+typedef struct DCache
+{
+    DCache_Line lines[DCACHE_NUM_SETS][DCACHE_ASSOC];
+    int access_count;              /* Used as LRU timestamp */
+    int hits;
+    int misses;
+    int writebacks;
+    int pending_writebacks;        /* Modified lines waiting for the bus */
+    int coherence_misses;          /* Misses on lines another core invalidated */
+    int invalidations;             /* Lines lost to other cores' writes */
+    int flushes;                   /* Modified lines other cores snooped */
+    int prefetch_hits[4];          /* First demand hits on prefetched lines */
+    int unused_prefetches[4];      /* Prefetched lines evicted before use */
+} DCache;
+
+/* A load waiting on an MSHR, value is read at issue so later stores to the
+ * same location cannot leak into it */
+typedef struct MSHR_Target
+{
+    int thread;
+    int rd;
+    int value;
+} MSHR_Target;
+
+/* Miss status holding register, tracks one line being fetched from memory */
+typedef struct MSHR
+{
+    int valid;
+    int line;                      /* Line number, address / DCACHE_LINE_SIZE */
+    int ready_cycle;               /* Clock cycle at which the line arrives */
+    enum FillSource prefetch;      /* Issued by a prefetch, no demand yet */
+    int bus_wait;                  /* Queued for the shared bus */
+    int request_cycle;
+    enum Bus_Request request;
+    enum Line_State fill_state;    /* State the line arrives in */
+    int snooped;                   /* Another core's request to apply after
+                                    * the fill, -1 for none */
+    int num_targets;
+    MSHR_Target targets[MSHR_MAX_TARGETS];
+} MSHR;
+
+void dcache_init(DCache *cache);
+int dcache_line(int address);
+int dcache_lookup(DCache *cache, int address, int is_write);
+int dcache_probe(const DCache *cache, int line);
+enum Line_State dcache_state(const DCache *cache, int line);
+int dcache_invalidated(const DCache *cache, int line);
+void dcache_fill(DCache *cache, int line, enum FillSource prefetched,
+                 enum Line_State state);
+void dcache_snoop(DCache *cache, int line, enum Bus_Request request);
+MSHR *mshr_find(MSHR *mshrs, int line);
+MSHR *mshr_allocate(MSHR *mshrs, int line, int ready_cycle,
+                    enum Bus_Request request);
+int mshr_outstanding(const MSHR *mshrs);
+void mshr_drop_target(MSHR *mshr, int thread, int rd);
+int store_buffer_push(Store_Buffer *sb, int address, int value);
+int store_buffer_search(const Store_Buffer *sb, int address, int *value);
+Store_Buffer_Entry *store_buffer_head(Store_Buffer *sb);
+void store_buffer_pop(Store_Buffer *sb);
+#endif
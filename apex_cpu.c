@@ -6,22 +6,28 @@
  * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
  * State University of New York at Binghamton
  */
+#include <assert.h>
+#include <limits.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "apex_cpu.h"
+#include "apex_dbt.h"
+#include "apex_simpoint.h"
 #include "apex_macros.h"
 
 
-/* Converts the PC(4000 series) into array index for code memory
+/* Converts the PC(4000 series) into a byte offset into code memory
  *
  * Note: You are not supposed to edit this function
  */
 static int
 get_code_memory_index_from_pc(const int pc)
 {
-    return (pc - 4000) / 4;
+    return pc - 4000;
 }
 
 static void
@@ -47,6 +53,26 @@ print_instruction(const CPU_Stage *stage)
                    stage->rs2);
             break;
         }
+        case OPCODE_MAC:
+        {
+            printf("%s,R%d,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1,
+                   stage->rs2);
+            break;
+        }
+        case OPCODE_CMOVZ:
+        case OPCODE_CMOVNZ:
+        case OPCODE_CMOVP:
+        case OPCODE_CMOVN:
+        {
+            printf("%s,R%d,R%d ", stage->opcode_str, stage->rd, stage->rs1);
+            break;
+        }
+        case OPCODE_SHADD:
+        {
+            printf("%s,R%d,R%d,R%d,#%d ", stage->opcode_str, stage->rd,
+                   stage->rs1, stage->rs2, stage->imm);
+            break;
+        }
         case OPCODE_ADDL:
         case OPCODE_SUBL:
         {
@@ -71,6 +97,7 @@ print_instruction(const CPU_Stage *stage)
 
         case OPCODE_STOREP:
         case OPCODE_STORE:
+        case OPCODE_COPY:
         {
             printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
                    stage->imm);
@@ -93,14 +120,63 @@ print_instruction(const CPU_Stage *stage)
             printf("%s,R%d,R%d", stage->opcode_str, stage->rs1, stage->rs2);
             break;
         }
+        case OPCODE_BEQ:
+        case OPCODE_BNE:
+        case OPCODE_BLT:
+        case OPCODE_BGE:
+        {
+            printf("%s,R%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+                   stage->imm);
+            break;
+        }
+        case OPCODE_BEQL:
+        case OPCODE_BNEL:
+        case OPCODE_BLTL:
+        case OPCODE_BGEL:
+        {
+            printf("%s,R%d,#%d,#%d ", stage->opcode_str, stage->rs1,
+                   stage->literal, stage->imm);
+            break;
+        }
         case OPCODE_JUMP:
         case OPCODE_CML:
+        case OPCODE_PREFETCH:
+        case OPCODE_LOOP:
         {
             printf("%s,R%d,#%d", stage->opcode_str, stage->rs1, stage->imm);
             break;
         }
 
+        case OPCODE_VLOAD:
+        {
+            printf("%s,V%d,R%d,#%d ", stage->opcode_str, stage->rd, stage->rs1,
+                   stage->imm);
+            break;
+        }
+
+        case OPCODE_VSTORE:
+        {
+            printf("%s,V%d,R%d,#%d ", stage->opcode_str, stage->rs1, stage->rs2,
+                   stage->imm);
+            break;
+        }
+
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+        {
+            printf("%s,V%d,V%d,V%d ", stage->opcode_str, stage->rd, stage->rs1,
+                   stage->rs2);
+            break;
+        }
+
+        case OPCODE_VRED:
+        {
+            printf("%s,R%d,V%d ", stage->opcode_str, stage->rd, stage->rs1);
+            break;
+        }
+
         case OPCODE_HALT:
+        case OPCODE_DMAWAIT:
         {
             printf("%s", stage->opcode_str);
             break;
@@ -115,8 +191,46 @@ print_instruction(const CPU_Stage *stage)
 static void
 print_stage_content(const char *name, const CPU_Stage *stage)
 {
-    printf("%-15s: pc(%d) ", name, stage->pc);
+    printf("%-15s: T%d pc(%d) ", name, stage->thread, stage->pc);
     print_instruction(stage);
+    if (stage->fused)
+    {
+        printf(" + fused branch,#%d", stage->fused_imm);
+    }
+    if (stage->runahead)
+    {
+        printf(stage->invalid ? " (runahead, invalid)" : " (runahead)");
+    }
+    printf("\n");
+}
+
+/* Fills in the instruction fields of a latch from the encoding Fetch read */
+static void
+decode_instruction(CPU_Stage *stage)
+{
+    APEX_Instruction ins;
+
+    isa_decode(stage->insn, &ins);
+    strcpy(stage->opcode_str, ins.opcode_str);
+    stage->opcode = ins.opcode;
+    stage->rd = ins.rd;
+    stage->rs1 = ins.rs1;
+    stage->rs2 = ins.rs2;
+    stage->imm = ins.imm;
+    stage->literal = ins.literal;
+}
+
+/* Fetch only holds the encoding, which is printed along with what Decode
+ * will make of it */
+static void
+print_fetch_content(const CPU_Stage *stage)
+{
+    CPU_Stage shown = *stage;
+
+    decode_instruction(&shown);
+    printf("%-15s: T%d pc(%d) [%0*llx] ", "Fetch", stage->thread, stage->pc,
+           stage->size * 2, stage->insn);
+    print_instruction(&shown);
     printf("\n");
 }
 
@@ -125,7 +239,7 @@ print_stage_content(const char *name, const CPU_Stage *stage)
  * Note: You are not supposed to edit this function
  */
 static void
-print_reg_file(const APEX_CPU *cpu)
+print_reg_file(const APEX_Thread *thread)
 {
     int i;
 
@@ -133,26 +247,26 @@ print_reg_file(const APEX_CPU *cpu)
 
     for (int i = 0; i < REG_FILE_SIZE / 2; ++i)
     {
-        printf("R%-3d[%-3d] ", i, cpu->regs[i]);
+        printf("R%-3d[%-3d] ", i, thread->regs[i]);
     }
 
     printf("\n");
 
     for (i = (REG_FILE_SIZE / 2); i < REG_FILE_SIZE; ++i)
     {
-        printf("R%-3d[%-3d] ", i, cpu->regs[i]);
+        printf("R%-3d[%-3d] ", i, thread->regs[i]);
     }
 
     printf("\n");
-    printf("P = %d\n", cpu->positive_flag);
-    printf("N = %d\n", cpu->negative_flag);
-    printf("Z = %d\n", cpu->zero_flag);
+    printf("P = %d\n", thread->positive_flag);
+    printf("N = %d\n", thread->negative_flag);
+    printf("Z = %d\n", thread->zero_flag);
     printf("\n");
 
     // for (int i = 2000; i < 2010; ++i)
     // {
     //     printf("MEM[%-3d%s ", i, "]");
-    //     printf("      DATA VALUE = %-4d", cpu->data_memory[i]);
+    //     printf("      DATA VALUE = %-4d", mem_read(cpu->data_memory, i));
     //     printf("\n");
     // }
 
@@ -163,7 +277,7 @@ print_reg_file(const APEX_CPU *cpu)
  * Note: You are not supposed to edit this function
  */
 static void
-print_score_file(const APEX_CPU *cpu)
+print_score_file(const APEX_Thread *thread)
 {
     int i;
 
@@ -171,211 +285,2595 @@ print_score_file(const APEX_CPU *cpu)
 
     for (int i = 0; i < REG_FILE_SIZE / 2; ++i)
     {
-        printf("R%-3d[%-3d] ", i, cpu->status[i]);
+        printf("R%-3d[%-3d] ", i, thread->status[i]);
     }
 
     printf("\n");
 
     for (i = (REG_FILE_SIZE / 2); i < REG_FILE_SIZE; ++i)
     {
-        printf("R%-3d[%-3d] ", i, cpu->status[i]);
+        printf("R%-3d[%-3d] ", i, thread->status[i]);
     }
 
     printf("\n");
 }
 
-/*
- * Fetch Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
- */
+/* Debug function which prints the vector register file */
 static void
-APEX_fetch(APEX_CPU *cpu)
+print_vector_reg_file(const APEX_Thread *thread)
 {
-    APEX_Instruction *current_ins;
+    int i, j;
 
-    if (cpu->fetch.has_insn)
+    printf("----------\n%s\n----------\n", "Vector Registers:");
+
+    for (i = 0; i < VECTOR_REG_FILE_SIZE; ++i)
     {
-        /* This fetches new branch target instruction from next cycle */
-        if (cpu->fetch_from_next_cycle == TRUE)
+        printf("V%-3d[", i);
+        for (j = 0; j < VECTOR_LENGTH; ++j)
         {
-            cpu->fetch_from_next_cycle = FALSE;
+            printf(j ? " %d" : "%d", thread->vregs[i][j]);
+        }
+        printf("]%s", (i % 4 == 3) ? "\n" : " ");
+    }
 
-            /* Skip this cycle*/
-            return;
+    printf("\n");
+}
+
+/* Returns TRUE for instructions that write their rd register */
+static int
+writes_rd(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_MOVC:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_JALR:
+        case OPCODE_VRED:
+        case OPCODE_MAC:
+        case OPCODE_SHADD:
+        case OPCODE_CMOVZ:
+        case OPCODE_CMOVNZ:
+        case OPCODE_CMOVP:
+        case OPCODE_CMOVN:
+        {
+            return TRUE;
         }
-        if(cpu->stall == 1){
-            cpu->fetch_from_next_cycle = FALSE;
-            cpu->fetch.pc = cpu->pc;
-            current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-            strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-            cpu->fetch.opcode = current_ins->opcode;
-            cpu->fetch.rd = current_ins->rd;
-            cpu->fetch.rs1 = current_ins->rs1;
-            cpu->fetch.rs2 = current_ins->rs2;
-            cpu->fetch.imm = current_ins->imm;
-            if (ENABLE_DEBUG_MESSAGES)
-            {
-                print_stage_content("Fetch", &cpu->fetch);
-            }
-            return;
+    }
+
+    return FALSE;
+}
+
+/* Returns TRUE for the branches that test the flags */
+static int
+is_flag_branch(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            return TRUE;
         }
+    }
+
+    return FALSE;
+}
+
+/* Evaluates a flag branch against the current flags */
+static int
+flag_branch_taken(const APEX_Thread *thread, int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+            return thread->zero_flag == TRUE;
+        case OPCODE_BNZ:
+            return thread->zero_flag == FALSE;
+        case OPCODE_BP:
+            return thread->positive_flag == TRUE;
+        case OPCODE_BNP:
+            return thread->positive_flag == FALSE;
+        case OPCODE_BN:
+            return thread->negative_flag == TRUE;
+        case OPCODE_BNN:
+            return thread->negative_flag == FALSE;
+    }
 
-        /* Store current PC in fetch latch */
-        cpu->fetch.pc = cpu->pc;
+    return FALSE;
+}
 
-        /* Index into code memory using this pc and copy all instruction fields
-         * into fetch latch  */
-        current_ins = &cpu->code_memory[get_code_memory_index_from_pc(cpu->pc)];
-        strcpy(cpu->fetch.opcode_str, current_ins->opcode_str);
-        cpu->fetch.opcode = current_ins->opcode;
-        cpu->fetch.rd = current_ins->rd;
-        cpu->fetch.rs1 = current_ins->rs1;
-        cpu->fetch.rs2 = current_ins->rs2;
-        cpu->fetch.imm = current_ins->imm;
+/* Returns TRUE if next_pc is just past the body of an active hardware loop */
+static int
+is_loop_end(const APEX_Thread *thread, int next_pc)
+{
+    int i;
 
-        /* Update PC for next instruction */
-        cpu->pc += 4;
+    for (i = 0; i < thread->loop_depth; ++i)
+    {
+        if (thread->loop_stack[i].end == next_pc)
+        {
+            return TRUE;
+        }
+    }
 
-        /* Copy data from fetch latch to decode latch*/
-        cpu->decode = cpu->fetch;
+    return FALSE;
+}
 
-        if (ENABLE_DEBUG_MESSAGES)
+/*
+ * Sets up the hardware loop of a LOOP leaving Decode. The body is the next
+ * imm bytes, which the loader worked out from the instruction count in the
+ * source, run Rc times. Fetch has not gone past the first body instruction
+ * yet, so a loop that runs zero times simply skips its body.
+ */
+static void
+hw_loop_start(APEX_Thread *thread, const CPU_Stage *stage)
+{
+    HW_Loop *loop;
+    int start = stage->pc + stage->size;
+    int end = start + stage->imm;
+
+    if (stage->rs1_value <= 0 || stage->imm <= 0)
+    {
+        thread->pc = end;
+        return;
+    }
+
+    assert(thread->loop_depth < HW_LOOP_DEPTH && "Hardware loops nested too deep");
+    assert((!thread->loop_depth || end < thread->loop_stack[thread->loop_depth - 1].end)
+           && "Nested hardware loop must end before the enclosing one");
+
+    loop = &thread->loop_stack[thread->loop_depth++];
+    loop->start = start;
+    loop->end = end;
+    loop->remaining = stage->rs1_value;
+}
+
+/* Called by Fetch for every instruction it reads, with the PC after it.
+ * At the end of the innermost body it either goes back to the start or
+ * retires the loop. Progress made running ahead is not counted */
+static enum LoopUpdate
+hw_loop_fetch(APEX_CPU *cpu, APEX_Thread *thread, int next_pc)
+{
+    HW_Loop *loop;
+
+    if (!thread->loop_depth)
+    {
+        return LOOP_NONE;
+    }
+
+    loop = &thread->loop_stack[thread->loop_depth - 1];
+    if (next_pc != loop->end)
+    {
+        return LOOP_NONE;
+    }
+
+    if (--loop->remaining > 0)
+    {
+        thread->pc = loop->start;
+        if (!thread->runahead.active)
         {
-            print_stage_content("Fetch", &cpu->fetch);
+            cpu->loop_backs++;
         }
+        return LOOP_BACK;
+    }
+
+    thread->loop_depth--;
+    return LOOP_DONE;
+}
 
-        /* Stop fetching new instructions if HALT is fetched */
-        if (cpu->fetch.opcode == OPCODE_HALT)
+/* Takes back the loop progress made by fetching an instruction that is
+ * squashed or that redirects fetch itself */
+static void
+hw_loop_undo(APEX_CPU *cpu, APEX_Thread *thread, enum LoopUpdate update)
+{
+    if (update == LOOP_BACK)
+    {
+        thread->loop_stack[thread->loop_depth - 1].remaining++;
+        if (!thread->runahead.active)
         {
-            cpu->fetch.has_insn = FALSE;
+            cpu->loop_backs--;
         }
     }
+    else if (update == LOOP_DONE)
+    {
+        thread->loop_stack[thread->loop_depth++].remaining = 1;
+    }
 }
 
 /*
- * Decode Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Falls back to ordinary control flow when fetch is redirected. The
+ * instruction taken back may have advanced a loop, which is undone. A
+ * target outside a body then ends that loop, as a break would, while a
+ * target inside it keeps the loop running.
  */
 static void
-APEX_decode(APEX_CPU *cpu)
+hw_loop_redirect(APEX_CPU *cpu, APEX_Thread *thread, enum LoopUpdate undone)
 {
-    if (cpu->decode.has_insn)
+    HW_Loop *loop;
+
+    hw_loop_undo(cpu, thread, undone);
+    while (thread->loop_depth)
     {
-            /* Read operands from register file based on the instruction type */
-            switch (cpu->decode.opcode)
-            {
-                case OPCODE_ADD:
-                {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2] )== BUSY){
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
-                }
+        loop = &thread->loop_stack[thread->loop_depth - 1];
+        if (thread->pc >= loop->start && thread->pc < loop->end)
+        {
+            break;
+        }
+        thread->loop_depth--;
+        if (!thread->runahead.active)
+        {
+            cpu->loop_branch_exits++;
+        }
+    }
+}
 
-                case OPCODE_ADDL:
-                {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
-                }
+/* Returns TRUE when the loop buffer is replaying a loop that holds pc */
+static int
+loop_buffer_holds(const APEX_Thread *thread, int pc)
+{
+    const Loop_Buffer *lb = &thread->loop_buffer;
 
-                case OPCODE_SUB:
-                {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
-                }
+    return lb->state == LB_ACTIVE && pc >= lb->start && pc <= lb->end;
+}
 
-                case OPCODE_SUBL:
-                {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
-                }
+/* Returns the encoding at pc and its size. The loop buffer serves the body
+ * of the loop it holds, with code memory left idle, everything else is
+ * read from code memory */
+static unsigned long long
+fetch_instruction(APEX_CPU *cpu, APEX_Thread *thread, int pc, int *size)
+{
+    Loop_Buffer *lb = &thread->loop_buffer;
+    unsigned long long insn;
 
-                case OPCODE_MUL:
-                {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
-                }
+    if (loop_buffer_holds(thread, pc))
+    {
+        lb->hits++;
+        insn = isa_fetch(lb->code, lb->length, pc - lb->start, size);
+    }
+    else
+    {
+        insn = isa_fetch(thread->code_memory, thread->code_memory_size,
+                         get_code_memory_index_from_pc(pc), size);
+    }
 
-                case OPCODE_AND:
-                {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
+    cpu->fetches++;
+    cpu->fetch_bytes += *size;
+    return insn;
+}
+
+/*
+ * Tracks loops for the loop buffer as control flow resolves in Execute. A
+ * taken backward branch over a body that fits the buffer starts a capture, which fills the buffer while that iteration runs from code
+ * memory. When the branch is taken again the buffer starts replaying. The
+ * loop is dropped once its branch falls through or control leaves it.
+ */
+static void
+loop_buffer_update(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    APEX_Thread *thread = &cpu->threads[stage->thread];
+    Loop_Buffer *lb = &thread->loop_buffer;
+    int branch_pc = stage->fused ? stage->pc + stage->size : stage->pc;
+    int offset = get_code_memory_index_from_pc(thread->pc);
+    int length;
+
+    if (!thread->fetch_from_next_cycle)
+    {
+        if (lb->state != LB_IDLE && branch_pc == lb->end)
+        {
+            lb->state = LB_IDLE;
+        }
+        return;
+    }
+
+    if (lb->state != LB_IDLE && thread->pc >= lb->start && thread->pc <= lb->end)
+    {
+        if (lb->state == LB_CAPTURE && branch_pc == lb->end)
+        {
+            lb->state = LB_ACTIVE;
+            lb->captures++;
+        }
+        return;
+    }
+
+    lb->state = LB_IDLE;
+    isa_fetch(thread->code_memory, thread->code_memory_size,
+              get_code_memory_index_from_pc(branch_pc), &length);
+    length += branch_pc - thread->pc;
+    if (thread->pc < branch_pc && length <= (int)sizeof(lb->code) && offset >= 0
+        && offset + length <= thread->code_memory_size
+        && stage->opcode != OPCODE_JUMP && stage->opcode != OPCODE_JALR)
+    {
+        lb->state = LB_CAPTURE;
+        lb->start = thread->pc;
+        lb->end = branch_pc;
+        lb->length = length;
+        memcpy(lb->code, &thread->code_memory[offset], length);
+    }
+}
+
+/*
+ * Fuses a CMP/CML leaving Decode with a flag branch that directly follows
+ * it. The branch rides along in the compare's latch and Fetch skips over
+ * it, so the pair uses one slot. Only done when Fetch is about to read the
+ * branch, i.e. the pair is reached sequentially.
+ */
+static void
+fuse_compare_branch(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    APEX_Thread *thread = &cpu->threads[stage->thread];
+    int next_pc = stage->pc + stage->size;
+    int index = get_code_memory_index_from_pc(next_pc);
+    APEX_Instruction next;
+    int size;
+
+    stage->fused = FALSE;
+    if ((stage->opcode != OPCODE_CMP && stage->opcode != OPCODE_CML)
+        || thread->pc != next_pc || index >= thread->code_memory_size)
+    {
+        return;
+    }
+
+    /* Fetch must still see a branch that closes a hardware loop body */
+    isa_decode(isa_fetch(thread->code_memory, thread->code_memory_size, index,
+                         &size), &next);
+    if (!is_flag_branch(next.opcode) || is_loop_end(thread, next_pc + size))
+    {
+        return;
+    }
+
+    stage->fused = TRUE;
+    stage->fused_opcode = next.opcode;
+    stage->fused_imm = next.imm;
+    thread->pc += size;
+    if (!stage->runahead)
+    {
+        cpu->fused_pairs++;
+    }
+}
+
+/* Cycles an instruction occupies Execute */
+static int
+execute_latency(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_MUL:
+        case OPCODE_MAC:
+        {
+            return MUL_LATENCY;
+        }
+    }
+
+    return 1;
+}
+
+/* Returns TRUE for a load of the thread in flight ahead of Memory's cache
+ * access, which may yet miss and write rd from an MSHR. A predicted load
+ * settles that with the writer in Execute when it is verified */
+static int
+older_load_of(const CPU_Stage *older, const CPU_Stage *stage)
+{
+    return older->has_insn && !older->runahead
+           && older->thread == stage->thread
+           && (older->opcode == OPCODE_LOAD || older->opcode == OPCODE_LOADP)
+           && older->rd == stage->rd && !older->mshr_pending
+           && !older->value_predicted;
+}
+
+/* Returns TRUE if a load miss still owes, or may still owe, this
+ * instruction's rd register. The fill would overwrite a younger result, so
+ * such writers wait in Decode */
+static int
+rd_pending_fill(const APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    int i, j;
+
+    if (!writes_rd(stage->opcode))
+    {
+        return FALSE;
+    }
+
+    if (older_load_of(&cpu->execute, stage)
+        || older_load_of(&cpu->memory, stage))
+    {
+        return TRUE;
+    }
+
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        for (j = 0; cpu->mshr[i].valid && j < cpu->mshr[i].num_targets; ++j)
+        {
+            if (cpu->mshr[i].targets[j].thread == stage->thread
+                && cpu->mshr[i].targets[j].rd == stage->rd)
+            {
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Reads and writes data memory for a core. With several cores their stores
+ * are held in a log until the cores stop at the end of the quantum, so
+ * they can run in parallel and data memory changes in a fixed order. A
+ * sampled window holds them too, and they are thrown away after it.
+ */
+static int
+read_data(APEX_CPU *cpu, int address)
+{
+    if (cpu->hold_stores)
+    {
+        return mem_log_read(cpu->data_memory, &cpu->mem_log, address);
+    }
+
+    return mem_read(cpu->data_memory, address);
+}
+
+static void
+write_data(APEX_CPU *cpu, int address, int value)
+{
+    if (cpu->hold_stores)
+    {
+        mem_log_write(&cpu->mem_log, address, value);
+        return;
+    }
+
+    mem_write(cpu->data_memory, address, value);
+}
+
+/* State of lines filled outside the MSHRs, which are never snooped for */
+static enum Line_State
+unsnooped_fill_state(const APEX_CPU *cpu)
+{
+    return cpu->bus ? LINE_SHARED : LINE_EXCLUSIVE;
+}
+
+/*
+ * Looks for a missing line in the stream buffer and returns the cycle it is
+ * available. A line that has already arrived moves into the cache. When
+ * the stream does not hold the line it restarts right after it. Its refills
+ * take no MSHR or bus slot, so they are not counted as issued prefetches.
+ */
+static int
+stream_buffer_access(APEX_CPU *cpu, int line)
+{
+    Stream_Entry *entry = stream_buffer_find(&cpu->prefetcher, line);
+    int ready_cycle;
+
+    if (!entry)
+    {
+        stream_buffer_start(&cpu->prefetcher, line,
+                            cpu->clock + DCACHE_MISS_LATENCY);
+        return cpu->clock + DCACHE_MISS_LATENCY;
+    }
+
+    ready_cycle = entry->ready_cycle;
+    stream_buffer_advance(&cpu->prefetcher, entry,
+                          cpu->clock + DCACHE_MISS_LATENCY);
+
+    if (ready_cycle <= cpu->clock)
+    {
+        dcache_fill(&cpu->dcache, line, FILL_DEMAND,
+                    unsnooped_fill_state(cpu));
+        cpu->prefetcher.stream_hits++;
+    }
+    else
+    {
+        cpu->prefetcher.stream_late++;
+    }
+    return ready_cycle;
+}
+
+/* Returns TRUE for addresses that belong to the scratchpad */
+static int
+in_scratchpad(int address)
+{
+    return ENABLE_SCRATCHPAD
+           && (unsigned int)(address - SCRATCHPAD_BASE) < SCRATCHPAD_SIZE;
+}
+
+/*
+ * Scratchpad accesses skip the data cache, the store buffer and the
+ * prefetchers, and hold Memory for a fixed SCRATCHPAD_LATENCY cycles.
+ * Returns TRUE in the cycle the access completes.
+ */
+static int
+scratchpad_access(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    if (!stage->spm_ready_cycle)
+    {
+        stage->spm_ready_cycle = cpu->clock + SCRATCHPAD_LATENCY;
+        cpu->spm_accesses++;
+    }
+
+    return cpu->clock + 1 >= stage->spm_ready_cycle;
+}
+
+/*
+ * Claims an MSHR for a line that has to come from memory. With several
+ * cores the transfer also queues for the shared bus, and ready_cycle moves
+ * back by however long it waits there. Cores running longer quanta start
+ * it right away and leave it for the bus to replay.
+ */
+static MSHR *
+allocate_miss(APEX_CPU *cpu, int line, int ready_cycle,
+              enum Bus_Request request)
+{
+    MSHR *mshr = mshr_allocate(cpu->mshr, line, ready_cycle, request);
+
+    if (mshr && cpu->bus && cpu->bus->deferred)
+    {
+        bus_record(cpu->bus, cpu->core, cpu->clock, line, request);
+    }
+    else if (mshr && cpu->bus)
+    {
+        mshr->bus_wait = TRUE;
+        mshr->request_cycle = cpu->clock;
+    }
+    if (mshr && dcache_invalidated(&cpu->dcache, line))
+    {
+        cpu->dcache.coherence_misses++;
+    }
+    return mshr;
+}
+
+/*
+ * Claims an MSHR to get write permission on a line. A shared copy only
+ * needs an upgrade that invalidates the others, anything else fetches the
+ * line to write it.
+ */
+static MSHR *
+allocate_write_miss(APEX_CPU *cpu, int line)
+{
+    if (dcache_probe(&cpu->dcache, line))
+    {
+        return allocate_miss(cpu, line, cpu->clock + BUS_UPGRADE_CYCLES,
+                             BUS_UPGRADE);
+    }
+
+    return allocate_miss(cpu, line, cpu->clock + DCACHE_MISS_LATENCY,
+                         BUS_READ_EXCLUSIVE);
+}
+
+/*
+ * Sends a LOAD/LOADP to the data cache. Hits read data memory right away.
+ * Misses are handed to an MSHR, which writes rd once the line arrives, so
+ * the load itself moves on and only its consumers wait on the scoreboard.
+ * Returns FALSE when no MSHR can take the miss.
+ */
+static int
+issue_load(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    int line = dcache_line(stage->memory_address);
+    int ready_cycle;
+    MSHR *mshr;
+
+    stage->mshr_pending = FALSE;
+
+    /* A buffered store to this address holds the latest value */
+    if (ENABLE_STORE_BUFFER
+        && store_buffer_search(&cpu->store_buffer, stage->memory_address,
+                               &stage->result_buffer))
+    {
+        cpu->store_buffer.forwards++;
+        return TRUE;
+    }
+
+    cpu->dcache_busy = TRUE;
+    if (dcache_lookup(&cpu->dcache, stage->memory_address, FALSE))
+    {
+        stage->result_buffer = read_data(cpu, stage->memory_address);
+        cpu->dcache.hits++;
+        if (mshr_outstanding(cpu->mshr))
+        {
+            cpu->hits_under_miss++;
+        }
+        return TRUE;
+    }
+
+    mshr = mshr_find(cpu->mshr, line);
+    if (mshr)
+    {
+        if (mshr->num_targets == MSHR_MAX_TARGETS)
+        {
+            cpu->mshr_full_stalls++;
+            return FALSE;
+        }
+
+        /* Demand caught up with a prefetch still in flight */
+        if (mshr->prefetch == FILL_HW_PREFETCH)
+        {
+            cpu->prefetcher.late++;
+        }
+        else if (mshr->prefetch == FILL_SW_PREFETCH)
+        {
+            cpu->sw_prefetch_late++;
+        }
+        else if (mshr->prefetch == FILL_RUNAHEAD)
+        {
+            cpu->runahead_late++;
+            cpu->runahead_hidden += DCACHE_MISS_LATENCY
+                                    - (mshr->ready_cycle - cpu->clock);
+        }
+        mshr->prefetch = FILL_DEMAND;
+        cpu->mshr_merges++;
+    }
+    else
+    {
+        if (mshr_outstanding(cpu->mshr) == NUM_MSHRS)
+        {
+            cpu->mshr_full_stalls++;
+            return FALSE;
+        }
+
+        ready_cycle = cpu->clock + DCACHE_MISS_LATENCY;
+        if (ENABLE_STREAM_BUFFER)
+        {
+            ready_cycle = stream_buffer_access(cpu, line);
+            if (ready_cycle <= cpu->clock)
+            {
+                stage->result_buffer = read_data(cpu, stage->memory_address);
+                return TRUE;
+            }
+        }
+        mshr = allocate_miss(cpu, line, ready_cycle, BUS_READ);
+    }
+
+    mshr->targets[mshr->num_targets].thread = stage->thread;
+    mshr->targets[mshr->num_targets].rd = stage->rd;
+    mshr->targets[mshr->num_targets].value
+        = read_data(cpu, stage->memory_address);
+    stage->result_buffer = mshr->targets[mshr->num_targets].value;
+    mshr->num_targets++;
+    cpu->dcache.misses++;
+    stage->mshr_pending = TRUE;
+    return TRUE;
+}
+
+/*
+ * Sends a VLOAD/VSTORE to the data cache. The access covers VECTOR_LENGTH
+ * words, which may span several lines. It waits in Memory until every line
+ * is present, missing ones are fetched in parallel through the MSHRs.
+ * Vectors starting in the scratchpad take its fixed latency instead.
+ * Returns TRUE once the access can complete.
+ */
+static int
+vector_access_ready(APEX_CPU *cpu, CPU_Stage *stage, int is_write)
+{
+    int first = dcache_line(stage->memory_address);
+    int last = dcache_line(stage->memory_address
+                           + (VECTOR_LENGTH - 1) * DATA_WORD_STRIDE);
+    int line, present = TRUE;
+    enum Line_State state;
+
+    if (in_scratchpad(stage->memory_address))
+    {
+        return scratchpad_access(cpu, stage);
+    }
+
+    cpu->dcache_busy = TRUE;
+    for (line = first; line <= last; ++line)
+    {
+        state = dcache_state(&cpu->dcache, line);
+        if (state == LINE_EXCLUSIVE || state == LINE_MODIFIED
+            || (state == LINE_SHARED && !is_write))
+        {
+            if (!stage->mshr_pending)
+            {
+                cpu->dcache.hits++;
+            }
+            continue;
+        }
+
+        present = FALSE;
+        if (!stage->mshr_pending)
+        {
+            cpu->dcache.misses++;
+        }
+        if (!mshr_find(cpu->mshr, line)
+            && !(is_write ? allocate_write_miss(cpu, line)
+                          : allocate_miss(cpu, line,
+                                          cpu->clock + DCACHE_MISS_LATENCY,
+                                          BUS_READ)))
+        {
+            cpu->mshr_full_stalls++;
+        }
+    }
+
+    if (!present)
+    {
+        stage->mshr_pending = TRUE;
+        return FALSE;
+    }
+
+    for (line = first; line <= last; ++line)
+    {
+        dcache_lookup(&cpu->dcache, line * DCACHE_LINE_SIZE, is_write);
+    }
+    stage->mshr_pending = FALSE;
+    return TRUE;
+}
+
+/*
+ * Advances the page walk of a TLB. Each level reads one page table entry
+ * through the data cache. A hit costs a cycle, while a miss is sent to
+ * memory through an MSHR like any other and the walk waits for the fill.
+ * Returns TRUE once the last level has been read.
+ */
+static int
+page_walk_step(APEX_CPU *cpu, TLB *tlb)
+{
+    int bits = (32 - VM_PAGE_BITS + VM_WALK_LEVELS - 1) / VM_WALK_LEVELS;
+    unsigned int index;
+    int address, line;
+
+    while (tlb->walk_level < VM_WALK_LEVELS
+           && cpu->clock >= tlb->walk_done_cycle)
+    {
+        index = (tlb->walk_vpn >> (bits * (VM_WALK_LEVELS - 1 - tlb->walk_level)))
+                & ((1u << bits) - 1);
+        address = (int)(PAGE_TABLE_BASE + (tlb->walk_table << bits) + index);
+        line = dcache_line(address);
+
+        /* The line is on its way, for this walk or another miss */
+        if (mshr_find(cpu->mshr, line))
+        {
+            return FALSE;
+        }
+
+        if (tlb->walk_filling)
+        {
+            tlb->walk_filling = FALSE;
+        }
+        else if (dcache_lookup(&cpu->dcache, address, FALSE))
+        {
+            cpu->walk_accesses++;
+            tlb->walk_done_cycle = cpu->clock + 1;
+        }
+        else
+        {
+            if (mshr_outstanding(cpu->mshr) == NUM_MSHRS)
+            {
+                return FALSE;
+            }
+            cpu->walk_accesses++;
+            cpu->walk_cache_misses++;
+            allocate_miss(cpu, line, cpu->clock + DCACHE_MISS_LATENCY,
+                          BUS_READ);
+            tlb->walk_filling = TRUE;
+            return FALSE;
+        }
+
+        /* Next level table, numbered in walk order below the base */
+        tlb->walk_table = (tlb->walk_table << bits) + index + 1;
+        tlb->walk_level++;
+    }
+
+    return tlb->walk_level == VM_WALK_LEVELS
+           && cpu->clock >= tlb->walk_done_cycle;
+}
+
+/*
+ * Translates address through a TLB. A miss starts a page walk, and the
+ * caller waits until it has finished. Returns TRUE once the page is mapped.
+ */
+static int
+translate(APEX_CPU *cpu, TLB *tlb, int address)
+{
+    unsigned int vpn = (unsigned int)address >> VM_PAGE_BITS;
+
+    if (tlb->walking)
+    {
+        if (!page_walk_step(cpu, tlb))
+        {
+            return FALSE;
+        }
+        tlb_insert(tlb, tlb->walk_vpn);
+        tlb->walking = FALSE;
+        tlb->walk_cycles += cpu->clock - tlb->walk_start_cycle;
+    }
+
+    if (tlb_lookup(tlb, vpn))
+    {
+        tlb->hits++;
+        return TRUE;
+    }
+
+    tlb->misses++;
+    tlb->walking = TRUE;
+    tlb->walk_vpn = vpn;
+    tlb->walk_level = 0;
+    tlb->walk_table = 0;
+    tlb->walk_filling = FALSE;
+    tlb->walk_start_cycle = cpu->clock;
+    tlb->walk_done_cycle = cpu->clock;
+    page_walk_step(cpu, tlb);
+    return FALSE;
+}
+
+/*
+ * Fetches the line holding address into the data cache ahead of demand,
+ * unless it is present or in flight. Never stalls, a prefetch that finds
+ * no MSHR is dropped. Hardware prefetches always keep one MSHR for demand.
+ */
+static void
+issue_prefetch(APEX_CPU *cpu, int address, enum FillSource source)
+{
+    int line = dcache_line(address);
+    int reserved = (source == FILL_HW_PREFETCH) ? 1 : 0;
+    MSHR *mshr;
+
+    if (dcache_probe(&cpu->dcache, line) || mshr_find(cpu->mshr, line))
+    {
+        if (source == FILL_SW_PREFETCH)
+        {
+            cpu->sw_prefetch_redundant++;
+        }
+        return;
+    }
+
+    /* Prefetches never start page walks, an unmapped page drops them */
+    if (mshr_outstanding(cpu->mshr) >= NUM_MSHRS - reserved
+        || (ENABLE_VIRTUAL_MEMORY
+            && !tlb_lookup(&cpu->dtlb, (unsigned int)address >> VM_PAGE_BITS)))
+    {
+        if (source == FILL_HW_PREFETCH)
+        {
+            cpu->prefetcher.dropped++;
+        }
+        else
+        {
+            cpu->sw_prefetch_dropped++;
+        }
+        return;
+    }
+
+    mshr = allocate_miss(cpu, line, cpu->clock + DCACHE_MISS_LATENCY,
+                         BUS_READ);
+    mshr->prefetch = source;
+    if (source == FILL_HW_PREFETCH)
+    {
+        cpu->prefetcher.issued++;
+    }
+    else
+    {
+        cpu->sw_prefetches++;
+    }
+}
+
+/* Trains the stride prefetcher with a load that has been accepted by
+ * Memory, and issues whatever prefetches it predicts */
+static void
+train_prefetcher(APEX_CPU *cpu, const CPU_Stage *stage)
+{
+    int addresses[PREFETCH_DEGREE];
+    int i, count;
+
+    count = prefetch_train(&cpu->prefetcher, stage->pc,
+                           stage->memory_address, addresses);
+    for (i = 0; i < count; ++i)
+    {
+        issue_prefetch(cpu, addresses[i], FILL_HW_PREFETCH);
+    }
+}
+
+/*
+ * Sends a STORE/STOREP to the data cache. Stores write-allocate and wait in
+ * Memory until their line is present and writable. Returns TRUE once the
+ * store can write.
+ */
+static int
+issue_store(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    int line = dcache_line(stage->memory_address);
+
+    cpu->dcache_busy = TRUE;
+    if (dcache_lookup(&cpu->dcache, stage->memory_address, TRUE))
+    {
+        if (!stage->mshr_pending)
+        {
+            cpu->dcache.hits++;
+        }
+        stage->mshr_pending = FALSE;
+        return TRUE;
+    }
+
+    if (!mshr_find(cpu->mshr, line) && !allocate_write_miss(cpu, line))
+    {
+        cpu->mshr_full_stalls++;
+        return FALSE;
+    }
+
+    if (!stage->mshr_pending)
+    {
+        cpu->dcache.misses++;
+        stage->mshr_pending = TRUE;
+    }
+    return FALSE;
+}
+
+/*
+ * Writes the oldest buffered store into the data cache when Memory left the
+ * cache port free this cycle. A store miss allocates an MSHR for its line
+ * and retries until the line arrives, younger stores queue behind it.
+ */
+static void
+drain_store_buffer(APEX_CPU *cpu)
+{
+    Store_Buffer_Entry *entry = store_buffer_head(&cpu->store_buffer);
+    int line;
+
+    if (entry && !cpu->dcache_busy)
+    {
+        line = dcache_line(entry->address);
+        if (dcache_lookup(&cpu->dcache, entry->address, TRUE))
+        {
+            write_data(cpu, entry->address, entry->value);
+            cpu->dcache.hits++;
+            store_buffer_pop(&cpu->store_buffer);
+        }
+        else if (!mshr_find(cpu->mshr, line) && allocate_write_miss(cpu, line))
+        {
+            cpu->dcache.misses++;
+        }
+    }
+
+    cpu->dcache_busy = FALSE;
+}
+
+/* Collects the integer registers an instruction reads, returns how many */
+static int
+source_registers(const CPU_Stage *stage, int *regs)
+{
+    switch (stage->opcode)
+    {
+        case OPCODE_MOVC:
+        case OPCODE_NOP:
+        case OPCODE_HALT:
+        case OPCODE_DMAWAIT:
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+        case OPCODE_VRED:
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            return 0;
+        }
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        case OPCODE_CML:
+        case OPCODE_BEQL:
+        case OPCODE_BNEL:
+        case OPCODE_BLTL:
+        case OPCODE_BGEL:
+        case OPCODE_PREFETCH:
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+        case OPCODE_LOOP:
+        case OPCODE_VLOAD:
+        {
+            regs[0] = stage->rs1;
+            return 1;
+        }
+
+        case OPCODE_VSTORE:
+        {
+            regs[0] = stage->rs2;
+            return 1;
+        }
+
+        case OPCODE_CMOVZ:
+        case OPCODE_CMOVNZ:
+        case OPCODE_CMOVP:
+        case OPCODE_CMOVN:
+        {
+            regs[0] = stage->rs1;
+            regs[1] = stage->rd;
+            return 2;
+        }
+
+        case OPCODE_MAC:
+        {
+            regs[0] = stage->rs1;
+            regs[1] = stage->rs2;
+            regs[2] = stage->rd;
+            return 3;
+        }
+    }
+
+    regs[0] = stage->rs1;
+    regs[1] = stage->rs2;
+    return 2;
+}
+
+/* Returns TRUE for instructions that set the flags in Execute */
+static int
+sets_flags(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_MAC:
+        case OPCODE_SHADD:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_CMP:
+        case OPCODE_CML:
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/*
+ * Puts a thread whose Decode is blocked by load misses into runahead, once
+ * everything older has left the pipeline. The registers the misses owe are
+ * marked invalid and freed, so the blocked instruction and the ones after
+ * it can go ahead. The thread comes back when the last of the misses the
+ * blocked instruction waits on is filled.
+ */
+static void
+runahead_enter(APEX_CPU *cpu, int t)
+{
+    APEX_Thread *thread = &cpu->threads[t];
+    Runahead *ra = &thread->runahead;
+    const MSHR *mshr;
+    int regs[4], n, i, j, k, exit_cycle = -1;
+
+    if ((cpu->execute.has_insn && cpu->execute.thread == t)
+        || (cpu->memory.has_insn && cpu->memory.thread == t)
+        || (cpu->writeback.has_insn && cpu->writeback.thread == t))
+    {
+        return;
+    }
+
+    n = source_registers(&thread->decode, regs);
+    if (writes_rd(thread->decode.opcode))
+    {
+        regs[n++] = thread->decode.rd;
+    }
+
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        mshr = &cpu->mshr[i];
+        for (j = 0; mshr->valid && j < mshr->num_targets; ++j)
+        {
+            for (k = 0; k < n; ++k)
+            {
+                if (mshr->targets[j].thread == t
+                    && mshr->targets[j].rd == regs[k]
+                    && mshr->ready_cycle > exit_cycle)
+                {
+                    exit_cycle = mshr->ready_cycle;
+                }
+            }
+        }
+    }
+
+    /* Not blocked by a miss, or too close to the fill to pay off */
+    if (exit_cycle - cpu->clock < RUNAHEAD_MIN_CYCLES)
+    {
+        return;
+    }
+
+    ra->active = TRUE;
+    ra->pc = thread->decode.pc;
+    ra->loop_update = thread->decode.loop_update;
+    ra->entry_cycle = cpu->clock;
+    ra->exit_cycle = exit_cycle;
+    memcpy(ra->regs, thread->regs, sizeof(ra->regs));
+    memcpy(ra->status, thread->status, sizeof(ra->status));
+    ra->zero_flag = thread->zero_flag;
+    ra->positive_flag = thread->positive_flag;
+    ra->negative_flag = thread->negative_flag;
+    memcpy(ra->loop_stack, thread->loop_stack, sizeof(ra->loop_stack));
+    ra->loop_depth = thread->loop_depth;
+    ra->flags_inv = FALSE;
+
+    /* With the pipeline drained only load misses still own registers */
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        ra->inv[i] = thread->status[i] == BUSY;
+        thread->status[i] = FREE;
+    }
+
+    cpu->runahead_periods++;
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        printf("%-15s: T%d pc(%d) until cycle %d\n", "Runahead Enter", t,
+               ra->pc, exit_cycle);
+    }
+}
+
+/*
+ * Ends runahead once the miss that started it is filled. Whatever the
+ * thread ran ahead with is squashed, the checkpoint is restored, and Fetch
+ * starts again from the blocked instruction.
+ */
+static void
+runahead_exit(APEX_CPU *cpu, int t)
+{
+    APEX_Thread *thread = &cpu->threads[t];
+    Runahead *ra = &thread->runahead;
+    CPU_Stage *stages[4];
+    int i;
+
+    stages[0] = &thread->decode;
+    stages[1] = &cpu->execute;
+    stages[2] = &cpu->memory;
+    stages[3] = &cpu->writeback;
+    for (i = 0; i < 4; ++i)
+    {
+        if (stages[i]->has_insn && stages[i]->thread == t)
+        {
+            stages[i]->has_insn = FALSE;
+        }
+    }
+
+    memcpy(thread->regs, ra->regs, sizeof(ra->regs));
+    memcpy(thread->status, ra->status, sizeof(ra->status));
+    thread->zero_flag = ra->zero_flag;
+    thread->positive_flag = ra->positive_flag;
+    thread->negative_flag = ra->negative_flag;
+    memcpy(thread->loop_stack, ra->loop_stack, sizeof(ra->loop_stack));
+    thread->loop_depth = ra->loop_depth;
+
+    /* Fetching the blocked instruction again redoes its loop progress,
+     * which was counted before the thread ran ahead */
+    ra->active = FALSE;
+    thread->pc = ra->pc;
+    hw_loop_redirect(cpu, thread, ra->loop_update);
+    thread->fetching = TRUE;
+    thread->fetch_from_next_cycle = FALSE;
+
+    cpu->runahead_cycles += cpu->clock - ra->entry_cycle;
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        printf("%-15s: T%d pc(%d)\n", "Runahead Exit", t, ra->pc);
+    }
+}
+
+/*
+ * Marks an instruction leaving Decode in runahead, and whether it reads a
+ * register or flags without a real value. Instructions with effects beyond
+ * the checkpoint become NOPs, and so do branches whose outcome is unknown,
+ * which then fall through. Left alone until its registers are ready, since
+ * their validity is only known once they are written.
+ */
+static void
+runahead_decode(APEX_Thread *thread, CPU_Stage *stage)
+{
+    Runahead *ra = &thread->runahead;
+    int regs[3], n, i;
+
+    n = source_registers(stage, regs);
+    for (i = 0; i < n; ++i)
+    {
+        if (thread->status[regs[i]] == BUSY)
+        {
+            return;
+        }
+    }
+
+    stage->runahead = TRUE;
+    stage->invalid = FALSE;
+    for (i = 0; i < n; ++i)
+    {
+        stage->invalid |= ra->inv[regs[i]];
+    }
+
+    switch (stage->opcode)
+    {
+        case OPCODE_CMOVZ:
+        case OPCODE_CMOVNZ:
+        case OPCODE_CMOVP:
+        case OPCODE_CMOVN:
+        {
+            stage->invalid |= ra->flags_inv;
+            break;
+        }
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            if (ra->flags_inv)
+            {
+                stage->opcode = OPCODE_NOP;
+            }
+            break;
+        }
+
+        case OPCODE_BEQ:
+        case OPCODE_BNE:
+        case OPCODE_BLT:
+        case OPCODE_BGE:
+        case OPCODE_BEQL:
+        case OPCODE_BNEL:
+        case OPCODE_BLTL:
+        case OPCODE_BGEL:
+        case OPCODE_JUMP:
+        case OPCODE_LOOP:
+        {
+            if (stage->invalid)
+            {
+                stage->opcode = OPCODE_NOP;
+            }
+            break;
+        }
+
+        case OPCODE_JALR:
+        {
+            if (stage->invalid)
+            {
+                ra->inv[stage->rd] = TRUE;
+                stage->opcode = OPCODE_NOP;
+            }
+            break;
+        }
+
+        case OPCODE_VRED:
+        {
+            ra->inv[stage->rd] = TRUE;
+            stage->opcode = OPCODE_NOP;
+            break;
+        }
+
+        /* The vector registers are not checkpointed, and memory, the DMA
+         * engine and HALT must not see runahead */
+        case OPCODE_HALT:
+        case OPCODE_COPY:
+        case OPCODE_DMAWAIT:
+        case OPCODE_VLOAD:
+        case OPCODE_VSTORE:
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+        {
+            stage->opcode = OPCODE_NOP;
+            break;
+        }
+    }
+}
+
+/* Tracks flag validity in issue order, and keeps a compare whose flags are
+ * invalid from taking the branch fused into it */
+static void
+runahead_issue(APEX_Thread *thread, CPU_Stage *stage)
+{
+    if (sets_flags(stage->opcode))
+    {
+        thread->runahead.flags_inv = stage->invalid;
+    }
+
+    if (stage->fused && stage->invalid)
+    {
+        stage->fused = FALSE;
+    }
+}
+
+/*
+ * Memory stage work of a runahead instruction. Nothing is written. A load
+ * whose line is present reads its value, otherwise its result is invalid
+ * and the line is fetched like a prefetch. Stores and PREFETCH fetch their
+ * line the same way.
+ */
+static void
+runahead_access(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    int address = stage->memory_address;
+    int line = dcache_line(address);
+    int is_load = stage->opcode == OPCODE_LOAD || stage->opcode == OPCODE_LOADP;
+    MSHR *mshr;
+
+    if (stage->invalid
+        || (!is_load && stage->opcode != OPCODE_STORE
+            && stage->opcode != OPCODE_STOREP
+            && stage->opcode != OPCODE_PREFETCH))
+    {
+        return;
+    }
+
+    if (is_load && ENABLE_STORE_BUFFER
+        && store_buffer_search(&cpu->store_buffer, address,
+                               &stage->result_buffer))
+    {
+        return;
+    }
+
+    if ((ENABLE_SCRATCHPAD && in_scratchpad(address))
+        || dcache_probe(&cpu->dcache, line))
+    {
+        if (is_load)
+        {
+            stage->result_buffer = read_data(cpu, address);
+        }
+        return;
+    }
+
+    stage->invalid = is_load;
+    if (mshr_find(cpu->mshr, line) || mshr_outstanding(cpu->mshr) == NUM_MSHRS)
+    {
+        return;
+    }
+
+    mshr = allocate_miss(cpu, line, cpu->clock + DCACHE_MISS_LATENCY,
+                         BUS_READ);
+    mshr->prefetch = FILL_RUNAHEAD;
+    cpu->runahead_prefetches++;
+}
+
+/*
+ * Sends the instruction in Execute back to Decode, it read a load value
+ * that was predicted wrong or would be overwritten by the load. Its
+ * scoreboard marks are released, and the instruction fetched after it is
+ * dropped and fetched again.
+ */
+static void
+lvp_replay(APEX_CPU *cpu, APEX_Thread *thread)
+{
+    CPU_Stage *stage = &cpu->execute;
+
+    if (writes_rd(stage->opcode))
+    {
+        thread->status[stage->rd] = FREE;
+    }
+    if (stage->opcode == OPCODE_LOADP)
+    {
+        thread->status[stage->rs1] = FREE;
+    }
+    if (stage->opcode == OPCODE_STOREP)
+    {
+        thread->status[stage->rs2] = FREE;
+    }
+    if (stage->opcode == OPCODE_VLOAD || stage->opcode == OPCODE_VADD
+        || stage->opcode == OPCODE_VMUL)
+    {
+        thread->vstatus[stage->rd] = FREE;
+    }
+
+    /* The fused branch is read again, Decode fuses the pair once more */
+    if (stage->fused)
+    {
+        thread->pc = stage->pc + stage->size;
+        stage->fused = FALSE;
+        cpu->fused_pairs--;
+    }
+    else if (thread->decode.has_insn)
+    {
+        thread->pc = thread->decode.pc;
+    }
+    if (thread->decode.has_insn)
+    {
+        hw_loop_redirect(cpu, thread, thread->decode.loop_update);
+    }
+
+    thread->decode = *stage;
+    stage->has_insn = FALSE;
+    thread->fetching = TRUE;
+    cpu->lvp.replays++;
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        printf("%-15s: T%d pc(%d)\n", "LVP Replay", stage->thread, stage->pc);
+    }
+}
+
+/*
+ * Trains the value predictor with a load leaving Memory, and checks the
+ * value Decode predicted for it. Only the instruction in Execute can have
+ * read that value yet, or written rd over it. It is replayed when the value
+ * was wrong. A correct value is already in rd, so the load leaves rd to a
+ * younger writer, and one read ahead of a miss keeps the load in Writeback
+ * until the line arrives, while one nobody read falls back to waiting on
+ * the MSHR.
+ */
+static void
+lvp_verify(APEX_CPU *cpu, CPU_Stage *stage)
+{
+    APEX_Thread *thread = &cpu->threads[stage->thread];
+    CPU_Stage *next = &cpu->execute;
+    int regs[3], n, i, reads = FALSE, writes = FALSE;
+    int correct = stage->result_buffer == stage->predicted_value;
+    MSHR *mshr = NULL;
+
+    cpu->lvp.loads++;
+    lvp_update(&cpu->lvp, stage->pc, stage->result_buffer);
+    if (!stage->value_predicted)
+    {
+        return;
+    }
+
+    thread->predicted[stage->rd] = FALSE;
+    if (next->has_insn && next->thread == stage->thread)
+    {
+        n = source_registers(next, regs);
+        for (i = 0; i < n; ++i)
+        {
+            reads |= regs[i] == stage->rd;
+        }
+        writes = writes_rd(next->opcode) && next->rd == stage->rd;
+
+        if (!correct && (reads || writes))
+        {
+            lvp_replay(cpu, thread);
+            reads = FALSE;
+            writes = FALSE;
+        }
+    }
+
+    /* Marks of the load itself that the replay released */
+    if (stage->opcode == OPCODE_LOADP)
+    {
+        thread->status[stage->rs1] = BUSY;
+    }
+
+    /* A replayed instruction waits for the load, Decode would otherwise
+     * issue it again before the load's writeback frees rd under it */
+    if (!correct)
+    {
+        thread->status[stage->rd] = BUSY;
+        return;
+    }
+
+    cpu->lvp.correct++;
+    stage->value_verified = TRUE;
+    if (stage->mshr_pending)
+    {
+        mshr = mshr_find(cpu->mshr, dcache_line(stage->memory_address));
+        if (writes)
+        {
+            mshr_drop_target(mshr, stage->thread, stage->rd);
+        }
+        else if (!reads)
+        {
+            thread->status[stage->rd] = BUSY;
+            return;
+        }
+    }
+    if (!reads)
+    {
+        return;
+    }
+
+    if (mshr)
+    {
+        stage->verify_cycle = mshr->ready_cycle;
+        cpu->lvp.cycles_gained += mshr->ready_cycle - thread->first_use[stage->rd];
+    }
+    else
+    {
+        cpu->lvp.cycles_gained += cpu->clock + 1 - thread->first_use[stage->rd];
+    }
+}
+
+/*
+ * Notes the first cycle an issuing instruction reads each unchecked load
+ * value, and hands a predicted load's value to its dependents.
+ */
+static void
+lvp_issue(APEX_CPU *cpu, APEX_Thread *thread, CPU_Stage *stage)
+{
+    int regs[3], n, i;
+
+    n = source_registers(stage, regs);
+    for (i = 0; i < n; ++i)
+    {
+        if (thread->predicted[regs[i]] && !thread->first_use[regs[i]])
+        {
+            thread->first_use[regs[i]] = cpu->clock;
+        }
+    }
+
+    stage->verify_cycle = 0;
+    stage->value_verified = FALSE;
+    if (!stage->value_predicted)
+    {
+        return;
+    }
+
+    thread->regs[stage->rd] = stage->predicted_value;
+    thread->status[stage->rd] = FREE;
+    thread->predicted[stage->rd] = TRUE;
+    thread->first_use[stage->rd] = 0;
+    cpu->lvp.predictions++;
+}
+
+/*
+ * Completes data cache misses whose line has arrived this cycle. Loads held
+ * by the MSHR write their destination and release it in the scoreboard.
+ * Requests other cores made for the line meanwhile are kept for later.
+ */
+static void
+service_mshrs(APEX_CPU *cpu)
+{
+    int i, j;
+    MSHR *mshr;
+    APEX_Thread *thread;
+
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        mshr = &cpu->mshr[i];
+        if (!mshr->valid || mshr->bus_wait || mshr->ready_cycle > cpu->clock)
+        {
+            continue;
+        }
+
+        dcache_fill(&cpu->dcache, mshr->line, mshr->prefetch,
+                    mshr->fill_state);
+        if (mshr->snooped >= 0)
+        {
+            cpu->snoop_lines[cpu->num_snoops] = mshr->line;
+            cpu->snoop_requests[cpu->num_snoops] = mshr->snooped;
+            cpu->num_snoops++;
+        }
+        for (j = 0; j < mshr->num_targets; ++j)
+        {
+            thread = &cpu->threads[mshr->targets[j].thread];
+
+            /* A thread running ahead gets the value in its checkpoint */
+            if (thread->runahead.active)
+            {
+                thread->runahead.regs[mshr->targets[j].rd] = mshr->targets[j].value;
+                thread->runahead.status[mshr->targets[j].rd] = FREE;
+                continue;
+            }
+            thread->regs[mshr->targets[j].rd] = mshr->targets[j].value;
+            thread->status[mshr->targets[j].rd] = FREE;
+        }
+        mshr->valid = FALSE;
+
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            printf("%-15s: line(%d) loads(%d)\n", "MSHR Fill", mshr->line,
+                   mshr->num_targets);
+        }
+    }
+
+    for (i = 0; ENABLE_RUNAHEAD && i < cpu->num_threads; ++i)
+    {
+        if (cpu->threads[i].runahead.active
+            && cpu->threads[i].runahead.exit_cycle <= cpu->clock)
+        {
+            runahead_exit(cpu, i);
+        }
+    }
+}
+
+/*
+ * Applies the requests other cores made for lines that were still in flight
+ * here. This waits until Memory and the store buffer had a cycle to use the
+ * arrived line, so the core that asked first makes progress.
+ */
+static void
+apply_snoops(APEX_CPU *cpu)
+{
+    int i;
+
+    for (i = 0; i < cpu->num_snoops; ++i)
+    {
+        dcache_snoop(&cpu->dcache, cpu->snoop_lines[i],
+                     cpu->snoop_requests[i]);
+    }
+    cpu->num_snoops = 0;
+}
+
+/* Returns part as a percentage of whole, 0 when there is nothing to count */
+static double
+percent(int part, int whole)
+{
+    return whole ? (100.0 * part) / whole : 0.0;
+}
+
+/* Prints a TLB's miss rate and the cycles its walks took */
+static void
+print_tlb_stats(const char *name, const TLB *tlb)
+{
+    printf("APEX_CPU: %s accesses = %d misses = %d miss rate = %.2f%% walk cycles = %d\n",
+           name, tlb->hits + tlb->misses, tlb->misses,
+           percent(tlb->misses, tlb->hits + tlb->misses), tlb->walk_cycles);
+}
+
+/* Prints memory system statistics at the end of simulation */
+static void
+print_stats(const APEX_CPU *cpu)
+{
+    int timely = cpu->dcache.prefetch_hits[FILL_HW_PREFETCH];
+    int late = cpu->prefetcher.late;
+    int t, offset, size, insns = 0, compressed = 0, code_size = 0;
+    int cycles, captures = 0, lb_hits = 0, hidden;
+    const APEX_Thread *thread;
+
+    printf("APEX_CPU: CPI = %.3f\n",
+           cpu->insn_completed ? (double)cpu->clock / cpu->insn_completed : 0.0);
+
+    /* With several threads IPC is also given per thread, each over the
+     * cycles up to its HALT, the aggregate is over the whole run */
+    for (t = 0; cpu->num_threads > 1 && t < cpu->num_threads; ++t)
+    {
+        thread = &cpu->threads[t];
+        cycles = thread->halted ? thread->halt_cycle : cpu->clock;
+        printf("APEX_CPU: Thread %d instructions = %d cycles = %d IPC = %.3f\n",
+               t, thread->insn_completed, cycles,
+               cycles ? (double)thread->insn_completed / cycles : 0.0);
+    }
+    if (cpu->num_threads > 1)
+    {
+        printf("APEX_CPU: Aggregate IPC = %.3f over %d threads (%s fetch)\n",
+               cpu->clock ? (double)cpu->insn_completed / cpu->clock : 0.0,
+               cpu->num_threads,
+               SMT_FETCH_POLICY == FETCH_ICOUNT ? "ICOUNT" : "round-robin");
+    }
+
+    for (t = 0; t < cpu->num_threads; ++t)
+    {
+        thread = &cpu->threads[t];
+        for (offset = 0; offset < thread->code_memory_size; offset += size)
+        {
+            isa_fetch(thread->code_memory, thread->code_memory_size, offset,
+                      &size);
+            insns++;
+            compressed += size == 2;
+        }
+        code_size += thread->code_memory_size;
+        captures += thread->loop_buffer.captures;
+        lb_hits += thread->loop_buffer.hits;
+    }
+    printf("APEX_CPU: Code size = %d bytes, %d of %d instructions compressed\n",
+           code_size, compressed, insns);
+    printf("APEX_CPU: Fetched bytes = %d (%.2f per instruction)\n",
+           cpu->fetch_bytes,
+           cpu->fetches ? (double)cpu->fetch_bytes / cpu->fetches : 0.0);
+    if (ENABLE_MACRO_FUSION)
+    {
+        printf("APEX_CPU: Fused compare and branch pairs = %d\n", cpu->fused_pairs);
+    }
+
+    if (ENABLE_LOOP_BUFFER)
+    {
+        /* Each hit is a code memory read, and I-TLB lookup, avoided */
+        printf("APEX_CPU: Loop buffer loops captured = %d hits = %d coverage = %.1f%% code memory reads = %d\n",
+               captures, lb_hits, percent(lb_hits, cpu->fetches),
+               cpu->fetches - lb_hits);
+    }
+    if (cpu->loop_backs || cpu->loop_branch_exits)
+    {
+        printf("APEX_CPU: Hardware loop back edges = %d branch exits = %d\n",
+               cpu->loop_backs, cpu->loop_branch_exits);
+    }
+
+    /* Each redirect squashes Decode and leaves Fetch idle for a cycle */
+    printf("APEX_CPU: Taken branches = %d flush cycles = %d conditional moves = %d\n",
+           cpu->branch_flushes, cpu->branch_flushes * 2,
+           cpu->cmov_insns);
+    printf("APEX_CPU: D-cache hits = %d misses = %d writebacks = %d\n",
+           cpu->dcache.hits, cpu->dcache.misses, cpu->dcache.writebacks);
+    if (cpu->bus)
+    {
+        printf("APEX_CPU: Coherence misses = %d invalidations = %d snooped flushes = %d\n",
+               cpu->dcache.coherence_misses, cpu->dcache.invalidations,
+               cpu->dcache.flushes);
+    }
+    printf("APEX_CPU: MSHR merges = %d hits under miss = %d full stalls = %d\n",
+           cpu->mshr_merges, cpu->hits_under_miss, cpu->mshr_full_stalls);
+    printf("APEX_CPU: Memory stage stall cycles = %d\n", cpu->mem_stall_cycles);
+    printf("APEX_CPU: Data memory pages allocated = %d (%d KB)\n",
+           cpu->data_memory->pages_allocated,
+           cpu->data_memory->pages_allocated * MEM_PAGE_SIZE * (int)sizeof(int) / 1024);
+    if (ENABLE_STORE_BUFFER)
+    {
+        printf("APEX_CPU: Store buffer forwards = %d full stalls = %d drain cycles = %d\n",
+               cpu->store_buffer.forwards, cpu->store_buffer.full_stalls,
+               cpu->store_buffer.drain_cycles);
+    }
+    if (ENABLE_STRIDE_PREFETCHER)
+    {
+        printf("APEX_CPU: Prefetches issued = %d dropped = %d timely = %d late = %d unused = %d\n",
+               cpu->prefetcher.issued, cpu->prefetcher.dropped, timely, late,
+               cpu->dcache.unused_prefetches[FILL_HW_PREFETCH]);
+
+        /* Coverage counts misses removed or shortened out of all misses the
+         * demand stream would have taken without prefetching */
+        printf("APEX_CPU: Prefetch coverage = %.1f%% accuracy = %.1f%% timeliness = %.1f%%\n",
+               percent(timely + late, timely + cpu->dcache.misses),
+               percent(timely + late, cpu->prefetcher.issued),
+               percent(timely, timely + late));
+    }
+    if (ENABLE_STREAM_BUFFER)
+    {
+        printf("APEX_CPU: Stream buffer hits = %d late = %d\n",
+               cpu->prefetcher.stream_hits, cpu->prefetcher.stream_late);
+    }
+    if (ENABLE_VIRTUAL_MEMORY)
+    {
+        print_tlb_stats("I-TLB", &cpu->itlb);
+        print_tlb_stats("D-TLB", &cpu->dtlb);
+        printf("APEX_CPU: Page walk accesses = %d data cache misses = %d\n",
+               cpu->walk_accesses, cpu->walk_cache_misses);
+    }
+    if (cpu->fu_stall_cycles || cpu->mac_shadd_insns)
+    {
+        printf("APEX_CPU: Multiplier stall cycles = %d MAC/SHADD retired = %d\n",
+               cpu->fu_stall_cycles, cpu->mac_shadd_insns);
+    }
+    if (cpu->vector_insns)
+    {
+        printf("APEX_CPU: Vector instructions = %d (%d elements each, host %s)\n",
+               cpu->vector_insns, VECTOR_LENGTH, vector_isa());
+    }
+    if (ENABLE_SCRATCHPAD)
+    {
+        printf("APEX_CPU: Scratchpad accesses = %d\n", cpu->spm_accesses);
+    }
+    if (cpu->dma.transfers)
+    {
+        /* Overlap counts the cycles the engine was busy while the pipeline
+         * kept going instead of waiting for it */
+        printf("APEX_CPU: DMA transfers = %d bytes moved = %d busy cycles = %d wait cycles = %d full stalls = %d\n",
+               cpu->dma.transfers, cpu->dma.words_moved * (int)sizeof(int),
+               cpu->dma.busy_cycles, cpu->dma.wait_cycles,
+               cpu->dma.full_stalls);
+        printf("APEX_CPU: DMA overlap = %d cycles (%.1f%%)\n",
+               cpu->dma.busy_cycles - cpu->dma.wait_cycles,
+               percent(cpu->dma.busy_cycles - cpu->dma.wait_cycles,
+                       cpu->dma.busy_cycles));
+    }
+    if (cpu->runahead_periods)
+    {
+        /* A demand hit on a runahead line saves a whole miss, a late one
+         * what had elapsed. This is an upper bound, since misses runahead
+         * moved earlier could have overlapped with others anyway */
+        hidden = cpu->dcache.prefetch_hits[FILL_RUNAHEAD] * DCACHE_MISS_LATENCY
+                 + cpu->runahead_hidden;
+        printf("APEX_CPU: Runahead periods = %d cycles = %d instructions = %d\n",
+               cpu->runahead_periods, cpu->runahead_cycles,
+               cpu->runahead_insns);
+        printf("APEX_CPU: Runahead prefetches = %d useful = %d late = %d unused = %d\n",
+               cpu->runahead_prefetches, cpu->dcache.prefetch_hits[FILL_RUNAHEAD],
+               cpu->runahead_late, cpu->dcache.unused_prefetches[FILL_RUNAHEAD]);
+        printf("APEX_CPU: Runahead net gain <= %d cycles (%d miss cycles hidden, %d restart cycles)\n",
+               hidden - cpu->runahead_periods, hidden, cpu->runahead_periods);
+    }
+    if (cpu->lvp.predictions)
+    {
+        /* Coverage is out of all loads, accuracy out of those predicted */
+        printf("APEX_CPU: Value predictions = %d coverage = %.1f%% accuracy = %.1f%% replays = %d\n",
+               cpu->lvp.predictions,
+               percent(cpu->lvp.predictions, cpu->lvp.loads),
+               percent(cpu->lvp.correct, cpu->lvp.predictions),
+               cpu->lvp.replays);
+        printf("APEX_CPU: Value prediction dependent issue cycles gained = %d\n",
+               cpu->lvp.cycles_gained);
+    }
+    if (cpu->sw_prefetches || cpu->sw_prefetch_redundant || cpu->sw_prefetch_dropped)
+    {
+        printf("APEX_CPU: PREFETCH issued = %d useful = %d late = %d unused = %d redundant = %d dropped = %d\n",
+               cpu->sw_prefetches, cpu->dcache.prefetch_hits[FILL_SW_PREFETCH],
+               cpu->sw_prefetch_late,
+               cpu->dcache.unused_prefetches[FILL_SW_PREFETCH],
+               cpu->sw_prefetch_redundant, cpu->sw_prefetch_dropped);
+    }
+}
+
+/* Instructions a thread has between Decode and Writeback */
+static int
+thread_icount(const APEX_CPU *cpu, int t)
+{
+    return cpu->threads[t].decode.has_insn
+           + (cpu->execute.has_insn && cpu->execute.thread == t)
+           + (cpu->memory.has_insn && cpu->memory.thread == t)
+           + (cpu->writeback.has_insn && cpu->writeback.thread == t);
+}
+
+/*
+ * Picks the thread that fetches this cycle, or -1 if none can. A thread
+ * qualifies while its decode latch is free and it is not waiting out a
+ * redirect. Round-robin starts after the last thread that fetched, ICOUNT
+ * prefers the thread with the fewest instructions in the pipeline, which
+ * keeps a thread stalled on memory from clogging it.
+ */
+static int
+select_fetch_thread(const APEX_CPU *cpu, int waiting)
+{
+    int i, t, best = -1;
+
+    for (i = 1; i <= cpu->num_threads; ++i)
+    {
+        t = (cpu->fetch_thread + i) % cpu->num_threads;
+        if (!cpu->threads[t].fetching || cpu->threads[t].decode.has_insn
+            || (waiting & (1 << t)))
+        {
+            continue;
+        }
+
+        if (SMT_FETCH_POLICY == FETCH_ROUND_ROBIN)
+        {
+            return t;
+        }
+
+        if (best < 0 || thread_icount(cpu, t) < thread_icount(cpu, best))
+        {
+            best = t;
+        }
+    }
+
+    return best;
+}
+
+/* Maps the PC Fetch is about to read through the instruction TLB, once
+ * however many cycles Fetch waits on it. The front end is gated while the
+ * loop buffer replays, so it needs no translation */
+static int
+fetch_translate(APEX_CPU *cpu, APEX_Thread *thread)
+{
+    if (!ENABLE_VIRTUAL_MEMORY || thread->itlb_pc == thread->pc
+        || loop_buffer_holds(thread, thread->pc))
+    {
+        return TRUE;
+    }
+
+    if (!translate(cpu, &cpu->itlb, thread->pc))
+    {
+        return FALSE;
+    }
+    thread->itlb_pc = thread->pc;
+    return TRUE;
+}
+
+/*
+ * Fetch Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_fetch(APEX_CPU *cpu)
+{
+    APEX_Thread *thread;
+    int i, t, waiting = 0;
+
+    /* This fetches new branch target instruction from next cycle */
+    for (i = 0; i < cpu->num_threads; ++i)
+    {
+        if (cpu->threads[i].fetch_from_next_cycle == TRUE)
+        {
+            cpu->threads[i].fetch_from_next_cycle = FALSE;
+            waiting |= 1 << i;
+        }
+    }
+
+    t = select_fetch_thread(cpu, waiting);
+    if (t < 0)
+    {
+        /* Every thread is stalled in Decode, waiting or done. Show what the
+         * first stalled one would fetch next */
+        for (i = 0; i < cpu->num_threads; ++i)
+        {
+            if (cpu->threads[i].fetching && cpu->threads[i].decode.has_insn
+                && !(waiting & (1 << i)))
+            {
+                break;
+            }
+        }
+        if (i == cpu->num_threads)
+        {
+            return;
+        }
+
+        thread = &cpu->threads[i];
+        if (!fetch_translate(cpu, thread))
+        {
+            return;
+        }
+
+        cpu->fetch.thread = i;
+        cpu->fetch.pc = thread->pc;
+        cpu->fetch.insn = isa_fetch(thread->code_memory,
+                                    thread->code_memory_size,
+                                    get_code_memory_index_from_pc(thread->pc),
+                                    &cpu->fetch.size);
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_fetch_content(&cpu->fetch);
+        }
+        return;
+    }
+
+    thread = &cpu->threads[t];
+
+    /* Wait for the instruction TLB to map the PC */
+    if (!fetch_translate(cpu, thread))
+    {
+        return;
+    }
+
+    /* Store current PC in fetch latch */
+    cpu->fetch_thread = t;
+    cpu->fetch.thread = t;
+    cpu->fetch.pc = thread->pc;
+
+    /* Read the encoding at this pc into the fetch latch, Decode takes
+     * it apart */
+    cpu->fetch.insn = fetch_instruction(cpu, thread, thread->pc,
+                                        &cpu->fetch.size);
+
+    /* Update PC for next instruction */
+    thread->pc += cpu->fetch.size;
+    thread->itlb_pc = 0;
+    cpu->fetch.loop_update = hw_loop_fetch(cpu, thread, thread->pc);
+
+    /* Copy data from fetch latch to the thread's decode latch */
+    thread->decode = cpu->fetch;
+
+    if (ENABLE_DEBUG_MESSAGES)
+    {
+        print_fetch_content(&cpu->fetch);
+    }
+
+    /* Stop fetching new instructions if HALT is fetched */
+    if (isa_opcode(cpu->fetch.insn) == OPCODE_HALT)
+    {
+        thread->fetching = FALSE;
+    }
+}
+
+/* Reads the operands of the instruction in a thread's decode latch and
+ * sends it to Execute once they are available */
+static void
+decode_thread(APEX_CPU *cpu, APEX_Thread *thread)
+{
+    if (thread->decode.has_insn)
+    {
+            decode_instruction(&thread->decode);
+
+            /* Hold the instruction while Execute is blocked behind Memory, or
+             * while a load miss still owes its destination register. Those
+             * fills go to the checkpoint during runahead */
+            if (cpu->execute.has_insn
+                || (!thread->runahead.active
+                    && rd_pending_fill(cpu, &thread->decode)))
+            {
+                cpu->stall = 1;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    print_stage_content("Decode/RF", &thread->decode);
+                }
+                return;
+            }
+            cpu->stall = 0;
+
+            if (thread->runahead.active)
+            {
+                runahead_decode(thread, &thread->decode);
+            }
+
+            /* Predict the value of a load whose rd no older instruction
+             * still owes, unless LOADP also increments rd */
+            thread->decode.value_predicted
+                = ENABLE_VALUE_PREDICTION && !thread->runahead.active
+                  && (thread->decode.opcode == OPCODE_LOAD
+                      || (thread->decode.opcode == OPCODE_LOADP
+                          && thread->decode.rd != thread->decode.rs1))
+                  && thread->status[thread->decode.rd] != BUSY
+                  && !thread->predicted[thread->decode.rd]
+                  && lvp_predict(&cpu->lvp, thread->decode.pc,
+                                 &thread->decode.predicted_value);
+
+            /* Read operands from register file based on the instruction type */
+            switch (thread->decode.opcode)
+            {
+                case OPCODE_ADD:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2] )== BUSY){
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_ADDL:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_SUB:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_SUBL:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_MUL:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_MAC:
+                {
+                    /* rd is a source too, it holds the running sum */
+                    if (thread->status[thread->decode.rs1] == BUSY || thread->status[thread->decode.rs2] == BUSY
+                        || thread->status[thread->decode.rd] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->decode.rd_value = thread->regs[thread->decode.rd];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_CMOVZ:
+                case OPCODE_CMOVNZ:
+                case OPCODE_CMOVP:
+                case OPCODE_CMOVN:
+                {
+                    /* rd keeps its old value when the condition fails, so it
+                     * is read like a source and then marked busy */
+                    if (thread->status[thread->decode.rs1] == BUSY || thread->status[thread->decode.rd] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rd_value = thread->regs[thread->decode.rd];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_SHADD:
+                {
+                    if (thread->status[thread->decode.rs1] == BUSY || thread->status[thread->decode.rs2] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_AND:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_OR:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_XOR:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_LOAD:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY){
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_LOADP:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->status[thread->decode.rs1] = BUSY;
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_STORE:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    break;
+                }
+
+                case OPCODE_STOREP:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    thread->status[thread->decode.rs2] = BUSY;
+                    break;
+                }
+
+                case OPCODE_COPY:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    break;
+                }
+
+                case OPCODE_CMP:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    break;
+                }
+
+                case OPCODE_CML:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    break;
+                }
+
+                case OPCODE_BEQ:
+                case OPCODE_BNE:
+                case OPCODE_BLT:
+                case OPCODE_BGE:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY || (thread->status[thread->decode.rs2]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    break;
+                }
+
+                /* The literal stands in for rs2, Execute treats both alike */
+                case OPCODE_BEQL:
+                case OPCODE_BNEL:
+                case OPCODE_BLTL:
+                case OPCODE_BGEL:
+                {
+                    if ((thread->status[thread->decode.rs1]) == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->decode.rs2_value = thread->decode.literal;
+                    break;
+                }
+
+                case OPCODE_MOVC:
+                {
+                    thread->status[thread->decode.rd] = BUSY;
+                    /* MOVC doesn't have register operands */
+                    break;
+                }
+
+                case OPCODE_VLOAD:
+                {
+                    if (thread->status[thread->decode.rs1] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->vstatus[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_VSTORE:
+                {
+                    if (thread->vstatus[thread->decode.rs1] == BUSY || thread->status[thread->decode.rs2] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    memcpy(thread->decode.vs1_value, thread->vregs[thread->decode.rs1],
+                           sizeof(thread->decode.vs1_value));
+                    thread->decode.rs2_value = thread->regs[thread->decode.rs2];
+                    break;
+                }
+
+                case OPCODE_VADD:
+                case OPCODE_VMUL:
+                {
+                    if (thread->vstatus[thread->decode.rs1] == BUSY || thread->vstatus[thread->decode.rs2] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    memcpy(thread->decode.vs1_value, thread->vregs[thread->decode.rs1],
+                           sizeof(thread->decode.vs1_value));
+                    memcpy(thread->decode.vs2_value, thread->vregs[thread->decode.rs2],
+                           sizeof(thread->decode.vs2_value));
+                    thread->vstatus[thread->decode.rd] = BUSY;
+                    break;
+                }
+
+                case OPCODE_VRED:
+                {
+                    if (thread->vstatus[thread->decode.rs1] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    memcpy(thread->decode.vs1_value, thread->vregs[thread->decode.rs1],
+                           sizeof(thread->decode.vs1_value));
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+                case OPCODE_PREFETCH:
+                {
+                    if (thread->status[thread->decode.rs1] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    break;
+                }
+
+                case OPCODE_JUMP:
+                {
+                    if(thread->status[thread->decode.rs1] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    break;
+                    
+                }
+
+                case OPCODE_JALR:
+                {
+                    if (thread->status[thread->decode.rs1] == BUSY)
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
+                        }
+                        return;
+                    }
+                    else
+                    {
+                        cpu->stall = 0;
+                    }
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    thread->status[thread->decode.rd] = BUSY;
+                    break;
+                }
+                case OPCODE_LOOP:
+                {
+                    /* The trip count cannot be taken back once set */
+                    if (thread->status[thread->decode.rs1] == BUSY
+                        || thread->predicted[thread->decode.rs1])
+                    {
+                        cpu->stall = 1;
+                        if (ENABLE_DEBUG_MESSAGES)
+                        {
+                            print_stage_content("Decode/RF", &thread->decode);
                         }
                         return;
                     }
@@ -383,892 +2881,2470 @@ APEX_decode(APEX_CPU *cpu)
                     {
                         cpu->stall = 0;
                     }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->status[cpu->decode.rd] = BUSY;
+                    thread->decode.rs1_value = thread->regs[thread->decode.rs1];
+                    hw_loop_start(thread, &thread->decode);
+                    break;
+                }
+
+                case OPCODE_NOP:
+                {
                     break;
                 }
+            }
+
+        if (ENABLE_MACRO_FUSION && !cpu->stall)
+        {
+            fuse_compare_branch(cpu, &thread->decode);
+        }
+
+        /* Copy data from decode latch to execute latch*/
+        if(!cpu->stall){
+            if (thread->decode.runahead)
+            {
+                runahead_issue(thread, &thread->decode);
+            }
+            if (ENABLE_VALUE_PREDICTION)
+            {
+                lvp_issue(cpu, thread, &thread->decode);
+            }
+            cpu->execute = thread->decode;
+            thread->decode.has_insn = FALSE;
+        }
+        cpu->stall = 0;
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("Decode/RF", &thread->decode);
+        }
+    }
+}
+
+/*
+ * Decode Stage of APEX Pipeline
+ *
+ * Each thread has its own decode latch, and one of them issues to Execute
+ * per cycle. Threads take turns starting after the one that issued last, so
+ * a thread stalled on its operands lets the others go ahead.
+ */
+static void
+APEX_decode(APEX_CPU *cpu)
+{
+    int i, t;
+
+    for (i = 1; i <= cpu->num_threads; ++i)
+    {
+        t = (cpu->issue_thread + i) % cpu->num_threads;
+        if (!cpu->threads[t].decode.has_insn)
+        {
+            continue;
+        }
+
+        decode_thread(cpu, &cpu->threads[t]);
+        if (!cpu->threads[t].decode.has_insn)
+        {
+            cpu->issue_thread = t;
+        }
+        else if (ENABLE_RUNAHEAD && !cpu->threads[t].runahead.active)
+        {
+            runahead_enter(cpu, t);
+        }
+    }
+}
+
+/*
+ * Execute Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_execute(APEX_CPU *cpu)
+{
+    APEX_Thread *thread = &cpu->threads[cpu->execute.thread];
+
+    /* Loop progress made by fetching the instruction a branch would squash */
+    enum LoopUpdate squashed = thread->decode.has_insn
+                               ? thread->decode.loop_update : LOOP_NONE;
+
+    if (cpu->execute.has_insn)
+    {
+        /* Memory stage is stalled on a miss, hold this instruction */
+        if (cpu->memory.has_insn)
+        {
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Execute", &cpu->execute);
+            }
+            return;
+        }
+
+        /* Multi-cycle operations hold Execute until their unit is done */
+        if (execute_latency(cpu->execute.opcode) > 1)
+        {
+            if (!cpu->execute.fu_ready_cycle)
+            {
+                cpu->execute.fu_ready_cycle
+                    = cpu->clock + execute_latency(cpu->execute.opcode);
+            }
+
+            if (cpu->clock + 1 < cpu->execute.fu_ready_cycle)
+            {
+                cpu->fu_stall_cycles++;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    print_stage_content("Execute", &cpu->execute);
+                }
+                return;
+            }
+        }
+
+        /* Execute logic based on instruction type */
+        switch (cpu->execute.opcode)
+        {
+            case OPCODE_ADD:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_ADDL:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+            case OPCODE_SUB:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_SUBL:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_CMP:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_CML:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_MUL:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value * cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_MAC:
+            {
+                cpu->execute.result_buffer = cpu->execute.rd_value
+                    + cpu->execute.rs1_value * cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            /* Conditional moves read the flags but never set them */
+            case OPCODE_CMOVZ:
+            {
+                cpu->execute.result_buffer = (thread->zero_flag == TRUE)
+                    ? cpu->execute.rs1_value : cpu->execute.rd_value;
+                break;
+            }
+
+            case OPCODE_CMOVNZ:
+            {
+                cpu->execute.result_buffer = (thread->zero_flag == FALSE)
+                    ? cpu->execute.rs1_value : cpu->execute.rd_value;
+                break;
+            }
+
+            case OPCODE_CMOVP:
+            {
+                cpu->execute.result_buffer = (thread->positive_flag == TRUE)
+                    ? cpu->execute.rs1_value : cpu->execute.rd_value;
+                break;
+            }
+
+            case OPCODE_CMOVN:
+            {
+                cpu->execute.result_buffer = (thread->negative_flag == TRUE)
+                    ? cpu->execute.rs1_value : cpu->execute.rd_value;
+                break;
+            }
+
+            case OPCODE_SHADD:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value
+                    + (int)((unsigned int)cpu->execute.rs2_value << (cpu->execute.imm & 31));
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_AND:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value & cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_OR:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value | cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_XOR:
+            {
+                cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
+
+                /* Set the zero flag based on the result buffer */
+                thread->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
+                /* Set the positive flag based on the result buffer */
+                thread->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
+                /* Set the negative flag based on the result buffer */
+                thread->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+
+                break;
+            }
+
+            case OPCODE_LOAD:
+            {
+                cpu->execute.memory_address
+                    = cpu->execute.rs1_value + cpu->execute.imm;
+                break;
+            }
+
+            case OPCODE_LOADP:
+            {
+                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
+                cpu->execute.rs1_value = cpu->execute.rs1_value + 4;
+                break;
+            }
+
+            case OPCODE_STORE:
+            { 
+                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+                break;
+            }
+
+            case OPCODE_PREFETCH:
+            {
+                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
+                break;
+            }
+
+            case OPCODE_STOREP:
+            {
+                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+                cpu->execute.rs2_value = cpu->execute.rs2_value + 4;
+                break;
+            }
+
+            case OPCODE_JUMP:
+            {
+                thread->pc = cpu->execute.rs1_value + cpu->execute.imm;
+                thread->fetch_from_next_cycle = TRUE;
+                thread->fetching = TRUE;
+                thread->decode.has_insn = FALSE;
+                break;
+            }
+
+            case OPCODE_JALR:
+            {
+                thread->pc = cpu->execute.rs1_value + cpu->execute.imm;
+                thread->fetch_from_next_cycle = TRUE;
+                thread->decode.has_insn = FALSE;
+                thread->fetching = TRUE;
+                break;
+            }
+
+            case OPCODE_BZ:
+            {
+                if (thread->zero_flag == TRUE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+                    
+                    /* Since we are using reverse callbacks for pipeline stages, 
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
 
-                case OPCODE_OR:
+            case OPCODE_BNZ:
+            {
+                if (thread->zero_flag == FALSE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+                    
+                    /* Since we are using reverse callbacks for pipeline stages, 
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BP:
+            {
+                if (thread->positive_flag == TRUE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BNP:
+            {
+                if (thread->positive_flag == FALSE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BN:
+            {
+                if (thread->negative_flag == TRUE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BNN:
+            {
+                if (thread->negative_flag == FALSE)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+            case OPCODE_MOVC: 
+            {
+                cpu->execute.result_buffer = cpu->execute.imm;
+                break;
+            }
+
+            /* Compare-and-branch instructions leave the flags alone */
+            case OPCODE_BEQ:
+            case OPCODE_BEQL:
+            {
+                if (cpu->execute.rs1_value == cpu->execute.rs2_value)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BNE:
+            case OPCODE_BNEL:
+            {
+                if (cpu->execute.rs1_value != cpu->execute.rs2_value)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BLT:
+            case OPCODE_BLTL:
+            {
+                if (cpu->execute.rs1_value < cpu->execute.rs2_value)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_BGE:
+            case OPCODE_BGEL:
+            {
+                if (cpu->execute.rs1_value >= cpu->execute.rs2_value)
+                {
+                    /* Calculate new PC, and send it to fetch unit */
+                    thread->pc = cpu->execute.pc + cpu->execute.imm;
+
+                    /* Since we are using reverse callbacks for pipeline stages,
+                     * this will prevent the new instruction from being fetched in the current cycle*/
+                    thread->fetch_from_next_cycle = TRUE;
+
+                    /* Flush previous stages */
+                    thread->decode.has_insn = FALSE;
+
+                    /* Make sure fetch stage is enabled to start fetching from new PC */
+                    thread->fetching = TRUE;
+                }
+                break;
+            }
+
+            case OPCODE_VLOAD:
+            {
+                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
+                break;
+            }
+
+            case OPCODE_VSTORE:
+            {
+                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
+                break;
+            }
+
+            /* Vector operations leave the flags alone */
+            case OPCODE_VADD:
+            {
+                vector_add(cpu->execute.vector_result, cpu->execute.vs1_value,
+                           cpu->execute.vs2_value);
+                break;
+            }
+
+            case OPCODE_VMUL:
+            {
+                vector_mul(cpu->execute.vector_result, cpu->execute.vs1_value,
+                           cpu->execute.vs2_value);
+                break;
+            }
+
+            case OPCODE_VRED:
+            {
+                cpu->execute.result_buffer = vector_reduce(cpu->execute.vs1_value);
+                break;
+            }
+
+            case OPCODE_NOP:
+            {
+                break;
+            }
+        }
+
+        /* A branch fused into a compare tests the flags it just set, its
+         * offset is relative to the branch itself */
+        if (cpu->execute.fused
+            && flag_branch_taken(thread, cpu->execute.fused_opcode))
+        {
+            thread->pc = cpu->execute.pc + cpu->execute.size
+                      + cpu->execute.fused_imm;
+            thread->fetch_from_next_cycle = TRUE;
+            thread->decode.has_insn = FALSE;
+            thread->fetching = TRUE;
+        }
+
+        /* Every redirect above asks Fetch to wait a cycle. A taken branch
+         * closing a body does not end the iteration, so the progress its
+         * own fetch made is undone too, after the younger squashed one */
+        if (thread->fetch_from_next_cycle)
+        {
+            if (!cpu->execute.runahead)
+            {
+                cpu->branch_flushes++;
+            }
+            hw_loop_undo(cpu, thread, squashed);
+            hw_loop_redirect(cpu, thread, cpu->execute.loop_update);
+        }
+
+        if (ENABLE_LOOP_BUFFER)
+        {
+            loop_buffer_update(cpu, &cpu->execute);
+        }
+
+        /* Copy data from execute latch to memory latch*/
+        cpu->memory = cpu->execute;
+        cpu->execute.has_insn = FALSE;
+
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("Execute", &cpu->execute);
+        }
+    }
+}
+
+/*
+ * Memory Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static void
+APEX_memory(APEX_CPU *cpu)
+{
+    int i, address;
+
+    if (cpu->memory.has_insn)
+    {
+        /* Writeback still holds a load waiting for its value to be checked */
+        if (cpu->writeback.has_insn)
+        {
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Memory", &cpu->memory);
+            }
+            return;
+        }
+
+        /* Data accesses wait for the D-TLB to map their address */
+        if (ENABLE_VIRTUAL_MEMORY && !cpu->memory.translated
+            && !cpu->memory.invalid
+            && (cpu->memory.opcode == OPCODE_LOAD
+                || cpu->memory.opcode == OPCODE_LOADP
+                || cpu->memory.opcode == OPCODE_STORE
+                || cpu->memory.opcode == OPCODE_STOREP
+                || cpu->memory.opcode == OPCODE_VLOAD
+                || cpu->memory.opcode == OPCODE_VSTORE))
+        {
+            if (!translate(cpu, &cpu->dtlb, cpu->memory.memory_address))
+            {
+                cpu->mem_stall_cycles++;
+                if (ENABLE_DEBUG_MESSAGES)
+                {
+                    print_stage_content("Memory", &cpu->memory);
+                }
+                return;
+            }
+            cpu->memory.translated = TRUE;
+        }
+
+        /* Runahead instructions only look for misses to start */
+        if (cpu->memory.runahead)
+        {
+            runahead_access(cpu, &cpu->memory);
+        }
+
+        switch (cpu->memory.runahead ? OPCODE_NOP : cpu->memory.opcode)
+        {
+            case OPCODE_ADD:
+            {
+                /* No work for ADD */
+                break;
+            }
+
+            case OPCODE_LOAD:
+            case OPCODE_LOADP:
+            {
+                if (in_scratchpad(cpu->memory.memory_address))
                 {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
+                    if (!scratchpad_access(cpu, &cpu->memory))
                     {
-                        cpu->stall = 1;
+                        cpu->mem_stall_cycles++;
                         if (ENABLE_DEBUG_MESSAGES)
                         {
-                            print_stage_content("Decode/RF", &cpu->decode);
+                            print_stage_content("Memory", &cpu->memory);
                         }
                         return;
                     }
-                    else
+                    cpu->memory.result_buffer
+                        = read_data(cpu, cpu->memory.memory_address);
+                    break;
+                }
+
+                /* Read from data memory, a miss without a free MSHR waits */
+                if (!issue_load(cpu, &cpu->memory))
+                {
+                    cpu->mem_stall_cycles++;
+                    if (ENABLE_DEBUG_MESSAGES)
                     {
-                        cpu->stall = 0;
+                        print_stage_content("Memory", &cpu->memory);
                     }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
+                    return;
                 }
 
-                case OPCODE_XOR:
+                if (ENABLE_STRIDE_PREFETCHER)
+                {
+                    train_prefetcher(cpu, &cpu->memory);
+                }
+                break;
+            }
+
+            case OPCODE_PREFETCH:
+            {
+                /* Hint only, no register is written and Memory never waits */
+                cpu->dcache_busy = TRUE;
+                issue_prefetch(cpu, cpu->memory.memory_address, FILL_SW_PREFETCH);
+                break;
+            }
+
+            case OPCODE_STORE:
+            case OPCODE_STOREP:
+            {
+                if (in_scratchpad(cpu->memory.memory_address))
                 {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
+                    if (!scratchpad_access(cpu, &cpu->memory))
                     {
-                        cpu->stall = 1;
+                        cpu->mem_stall_cycles++;
                         if (ENABLE_DEBUG_MESSAGES)
                         {
-                            print_stage_content("Decode/RF", &cpu->decode);
+                            print_stage_content("Memory", &cpu->memory);
                         }
                         return;
                     }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->status[cpu->decode.rd] = BUSY;
+                    write_data(cpu, cpu->memory.memory_address,
+                              cpu->memory.rs1_value);
                     break;
                 }
 
-                case OPCODE_LOAD:
+                /* Retire into the store buffer, it writes the cache later */
+                if (ENABLE_STORE_BUFFER)
                 {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY){
-                        cpu->stall = 1;
+                    if (!store_buffer_push(&cpu->store_buffer,
+                                           cpu->memory.memory_address,
+                                           cpu->memory.rs1_value))
+                    {
+                        cpu->store_buffer.full_stalls++;
+                        cpu->mem_stall_cycles++;
                         if (ENABLE_DEBUG_MESSAGES)
                         {
-                            print_stage_content("Decode/RF", &cpu->decode);
+                            print_stage_content("Memory", &cpu->memory);
                         }
                         return;
                     }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->status[cpu->decode.rd] = BUSY;
                     break;
                 }
 
-                case OPCODE_LOADP:
+                /* Write to data memory once the line is in the cache */
+                if (!issue_store(cpu, &cpu->memory))
                 {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY)
+                    cpu->mem_stall_cycles++;
+                    if (ENABLE_DEBUG_MESSAGES)
                     {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
+                        print_stage_content("Memory", &cpu->memory);
                     }
-                    else
+                    return;
+                }
+                write_data(cpu, cpu->memory.memory_address,
+                          cpu->memory.rs1_value);
+                break;
+            }
+
+            case OPCODE_VLOAD:
+            {
+                if (!vector_access_ready(cpu, &cpu->memory, FALSE))
+                {
+                    cpu->mem_stall_cycles++;
+                    if (ENABLE_DEBUG_MESSAGES)
                     {
-                        cpu->stall = 0;
+                        print_stage_content("Memory", &cpu->memory);
                     }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->status[cpu->decode.rs1] = BUSY;
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
+                    return;
                 }
 
-                case OPCODE_STORE:
+                /* Each word may still sit in the store buffer */
+                for (i = 0; i < VECTOR_LENGTH; ++i)
                 {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
+                    address = cpu->memory.memory_address + i * DATA_WORD_STRIDE;
+                    if (!ENABLE_STORE_BUFFER
+                        || !store_buffer_search(&cpu->store_buffer, address,
+                                                &cpu->memory.vector_result[i]))
                     {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
+                        cpu->memory.vector_result[i]
+                            = read_data(cpu, address);
                     }
-                    else
+                }
+
+                if (ENABLE_STRIDE_PREFETCHER)
+                {
+                    train_prefetcher(cpu, &cpu->memory);
+                }
+                break;
+            }
+
+            case OPCODE_VSTORE:
+            {
+                /* Buffered scalar stores must not land after this one */
+                if (cpu->store_buffer.count
+                    || !vector_access_ready(cpu, &cpu->memory, TRUE))
+                {
+                    cpu->mem_stall_cycles++;
+                    if (ENABLE_DEBUG_MESSAGES)
                     {
-                        cpu->stall = 0;
+                        print_stage_content("Memory", &cpu->memory);
                     }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    break;
+                    return;
                 }
 
-                case OPCODE_STOREP:
+                for (i = 0; i < VECTOR_LENGTH; ++i)
+                {
+                    write_data(cpu,
+                              cpu->memory.memory_address + i * DATA_WORD_STRIDE,
+                              cpu->memory.vs1_value[i]);
+                }
+                break;
+            }
+
+            case OPCODE_COPY:
+            {
+                /* Older stores must reach memory before the engine reads
+                 * it, then the copy is queued and runs in the background */
+                if (cpu->store_buffer.count
+                    || !dma_enqueue(&cpu->dma, cpu->memory.rs2_value,
+                                    cpu->memory.rs1_value, cpu->memory.imm))
                 {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
+                    if (!cpu->store_buffer.count)
                     {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
+                        cpu->dma.full_stalls++;
                     }
-                    else
+                    cpu->mem_stall_cycles++;
+                    if (ENABLE_DEBUG_MESSAGES)
                     {
-                        cpu->stall = 0;
+                        print_stage_content("Memory", &cpu->memory);
                     }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    cpu->status[cpu->decode.rs2] = BUSY;
-                    break;
+                    return;
                 }
+                break;
+            }
 
-                case OPCODE_CMP:
+            case OPCODE_DMAWAIT:
+            {
+                /* Wait until every queued copy has completed */
+                if (cpu->dma.count)
                 {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY || (cpu->status[cpu->decode.rs2]) == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
+                    cpu->dma.wait_cycles++;
+                    cpu->mem_stall_cycles++;
+                    if (ENABLE_DEBUG_MESSAGES)
                     {
-                        cpu->stall = 0;
+                        print_stage_content("Memory", &cpu->memory);
                     }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->decode.rs2_value = cpu->regs[cpu->decode.rs2];
-                    break;
+                    return;
+                }
+                break;
+            }
+
+            case OPCODE_NOP:
+            {
+                break;
+            }
+        }
+
+        if (ENABLE_VALUE_PREDICTION && !cpu->memory.runahead
+            && (cpu->memory.opcode == OPCODE_LOAD
+                || cpu->memory.opcode == OPCODE_LOADP))
+        {
+            lvp_verify(cpu, &cpu->memory);
+        }
+
+        /* Copy data from memory latch to writeback latch*/
+        cpu->writeback = cpu->memory;
+        cpu->memory.has_insn = FALSE;
+
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("Memory", &cpu->memory);
+        }
+    }
+}
+
+/*
+ * Writeback Stage of APEX Pipeline
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+static int
+APEX_writeback(APEX_CPU *cpu)
+{
+    APEX_Thread *thread = &cpu->threads[cpu->writeback.thread];
+    int last = cpu->writeback.opcode == OPCODE_HALT
+               && cpu->halted_threads == cpu->num_threads - 1;
+
+    if (cpu->writeback.has_insn)
+    {
+        /* Let buffered stores and outstanding misses complete before
+         * stopping, other threads keep running past an earlier HALT */
+        if (last && cpu->store_buffer.count)
+        {
+            cpu->store_buffer.drain_cycles++;
+            return 0;
+        }
+
+        if (last && mshr_outstanding(cpu->mshr))
+        {
+            return 0;
+        }
+
+        if (last && cpu->dma.count)
+        {
+            cpu->dma.wait_cycles++;
+            return 0;
+        }
+
+        /* Dependents ran ahead on a predicted value, the load retires once
+         * its line confirms it */
+        if (cpu->writeback.verify_cycle > cpu->clock)
+        {
+            return 0;
+        }
+
+        /* Write result to register file based on instruction type */
+        switch (cpu->writeback.opcode)
+        {
+            case OPCODE_ADD:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_ADDL:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_SUB:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_SUBL:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_MUL:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_MAC:
+            case OPCODE_SHADD:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                if (!cpu->writeback.runahead)
+                {
+                    cpu->mac_shadd_insns++;
+                }
+                break;
+            }
+
+            case OPCODE_CMOVZ:
+            case OPCODE_CMOVNZ:
+            case OPCODE_CMOVP:
+            case OPCODE_CMOVN:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                if (!cpu->writeback.runahead)
+                {
+                    cpu->cmov_insns++;
+                }
+                break;
+            }
+
+            case OPCODE_AND:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_OR:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_XOR:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_LOAD:
+            {
+                /* A missing load gets its rd written by the MSHR, and a
+                 * verified prediction put the value there already */
+                if (!cpu->writeback.mshr_pending
+                    && !cpu->writeback.value_verified)
+                {
+                    thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                    thread->status[cpu->writeback.rd] = FREE;
+                }
+                break;
+            }
+
+            case OPCODE_LOADP:
+            {
+                if (!cpu->writeback.mshr_pending
+                    && !cpu->writeback.value_verified)
+                {
+                    thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                    thread->status[cpu->writeback.rd] = FREE;
                 }
+                thread->regs[cpu->writeback.rs1] = cpu->writeback.rs1_value;
+                thread->status[cpu->writeback.rs1] = FREE;
+                break;
+            }
+
+            case OPCODE_STOREP:
+            {
+                thread->regs[cpu->writeback.rs2] = cpu->writeback.rs2_value;
+                thread->status[cpu->writeback.rs2] = FREE;
+                break;
+            }
+
+            case OPCODE_MOVC: 
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_VLOAD:
+            case OPCODE_VADD:
+            case OPCODE_VMUL:
+            {
+                memcpy(thread->vregs[cpu->writeback.rd], cpu->writeback.vector_result,
+                       sizeof(cpu->writeback.vector_result));
+                thread->vstatus[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_VRED:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
+                thread->status[cpu->writeback.rd] = FREE;
+                break;
+            }
+
+            case OPCODE_JALR:
+            {
+                thread->regs[cpu->writeback.rd] = cpu->writeback.pc + cpu->writeback.size;
+                thread->status[cpu->writeback.rd] = FREE;
+            }
+            case OPCODE_NOP:
+            {
+                break;
+            }
+        }
+
+        /* Runahead results only feed later runahead instructions */
+        if (cpu->writeback.runahead)
+        {
+            if (writes_rd(cpu->writeback.opcode))
+            {
+                thread->runahead.inv[cpu->writeback.rd] = cpu->writeback.invalid;
+            }
+            cpu->runahead_insns++;
+            cpu->writeback.has_insn = FALSE;
+            if (ENABLE_DEBUG_MESSAGES)
+            {
+                print_stage_content("Writeback", &cpu->writeback);
+            }
+            return 0;
+        }
+
+        if (cpu->writeback.opcode >= OPCODE_VLOAD
+            && cpu->writeback.opcode <= OPCODE_VRED)
+        {
+            cpu->vector_insns++;
+        }
+
+        /* A fused pair retires both of its instructions */
+        if (cpu->writeback.fused)
+        {
+            cpu->insn_completed++;
+        }
+
+        cpu->insn_completed++;
+        thread->insn_completed += cpu->writeback.fused ? 2 : 1;
+        cpu->writeback.has_insn = FALSE;
+
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            print_stage_content("Writeback", &cpu->writeback);
+        }
+
+        if (cpu->writeback.opcode == OPCODE_HALT)
+        {
+            thread->halted = TRUE;
+            thread->halt_cycle = cpu->clock;
+            cpu->halted_threads++;
+
+            /* Stop the APEX simulator once every thread is done */
+            return last;
+        }
+
+        
+    }
+
+    /* Default */
+    return 0;
+}
+
+/*
+ * Creates one core running num_threads of the program files as hardware
+ * threads, on the data memory and bus of the system.
+ */
+static APEX_CPU *
+core_init(APEX_System *sys, int core, const char *const *filenames,
+          int num_threads)
+{
+    int i, t, size;
+    unsigned long long insn;
+    APEX_Instruction ins;
+    APEX_Thread *thread;
+    APEX_CPU *cpu;
+
+    cpu = calloc(1, sizeof(APEX_CPU));
 
-                case OPCODE_CML:
-                {
-                    if ((cpu->status[cpu->decode.rs1]) == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    break;
-                }
+    if (!cpu)
+    {
+        return NULL;
+    }
 
-                case OPCODE_MOVC:
-                {
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    /* MOVC doesn't have register operands */
-                    break;
-                }
-                case OPCODE_JUMP:
-                {
-                    if(cpu->status[cpu->decode.rs1] == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    break;
-                    
-                }
+    /* Initialize Registers and all pipeline stages */
+    cpu->core = core;
+    cpu->num_threads = num_threads;
+    cpu->data_memory = &sys->data_memory;
+    cpu->bus = (sys->num_cores > 1) ? &sys->bus : NULL;
+    cpu->hold_stores = (sys->num_cores > 1);
+    dcache_init(&cpu->dcache);
+    tlb_init(&cpu->dtlb, DTLB_ENTRIES);
+    tlb_init(&cpu->itlb, ITLB_ENTRIES);
+
+    for (t = 0; t < num_threads; ++t)
+    {
+        thread = &cpu->threads[t];
+        thread->pc = 4000;
+        thread->fetching = TRUE;
+        thread->regs[CORE_ID_REG] = core;
 
-                case OPCODE_JALR:
-                {
-                    if (cpu->status[cpu->decode.rs1] == BUSY)
-                    {
-                        cpu->stall = 1;
-                        if (ENABLE_DEBUG_MESSAGES)
-                        {
-                            print_stage_content("Decode/RF", &cpu->decode);
-                        }
-                        return;
-                    }
-                    else
-                    {
-                        cpu->stall = 0;
-                    }
-                    cpu->decode.rs1_value = cpu->regs[cpu->decode.rs1];
-                    cpu->status[cpu->decode.rd] = BUSY;
-                    break;
-                }
-                case OPCODE_NOP:
-                {
-                    break;
-                }
-            }
+        for (i = 0; i < REG_FILE_SIZE; i++)
+        {
+            thread->status[i] = FREE;
+        }
 
-        /* Copy data from decode latch to execute latch*/
-        if(!cpu->stall){
-            cpu->execute = cpu->decode;
-            cpu->decode.has_insn = FALSE;
+        for (i = 0; i < VECTOR_REG_FILE_SIZE; i++)
+        {
+            thread->vstatus[i] = FREE;
         }
-        cpu->stall = 0;
+
+        /* Parse input file and create the thread's code memory, data
+         * directives preload the shared data memory */
+        thread->code_memory = create_code_memory(filenames[t],
+                                                 &thread->code_memory_size,
+                                                 cpu->data_memory);
+        if (!thread->code_memory)
+        {
+            for (i = 0; i < t; ++i)
+            {
+                free(cpu->threads[i].code_memory);
+            }
+            free(cpu);
+            return NULL;
+        }
+
         if (ENABLE_DEBUG_MESSAGES)
         {
-            print_stage_content("Decode/RF", &cpu->decode);
+            if (sys->num_cores > 1)
+            {
+                fprintf(stderr, "APEX_CPU: Core %d\n", core);
+            }
+            fprintf(stderr,
+                    "APEX_CPU: Initialized thread %d from %s, loaded %d bytes of code\n",
+                    t, filenames[t], thread->code_memory_size);
+            fprintf(stderr, "APEX_CPU: PC initialized to %d\n", thread->pc);
+            fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
+            printf("%-9s %-16s %-9s %-9s %-9s %-9s %-9s\n", "pc", "encoding",
+                   "opcode_str", "rd", "rs1", "rs2", "imm");
+
+            for (i = 0; i < thread->code_memory_size; i += size)
+            {
+                insn = isa_fetch(thread->code_memory, thread->code_memory_size,
+                                 i, &size);
+                isa_decode(insn, &ins);
+                printf("%-9d %0*llx%*s %-9s %-9d %-9d %-9d %-9d\n",
+                       thread->pc + i, size * 2, insn, 16 - size * 2, "",
+                       ins.opcode_str, ins.rd, ins.rs1, ins.rs2, ins.imm);
+            }
         }
     }
+
+    /* To start fetch stage */
+    cpu->fetch.has_insn = TRUE;
+    return cpu;
 }
 
 /*
- * Execute Stage of APEX Pipeline
+ * This function creates and initializes APEX cpu.
  *
- * Note: You are free to edit this function according to your implementation
+ * The program files are split evenly across num_cores cores, in order, and
+ * the cores share data memory and the bus to it. A quantum above zero runs
+ * each core on its own host thread, that many cycles between the points
+ * where they meet, while zero steps them in turn one cycle at a time.
+ */
+APEX_System *
+APEX_cpu_init(const char *const *filenames, int num_files, int num_cores,
+              int quantum)
+{
+    int c, per_core;
+    APEX_System *sys;
+
+    if (!filenames || num_cores < 1 || num_cores > MAX_CORES || quantum < 0
+        || num_files < num_cores || num_files % num_cores)
+    {
+        return NULL;
+    }
+
+    per_core = num_files / num_cores;
+    if (per_core > SMT_MAX_THREADS)
+    {
+        return NULL;
+    }
+
+    sys = calloc(1, sizeof(APEX_System));
+
+    if (!sys)
+    {
+        return NULL;
+    }
+
+    sys->num_cores = num_cores;
+    sys->filenames = filenames;
+    sys->num_files = num_files;
+    sys->quantum = quantum ? quantum : 1;
+    sys->parallel = quantum && num_cores > 1 && !ENABLE_DEBUG_MESSAGES;
+    sys->single_step = ENABLE_SINGLE_STEP;
+    bus_init(&sys->bus, num_cores, num_cores > 1 && sys->quantum > 1);
+
+    /* Threads would interleave their trace output */
+    if (quantum && num_cores > 1 && ENABLE_DEBUG_MESSAGES)
+    {
+        fprintf(stderr, "APEX_CPU: Debug messages keep the cores on one host thread\n");
+    }
+
+    for (c = 0; c < num_cores; ++c)
+    {
+        sys->cores[c] = core_init(sys, c, &filenames[c * per_core], per_core);
+        if (!sys->cores[c])
+        {
+            APEX_cpu_stop(sys);
+            return NULL;
+        }
+        bus_attach(&sys->bus, c, &sys->cores[c]->dcache, sys->cores[c]->mshr);
+    }
+
+    return sys;
+}
+
+/*
+ * Runs one clock cycle of a core. Returns TRUE once its last HALT retires,
+ * the rest of the pipeline is empty by then.
+ */
+static int
+APEX_cpu_cycle(APEX_CPU *cpu)
+{
+    service_mshrs(cpu);
+
+    if (APEX_writeback(cpu))
+    {
+        return TRUE;
+    }
+
+    APEX_memory(cpu);
+    drain_store_buffer(cpu);
+    apply_snoops(cpu);
+    dma_step(&cpu->dma, cpu->data_memory,
+             cpu->hold_stores ? &cpu->mem_log : NULL, cpu->clock);
+    APEX_execute(cpu);
+    APEX_decode(cpu);
+    APEX_fetch(cpu);
+    return FALSE;
+}
+
+/*
+ * Per core CPI, how long each core's misses queued for the bus, the share
+ * of cycles the bus was busy, and what its transactions were. A run on
+ * host threads also reports its speedup over the same run, same quantum,
+ * on one host thread.
  */
 static void
-APEX_execute(APEX_CPU *cpu)
+print_system_stats(const APEX_System *sys)
 {
-    if (cpu->execute.has_insn)
+    const APEX_CPU *cpu;
+    int c, transactions = 0;
+    double stepping = 0.0;
+
+    for (c = 0; c < sys->num_cores; ++c)
     {
-        /* Execute logic based on instruction type */
-        switch (cpu->execute.opcode)
+        cpu = sys->cores[c];
+        transactions += sys->bus.transactions[c];
+        printf("APEX_CPU: Core %d instructions = %d cycles = %d CPI = %.3f bus transactions = %d bus wait cycles = %d\n",
+               c, cpu->insn_completed, cpu->clock,
+               cpu->insn_completed ? (double)cpu->clock / cpu->insn_completed : 0.0,
+               sys->bus.transactions[c], sys->bus.wait_cycles[c]);
+    }
+    printf("APEX_CPU: Bus transactions = %d busy cycles = %d utilization = %.1f%%\n",
+           transactions, sys->bus.busy_cycles,
+           percent(sys->bus.busy_cycles, sys->clock));
+    printf("APEX_CPU: Bus reads = %d read exclusives = %d upgrades = %d writebacks = %d\n",
+           sys->bus.requests[BUS_READ], sys->bus.requests[BUS_READ_EXCLUSIVE],
+           sys->bus.requests[BUS_UPGRADE], sys->bus.requests[BUS_WRITEBACK]);
+
+    for (c = 0; c < sys->num_cores; ++c)
+    {
+        stepping += sys->step_seconds[c];
+    }
+    printf("APEX_CPU: Host threads = %d quantum = %d run time = %.3f s core stepping time = %.3f s\n",
+           sys->parallel ? sys->num_cores : 1, sys->quantum,
+           sys->wall_seconds, stepping);
+    if (sys->serial_seconds > 0.0)
+    {
+        printf("APEX_CPU: One host thread run time = %.3f s speedup = %.2f\n",
+               sys->serial_seconds,
+               sys->wall_seconds > 0.0 ? sys->serial_seconds / sys->wall_seconds
+                                       : 0.0);
+    }
+}
+
+/* Reports the run so far, core by core when there are several */
+static void
+print_system(const APEX_System *sys, const char *outcome)
+{
+    int c, insns = 0;
+
+    for (c = 0; c < sys->num_cores; ++c)
+    {
+        insns += sys->cores[c]->insn_completed;
+    }
+
+    printf("APEX_CPU: Simulation %s, cycles = %d instructions = %d\n", outcome,
+           sys->clock, insns);
+    for (c = 0; c < sys->num_cores; ++c)
+    {
+        if (sys->num_cores > 1)
         {
-            case OPCODE_ADD:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.rs2_value;
+            printf("APEX_CPU: Core %d\n", c);
+        }
+        print_stats(sys->cores[c]);
+    }
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+    if (sys->num_cores > 1)
+    {
+        print_system_stats(sys);
+    }
+}
 
-                break;
-            }
+/* Host time in seconds, for the speedup report */
+static double
+host_seconds(void)
+{
+    struct timespec now;
 
-            case OPCODE_ADDL:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value + cpu->execute.imm;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec / 1e9;
+}
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+/*
+ * Runs a core through the current quantum, or until its last HALT retires.
+ * Cycles the bus charged it are spent first, with the pipeline frozen. A
+ * core only changes its own state here, so the cores can run on separate
+ * host threads.
+ */
+static void
+step_core(APEX_System *sys, int core)
+{
+    APEX_CPU *cpu = sys->cores[core];
+    double start = host_seconds();
+    int i;
 
-                break;
-            }
-            case OPCODE_SUB:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
+    for (i = 0; !cpu->halted && i < sys->quantum; ++i)
+    {
+        if (i)
+        {
+            cpu->clock++;
+        }
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+        if (cpu->bus_stall)
+        {
+            cpu->bus_stall--;
+            continue;
+        }
 
-                break;
-            }
+        if (ENABLE_DEBUG_MESSAGES && sys->num_cores > 1)
+        {
+            printf("Core %d\n", core);
+        }
 
-            case OPCODE_SUBL:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
+        if (APEX_cpu_cycle(cpu))
+        {
+            /* Halt in writeback stage */
+            cpu->halted = TRUE;
+        }
+    }
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+    sys->step_seconds[core] += host_seconds() - start;
+}
 
-                break;
-            }
+/* Host thread of one core, runs a quantum whenever the main thread starts
+ * one, until the run is over */
+static void *
+host_thread(void *arg)
+{
+    Host_Thread *thread = arg;
+    APEX_System *sys = thread->sys;
 
-            case OPCODE_CMP:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.rs2_value;
+    while (TRUE)
+    {
+        pthread_barrier_wait(&sys->start);
+        if (!sys->running)
+        {
+            return NULL;
+        }
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+        step_core(sys, thread->core);
+        pthread_barrier_wait(&sys->done);
+    }
+}
 
-                break;
-            }
+/*
+ * Runs the cores through the quantum starting at sys->clock, in parallel
+ * or one after the other. The bus then arbitrates each cycle of it in turn,
+ * or replays what the cores sent over a longer quantum, and the stores of
+ * the cores reach data memory in core order. On return sys->clock is the
+ * last cycle run.
+ */
+static void
+run_quantum(APEX_System *sys)
+{
+    int c, cycle, last = sys->clock + sys->quantum - 1;
 
-            case OPCODE_CML:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value - cpu->execute.imm;
+    if (sys->parallel)
+    {
+        pthread_barrier_wait(&sys->start);
+        pthread_barrier_wait(&sys->done);
+    }
+    else
+    {
+        for (c = 0; c < sys->num_cores; ++c)
+        {
+            step_core(sys, c);
+        }
+    }
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+    sys->halted_cores = 0;
+    for (c = 0; c < sys->num_cores; ++c)
+    {
+        sys->halted_cores += sys->cores[c]->halted;
+    }
 
-                break;
+    /* The run ends in the cycle the last core halted */
+    if (sys->halted_cores == sys->num_cores)
+    {
+        last = sys->clock;
+        for (c = 0; c < sys->num_cores; ++c)
+        {
+            if (sys->cores[c]->clock > last)
+            {
+                last = sys->cores[c]->clock;
             }
+        }
+    }
 
-            case OPCODE_MUL:
+    if (sys->num_cores > 1)
+    {
+        if (sys->bus.deferred)
+        {
+            bus_replay(&sys->bus);
+            for (c = 0; c < sys->num_cores; ++c)
             {
-                cpu->execute.result_buffer = cpu->execute.rs1_value * cpu->execute.rs2_value;
-
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
-
-                break;
+                sys->cores[c]->bus_stall += sys->bus.stall_cycles[c];
+            }
+        }
+        else
+        {
+            for (cycle = sys->clock; cycle <= last; ++cycle)
+            {
+                bus_arbitrate(&sys->bus, cycle);
             }
+        }
+
+        for (c = 0; c < sys->num_cores; ++c)
+        {
+            mem_log_commit(&sys->cores[c]->mem_log, &sys->data_memory);
+        }
+    }
 
-            case OPCODE_AND:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value & cpu->execute.rs2_value;
+    sys->clock = last;
+}
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+/* Moves the system and the cores still running to the next cycle */
+static void
+next_cycle(APEX_System *sys)
+{
+    int c;
 
-                break;
-            }
+    sys->clock++;
+    for (c = 0; c < sys->num_cores; ++c)
+    {
+        if (!sys->cores[c]->halted)
+        {
+            sys->cores[c]->clock++;
+        }
+    }
+}
 
-            case OPCODE_OR:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value | cpu->execute.rs2_value;
+/* Host time of the same run with every core stepped on the calling
+ * thread. The quantum stays, so it retires the same cycles and results */
+static double
+serial_seconds(const APEX_System *sys)
+{
+    APEX_System *reference = APEX_cpu_init(sys->filenames, sys->num_files,
+                                           sys->num_cores, sys->quantum);
+    double start = host_seconds(), seconds;
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+    if (!reference)
+    {
+        return 0.0;
+    }
 
-                break;
-            }
+    reference->parallel = FALSE;
+    while (TRUE)
+    {
+        run_quantum(reference);
+        if (reference->halted_cores == reference->num_cores)
+        {
+            break;
+        }
+        next_cycle(reference);
+    }
+    seconds = host_seconds() - start;
 
-            case OPCODE_XOR:
-            {
-                cpu->execute.result_buffer = cpu->execute.rs1_value ^ cpu->execute.rs2_value;
+    APEX_cpu_stop(reference);
+    return seconds;
+}
 
-                /* Set the zero flag based on the result buffer */
-                cpu->zero_flag = (cpu->execute.result_buffer == 0) ? TRUE : FALSE;
-                /* Set the positive flag based on the result buffer */
-                cpu->positive_flag = (cpu->execute.result_buffer > 0) ? TRUE : FALSE;
-                /* Set the negative flag based on the result buffer */
-                cpu->negative_flag = (cpu->execute.result_buffer < 0) ? TRUE : FALSE;
+/* Dumps the registers of every thread of every core */
+static void
+print_registers(const APEX_System *sys)
+{
+    const APEX_CPU *cpu;
+    int c, i;
 
-                break;
+    for (c = 0; c < sys->num_cores; ++c)
+    {
+        cpu = sys->cores[c];
+        for (i = 0; i < cpu->num_threads; ++i)
+        {
+            if (sys->num_cores > 1)
+            {
+                printf("Core %d Thread %d%s\n", c, i,
+                       cpu->threads[i].halted ? " (halted)" : "");
             }
-
-            case OPCODE_LOAD:
+            else if (cpu->num_threads > 1)
             {
-                cpu->execute.memory_address
-                    = cpu->execute.rs1_value + cpu->execute.imm;
-                break;
+                printf("Thread %d%s\n", i,
+                       cpu->threads[i].halted ? " (halted)" : "");
             }
-
-            case OPCODE_LOADP:
+            print_reg_file(&cpu->threads[i]);
+            if (ENABLE_DEBUG_MESSAGES)
             {
-                cpu->execute.memory_address = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->execute.rs1_value = cpu->execute.rs1_value + 4;
-                break;
+                print_vector_reg_file(&cpu->threads[i]);
             }
+        }
+    }
+}
 
-            case OPCODE_STORE:
-            { 
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-            }
+/*
+ * APEX CPU simulation loop
+ *
+ * Every core runs a quantum, then the bus and data memory catch up with
+ * them. A core that is done stops its clock there.
+ */
+void
+APEX_cpu_run(APEX_System *sys)
+{
+    char user_prompt_val;
+    double start = host_seconds();
+    int c;
 
-            case OPCODE_STOREP:
+    sys->running = TRUE;
+    if (sys->parallel)
+    {
+        pthread_barrier_init(&sys->start, NULL, sys->num_cores + 1);
+        pthread_barrier_init(&sys->done, NULL, sys->num_cores + 1);
+        for (c = 0; c < sys->num_cores; ++c)
+        {
+            sys->threads[c].sys = sys;
+            sys->threads[c].core = c;
+            pthread_create(&sys->threads[c].id, NULL, host_thread,
+                           &sys->threads[c]);
+        }
+    }
+
+    while (TRUE)
+    {
+        if (ENABLE_DEBUG_MESSAGES)
+        {
+            printf("--------------------------------------------\n");
+            if (sys->quantum > 1)
             {
-                cpu->execute.memory_address = cpu->execute.rs2_value + cpu->execute.imm;
-                cpu->execute.rs2_value = cpu->execute.rs2_value + 4;
+                printf("Clock Cycles #: %d to %d\n", sys->clock,
+                       sys->clock + sys->quantum - 1);
             }
-
-            case OPCODE_JUMP:
+            else
             {
-                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->fetch_from_next_cycle = TRUE;
-                cpu->fetch.has_insn = TRUE;
-                cpu->decode.has_insn = FALSE;
-                break;
+                printf("Clock Cycle #: %d\n", sys->clock);
             }
+            printf("--------------------------------------------\n");
+        }
 
-            case OPCODE_JALR:
+        run_quantum(sys);
+
+        if (sys->halted_cores == sys->num_cores)
+        {
+            sys->wall_seconds = host_seconds() - start;
+            if (sys->parallel)
             {
-                cpu->pc = cpu->execute.rs1_value + cpu->execute.imm;
-                cpu->fetch_from_next_cycle = TRUE;
-                cpu->decode.has_insn = FALSE;
-                cpu->fetch.has_insn = TRUE;
+                sys->serial_seconds = serial_seconds(sys);
             }
+            /* The last dump predates the halting cycle, whose fills and
+             * writebacks may still have landed */
+            print_registers(sys);
+            print_system(sys, "Complete");
+            break;
+        }
 
-            case OPCODE_BZ:
-            {
-                if (cpu->zero_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+        print_registers(sys);
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+        if (sys->single_step)
+        {
+            printf("Press any key to advance CPU Clock or <q> to quit:\n");
+            scanf("%c", &user_prompt_val);
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
+            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
+            {
+                sys->wall_seconds = host_seconds() - start;
+                print_system(sys, "Stopped");
                 break;
             }
+        }
 
-            case OPCODE_BNZ:
-            {
-                if (cpu->zero_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
-                    
-                    /* Since we are using reverse callbacks for pipeline stages, 
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+        next_cycle(sys);
+    }
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+    if (sys->parallel)
+    {
+        sys->running = FALSE;
+        pthread_barrier_wait(&sys->start);
+        for (c = 0; c < sys->num_cores; ++c)
+        {
+            pthread_join(sys->threads[c].id, NULL);
+        }
+        pthread_barrier_destroy(&sys->start);
+        pthread_barrier_destroy(&sys->done);
+    }
+}
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+/*
+ * This function deallocates APEX CPU.
+ *
+ * Note: You are free to edit this function according to your implementation
+ */
+void
+APEX_cpu_stop(APEX_System *sys)
+{
+    int c, i;
 
-            case OPCODE_BP:
-            {
-                if (cpu->positive_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    for (c = 0; c < sys->num_cores; ++c)
+    {
+        if (!sys->cores[c])
+        {
+            continue;
+        }
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+        for (i = 0; i < sys->cores[c]->num_threads; ++i)
+        {
+            free(sys->cores[c]->threads[i].code_memory);
+        }
+        mem_log_free(&sys->cores[c]->mem_log);
+        free(sys->cores[c]);
+    }
+    bus_free(&sys->bus);
+    mem_free(&sys->data_memory);
+    free(sys);
+}
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+/* Runs the translator and the interpreter on their own copies of the
+ * program, comparing them every DBT_CHECK_INSNS instructions and their data
+ * memories at the end. Returns FALSE at the first difference */
+static int
+check_translation(DBT_Engine *dbt, Func_State *translated,
+                  Func_State *interpreted)
+{
+    long long count;
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+    while (!translated->halted)
+    {
+        count = dbt_run(dbt, translated, DBT_CHECK_INSNS);
+        func_run(interpreted, count);
+        if (!func_state_equal(translated, interpreted))
+        {
+            fprintf(stderr,
+                    "APEX_Error: Translated run differs from the interpreter within instructions %lld to %lld, PC %d against %d\n",
+                    interpreted->insn_count - count + 1,
+                    interpreted->insn_count, translated->pc,
+                    interpreted->pc);
+            return FALSE;
+        }
+    }
 
-            case OPCODE_BNP:
-            {
-                if (cpu->positive_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    if (!mem_equal(translated->data_memory, interpreted->data_memory))
+    {
+        fprintf(stderr, "APEX_Error: Translated run leaves different data memory\n");
+        return FALSE;
+    }
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+    return TRUE;
+}
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+/* Runs the program through the pipeline of a single core to HALT and
+ * compares its registers, flags, instruction count and data memory with
+ * those the interpreter finished with. Returns FALSE at the first
+ * difference */
+static int
+check_pipeline(const char *filename, const Func_State *interpreted)
+{
+    APEX_System *sys = APEX_cpu_init(&filename, 1, 1, 0);
+    APEX_CPU *cpu;
+    APEX_Thread *thread;
+    int i, same = TRUE;
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+    if (!sys)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+        return FALSE;
+    }
 
-            case OPCODE_BN:
-            {
-                if (cpu->negative_flag == TRUE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    cpu = sys->cores[0];
+    thread = &cpu->threads[0];
+    while (!APEX_cpu_cycle(cpu))
+    {
+        cpu->clock++;
+    }
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        if (thread->regs[i] != interpreted->regs[i])
+        {
+            fprintf(stderr, "APEX_Error: Pipeline leaves R%d = %d against %d\n",
+                    i, thread->regs[i], interpreted->regs[i]);
+            same = FALSE;
+        }
+    }
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+    if (thread->zero_flag != interpreted->zero_flag
+        || thread->positive_flag != interpreted->positive_flag
+        || thread->negative_flag != interpreted->negative_flag)
+    {
+        fprintf(stderr, "APEX_Error: Pipeline leaves different flags\n");
+        same = FALSE;
+    }
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
+    if (memcmp(thread->vregs, interpreted->vregs, sizeof(thread->vregs)))
+    {
+        fprintf(stderr, "APEX_Error: Pipeline leaves different vector registers\n");
+        same = FALSE;
+    }
 
-            case OPCODE_BNN:
-            {
-                if (cpu->negative_flag == FALSE)
-                {
-                    /* Calculate new PC, and send it to fetch unit */
-                    cpu->pc = cpu->execute.pc + cpu->execute.imm;
+    if (thread->insn_completed != interpreted->insn_count)
+    {
+        fprintf(stderr, "APEX_Error: Pipeline retires %d instructions against %lld\n",
+                thread->insn_completed, interpreted->insn_count);
+        same = FALSE;
+    }
 
-                    /* Since we are using reverse callbacks for pipeline stages,
-                     * this will prevent the new instruction from being fetched in the current cycle*/
-                    cpu->fetch_from_next_cycle = TRUE;
+    if (!mem_equal(cpu->data_memory, interpreted->data_memory))
+    {
+        fprintf(stderr, "APEX_Error: Pipeline leaves different data memory\n");
+        same = FALSE;
+    }
 
-                    /* Flush previous stages */
-                    cpu->decode.has_insn = FALSE;
+    if (same)
+    {
+        printf("APEX_CPU: Pipeline run matches the interpreter, cycles = %d\n",
+               cpu->clock);
+    }
 
-                    /* Make sure fetch stage is enabled to start fetching from new PC */
-                    cpu->fetch.has_insn = TRUE;
-                }
-                break;
-            }
-            case OPCODE_MOVC: 
-            {
-                cpu->execute.result_buffer = cpu->execute.imm;
-                break;
-            }
+    APEX_cpu_stop(sys);
+    return same;
+}
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
+/*
+ * Runs a program to HALT without the pipeline, with the interpreter
+ * ("interp"), the binary translator ("dbt"), or both side by side to check
+ * the translator ("check"). "pipeline" checks the pipeline instead, running
+ * it to HALT after the interpreter and comparing their final state. Prints
+ * the registers and the host speed, and returns 0 on success.
+ */
+int
+APEX_func_run(const char *filename, const char *engine)
+{
+    Data_Memory *memories = calloc(2, sizeof(Data_Memory));
+    unsigned char *code[2] = {NULL, NULL};
+    Func_State states[2];
+    DBT_Engine *dbt = NULL;
+    int check = strcmp(engine, "check") == 0;
+    int translate = check || strcmp(engine, "dbt") == 0;
+    int pipeline = strcmp(engine, "pipeline") == 0;
+    int size, i, status = 0;
+    double start, seconds;
+
+    if (!memories || (!translate && !pipeline
+                      && strcmp(engine, "interp") != 0))
+    {
+        fprintf(stderr, "APEX_Error: Unknown functional engine %s\n", engine);
+        free(memories);
+        return 1;
+    }
+
+    for (i = 0; i < 1 + check && !status; ++i)
+    {
+        code[i] = create_code_memory(filename, &size, &memories[i]);
+        if (!code[i])
+        {
+            fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+            status = 1;
+            break;
         }
+        func_init(&states[i], code[i], size, &memories[i]);
+    }
 
-        /* Copy data from execute latch to memory latch*/
-        if(!(cpu->stall)){
-                cpu->memory = cpu->execute;
-                cpu->execute.has_insn = FALSE;
+    if (!status && translate)
+    {
+        dbt = malloc(sizeof(DBT_Engine));
+        if (!dbt || !dbt_init(dbt))
+        {
+            fprintf(stderr, "APEX_Error: Binary translation needs an x86-64 host that allows executable memory\n");
+            status = 1;
         }
+    }
 
-        if (ENABLE_DEBUG_MESSAGES)
+    if (!status)
+    {
+        start = host_seconds();
+        if (check)
         {
-            print_stage_content("Execute", &cpu->execute);
+            status = !check_translation(dbt, &states[0], &states[1]);
+        }
+        else if (translate)
+        {
+            dbt_run(dbt, &states[0], LLONG_MAX);
+        }
+        else
+        {
+            func_run(&states[0], LLONG_MAX);
+        }
+        seconds = host_seconds() - start;
+
+        if (pipeline)
+        {
+            status = !check_pipeline(filename, &states[0]);
+        }
+
+        func_print_state(&states[0]);
+        printf("APEX_CPU: Functional run %s, instructions = %lld\n",
+               status ? "Stopped" : "Complete", states[0].insn_count);
+        printf("APEX_CPU: Engine = %s host time = %.3f s speed = %.1f MIPS\n",
+               engine, seconds,
+               seconds > 0 ? states[0].insn_count / seconds / 1e6 : 0.0);
+        if (translate)
+        {
+            printf("APEX_CPU: Blocks translated = %lld chained exits = %lld dispatches = %lld interpreted instructions = %lld cache flushes = %d\n",
+                   dbt->translations, dbt->chains, dbt->dispatches,
+                   dbt->interpreted, dbt->flushes);
+        }
+        if (check && !status)
+        {
+            printf("APEX_CPU: Translated run matches the interpreter\n");
         }
     }
+
+    if (dbt)
+    {
+        dbt_free(dbt);
+        free(dbt);
+    }
+    for (i = 0; i < 2; ++i)
+    {
+        free(code[i]);
+        mem_free(&memories[i]);
+    }
+    free(memories);
+    return status;
 }
 
 /*
- * Memory Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * Hands the architectural state of a functional run to the core, with its
+ * pipeline empty and Fetch about to read the instruction at the PC. Cache
+ * and TLB contents and the predictors are left as the last window had them.
  */
 static void
-APEX_memory(APEX_CPU *cpu)
+core_restart(APEX_CPU *cpu, const Func_State *state)
 {
-    if (cpu->memory.has_insn)
-    {
-        switch (cpu->memory.opcode)
-        {
-            case OPCODE_ADD:
-            {
-                /* No work for ADD */
-                break;
-            }
+    APEX_Thread *thread = &cpu->threads[0];
+    int i;
 
-            case OPCODE_LOAD:
-            {
-                /* Read from data memory */
-                cpu->memory.result_buffer
-                    = cpu->data_memory[cpu->memory.memory_address];
-                break;
-            }
+    thread->pc = state->pc;
+    memcpy(thread->regs, state->regs, sizeof(thread->regs));
+    thread->zero_flag = state->zero_flag;
+    thread->positive_flag = state->positive_flag;
+    thread->negative_flag = state->negative_flag;
+    memcpy(thread->vregs, state->vregs, sizeof(thread->vregs));
+    memcpy(thread->loop_stack, state->loop_stack, sizeof(thread->loop_stack));
+    thread->loop_depth = state->loop_depth;
 
-            case OPCODE_LOADP:
-            {
-                /* Read from data memory */
-                cpu->memory.result_buffer = cpu->data_memory[cpu->memory.memory_address];
-                break;
-            }
+    for (i = 0; i < REG_FILE_SIZE; i++)
+    {
+        thread->status[i] = FREE;
+    }
 
-            case OPCODE_STORE:
-            {
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-                break;
-            }
+    for (i = 0; i < VECTOR_REG_FILE_SIZE; i++)
+    {
+        thread->vstatus[i] = FREE;
+    }
 
-            case OPCODE_STOREP:
-            {
-                cpu->data_memory[cpu->memory.memory_address] = cpu->memory.rs1_value;
-                break;
-            }
+    thread->fetching = TRUE;
+    thread->fetch_from_next_cycle = FALSE;
+    thread->itlb_pc = 0;
+    thread->loop_buffer.state = LB_IDLE;
+    memset(&thread->decode, 0, sizeof(CPU_Stage));
+    memset(&thread->runahead, 0, sizeof(Runahead));
+    memset(thread->predicted, 0, sizeof(thread->predicted));
+    memset(thread->first_use, 0, sizeof(thread->first_use));
+    thread->halted = FALSE;
+
+    memset(&cpu->fetch, 0, sizeof(CPU_Stage));
+    memset(&cpu->execute, 0, sizeof(CPU_Stage));
+    memset(&cpu->memory, 0, sizeof(CPU_Stage));
+    memset(&cpu->writeback, 0, sizeof(CPU_Stage));
+    cpu->fetch.has_insn = TRUE;
 
-            case OPCODE_NOP:
-            {
-                break;
-            }
-        }
+    /* Walks in flight go with the misses they wait on */
+    for (i = 0; i < NUM_MSHRS; ++i)
+    {
+        cpu->mshr[i].valid = FALSE;
+    }
+    cpu->itlb.walking = FALSE;
+    cpu->dtlb.walking = FALSE;
+    cpu->num_snoops = 0;
+    cpu->store_buffer.head = 0;
+    cpu->store_buffer.count = 0;
+    cpu->dma.head = 0;
+    cpu->dma.count = 0;
+    cpu->dcache_busy = FALSE;
+    cpu->stall = 0;
+    cpu->halted_threads = 0;
+    cpu->halted = FALSE;
+    mem_log_discard(&cpu->mem_log);
+}
 
-        /* Copy data from memory latch to writeback latch*/
-        cpu->writeback = cpu->memory;
-        cpu->memory.has_insn = FALSE;
+/* Clocks the core until insns more instructions retire. Returns FALSE if
+ * its HALT retires first, with the clock left on that cycle as a full run
+ * leaves it */
+static int
+run_detailed(APEX_CPU *cpu, int insns)
+{
+    int target = cpu->insn_completed + insns;
 
-        if (ENABLE_DEBUG_MESSAGES)
+    while (cpu->insn_completed < target)
+    {
+        if (APEX_cpu_cycle(cpu))
         {
-            print_stage_content("Memory", &cpu->memory);
+            return FALSE;
         }
+        cpu->clock++;
     }
+
+    return TRUE;
+}
+
+static long long
+fast_forward(DBT_Engine *dbt, Func_State *state, long long insns)
+{
+    return dbt ? dbt_run(dbt, state, insns) : func_run(state, insns);
 }
 
 /*
- * Writeback Stage of APEX Pipeline
- *
- * Note: You are free to edit this function according to your implementation
+ * One sampled run of a program from the start. The functional run stops
+ * at the start of each of up to max_samples intervals of interval
+ * instructions, and the core carries on from there in detail: warmup, then
+ * a unit whose CPI goes into cpis. Stores in the window never reach data
+ * memory, so the functional run goes through those instructions itself.
+ * Without samples it is just a functional run. Returns the samples taken,
+ * state holds the final registers, or -1 if the program does not load.
  */
 static int
-APEX_writeback(APEX_CPU *cpu)
+sample_pass(const char *filename, DBT_Engine *dbt, long long interval,
+            int max_samples, double *cpis, Func_State *state,
+            long long *detailed)
 {
-    if (cpu->writeback.has_insn)
-    {
-        /* Write result to register file based on instruction type */
-        switch (cpu->writeback.opcode)
-        {
-            case OPCODE_ADD:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
-
-            case OPCODE_ADDL:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+    APEX_System *sys = APEX_cpu_init(&filename, 1, 1, 0);
+    APEX_Thread *thread;
+    APEX_CPU *cpu;
+    long long offset = (interval - SAMPLE_WARMUP_INSNS - SAMPLE_UNIT_INSNS) / 2;
+    int i, count = 0, first, start, cycle;
 
-            case OPCODE_SUB:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+    if (!sys)
+    {
+        return -1;
+    }
 
-            case OPCODE_SUBL:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+    cpu = sys->cores[0];
+    thread = &cpu->threads[0];
+    cpu->hold_stores = TRUE;
+    func_init(state, thread->code_memory, thread->code_memory_size,
+              &sys->data_memory);
+    if (dbt)
+    {
+        dbt_flush(dbt);
+    }
 
-            case OPCODE_MUL:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+    for (i = 0; i < max_samples; ++i)
+    {
+        fast_forward(dbt, state, i * interval + offset - state->insn_count);
+        if (state->halted)
+        {
+            break;
+        }
 
-            case OPCODE_AND:
+        core_restart(cpu, state);
+        first = cpu->insn_completed;
+        if (run_detailed(cpu, SAMPLE_WARMUP_INSNS))
+        {
+            cycle = cpu->clock;
+            start = cpu->insn_completed;
+            if (run_detailed(cpu, SAMPLE_UNIT_INSNS))
             {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
+                cpis[count++] = (double)(cpu->clock - cycle)
+                                / (cpu->insn_completed - start);
             }
+        }
+        *detailed += cpu->insn_completed - first;
+    }
 
-            case OPCODE_OR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+    fast_forward(dbt, state, LLONG_MAX);
+    APEX_cpu_stop(sys);
+    state->code_memory = NULL;
+    state->data_memory = NULL;
+    return count;
+}
 
-            case OPCODE_XOR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+/*
+ * Estimates the CPI of a program from systematic samples, as SMARTS does.
+ * A functional run first counts the instructions. Each pass then spreads
+ * its samples evenly over them, and when the confidence interval is wider
+ * than error percent of the mean, the coefficient of variation it measured
+ * gives the sample count for the next pass. Returns 0 on success.
+ */
+int
+APEX_sample_run(const char *filename, double error)
+{
+    DBT_Engine *dbt = malloc(sizeof(DBT_Engine));
+    double *cpis = NULL;
+    double mean = 0.0, deviation = 0.0, half = 0.0, reached = 0.0;
+    double start = host_seconds();
+    long long total, interval, detailed = 0, needed;
+    int limit, samples, count = 0, pass, i, status;
+    Func_State state;
+
+    if (!dbt || !dbt_init(dbt))
+    {
+        fprintf(stderr, "APEX_CPU: No binary translation on this host, fast-forwarding with the interpreter\n");
+        free(dbt);
+        dbt = NULL;
+    }
 
-            case OPCODE_LOAD:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+    if (sample_pass(filename, dbt, 0, 0, NULL, &state, &detailed) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+        free(dbt);
+        return 1;
+    }
 
-            case OPCODE_LOADP:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->regs[cpu->writeback.rs1] = cpu->writeback.rs1_value;
-                cpu->status[cpu->writeback.rd] = FREE;
-                cpu->status[cpu->writeback.rs1] = FREE;
-                break;
-            }
+    total = state.insn_count;
+    limit = total / (SAMPLE_WARMUP_INSNS + SAMPLE_UNIT_INSNS);
+    if (limit < 2)
+    {
+        fprintf(stderr, "APEX_Error: %s runs %lld instructions, too few to sample\n",
+                filename, total);
+        if (dbt)
+        {
+            dbt_free(dbt);
+        }
+        free(dbt);
+        return 1;
+    }
 
-            case OPCODE_STOREP:
-            {
-                cpu->regs[cpu->writeback.rs2] = cpu->writeback.rs2_value;
-                cpu->status[cpu->writeback.rs2] = FREE;
-                break;
-            }
+    cpis = malloc(limit * sizeof(double));
+    samples = (limit < SAMPLE_INITIAL_COUNT) ? limit : SAMPLE_INITIAL_COUNT;
 
-            case OPCODE_MOVC: 
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.result_buffer;
-                cpu->status[cpu->writeback.rd] = FREE;
-                break;
-            }
+    for (pass = 1; cpis && pass <= SAMPLE_MAX_PASSES; ++pass)
+    {
+        interval = total / samples;
+        count = sample_pass(filename, dbt, interval, samples, cpis, &state,
+                            &detailed);
 
-            case OPCODE_JALR:
-            {
-                cpu->regs[cpu->writeback.rd] = cpu->writeback.pc +4;
-                cpu->status[cpu->writeback.rd] = FREE;
-            }
-            case OPCODE_NOP:
-            {
-                break;
-            }
+        mean = deviation = 0.0;
+        for (i = 0; i < count; ++i)
+        {
+            mean += cpis[i];
+        }
+        mean = count ? mean / count : 0.0;
+        for (i = 0; i < count; ++i)
+        {
+            deviation += (cpis[i] - mean) * (cpis[i] - mean);
         }
+        deviation = (count > 1) ? sqrt(deviation / (count - 1)) : 0.0;
+        half = (count > 1) ? SAMPLE_CONFIDENCE_Z * deviation / sqrt(count) : 0.0;
+        reached = (mean > 0.0) ? 100.0 * half / mean : 0.0;
 
-        cpu->insn_completed++;
-        cpu->writeback.has_insn = FALSE;
+        printf("APEX_CPU: Sampling pass %d, samples = %d interval = %lld instructions CPI = %.3f +- %.3f (%.2f%%) coefficient of variation = %.3f\n",
+               pass, count, interval, mean, half, reached,
+               (mean > 0.0) ? deviation / mean : 0.0);
 
-        if (ENABLE_DEBUG_MESSAGES)
+        if (count < 2 || reached <= error || samples == limit)
         {
-            print_stage_content("Writeback", &cpu->writeback);
+            break;
         }
 
-        if (cpu->writeback.opcode == OPCODE_HALT)
+        /* n = (z V / error)^2 samples bring the interval down to error */
+        needed = (long long)ceil(pow(SAMPLE_CONFIDENCE_Z * deviation / mean
+                                     / (error / 100.0), 2));
+        if (needed <= samples)
         {
-            /* Stop the APEX simulator */
-            return TRUE;
+            needed = samples + 1;
         }
+        samples = (needed < limit) ? needed : limit;
+    }
 
-        
+    if (cpis)
+    {
+        func_print_state(&state);
+        printf("APEX_CPU: Sampled run Complete, instructions = %lld\n", total);
+        printf("APEX_CPU: Estimated CPI = %.3f +- %.3f (%.2f%%, target %.2f%%) at z = %.1f, cycles = %.0f\n",
+               mean, half, reached, error, SAMPLE_CONFIDENCE_Z, mean * total);
+        printf("APEX_CPU: Samples = %d of %d instructions after %d of warmup, detailed instructions = %lld over %d passes, host time = %.3f s\n",
+               count, SAMPLE_UNIT_INSNS, SAMPLE_WARMUP_INSNS, detailed,
+               pass > SAMPLE_MAX_PASSES ? SAMPLE_MAX_PASSES : pass,
+               host_seconds() - start);
+        if (reached > error && count > 1 && samples == limit)
+        {
+            printf("APEX_CPU: The program only has room for %d samples\n",
+                   limit);
+        }
+    }
+    else
+    {
+        fprintf(stderr, "APEX_Error: Unable to allocate the samples\n");
     }
 
-    /* Default */
-    return 0;
+    status = (cpis && count > 1) ? 0 : 1;
+    if (dbt)
+    {
+        dbt_free(dbt);
+    }
+    free(dbt);
+    free(cpis);
+    return status;
 }
 
 /*
- * This function creates and initializes APEX cpu.
- *
- * Note: You are free to edit this function according to your implementation
+ * Runs a program functionally, picks its simulation points and writes them
+ * to path. Returns 0 on success.
  */
-APEX_CPU *
-APEX_cpu_init(const char *filename)
+int
+APEX_simpoint_pick(const char *filename, const char *path)
 {
-    int i;
-    APEX_CPU *cpu;
+    Data_Memory *memory = calloc(1, sizeof(Data_Memory));
+    unsigned char *code = NULL;
+    Sim_Points points;
+    Func_State state;
+    int size, i, status = 1;
 
-    if (!filename)
+    if (memory)
     {
-        return NULL;
+        code = create_code_memory(filename, &size, memory);
     }
 
-    cpu = calloc(1, sizeof(APEX_CPU));
-
-    if (!cpu)
+    if (!code)
     {
-        return NULL;
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+    }
+    else
+    {
+        func_init(&state, code, size, memory);
+        if (!simpoint_analyze(&state, SIMPOINT_INTERVAL_INSNS, &points))
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for the phase analysis\n");
+        }
+        else if (!simpoint_write(&points, path, filename))
+        {
+            fprintf(stderr, "APEX_Error: Unable to write %s\n", path);
+        }
+        else
+        {
+            for (i = 0; i < points.count; ++i)
+            {
+                printf("APEX_CPU: Point %d interval = %d weight = %.3f\n", i,
+                       points.points[i].interval, points.points[i].weight);
+            }
+            printf("APEX_CPU: Phase analysis Complete, instructions = %lld, %d points written to %s\n",
+                   points.insns, points.count, path);
+            status = 0;
+        }
     }
 
-    /* Initialize PC, Registers and all pipeline stages */
-    cpu->pc = 4000;
-    memset(cpu->regs, 0, sizeof(int) * REG_FILE_SIZE);
-    memset(cpu->data_memory, 0, sizeof(int) * DATA_MEMORY_SIZE);
-    cpu->single_step = ENABLE_SINGLE_STEP;
+    free(code);
+    if (memory)
+    {
+        mem_free(memory);
+    }
+    free(memory);
+    return status;
+}
 
+/*
+ * Takes a checkpoint SIMPOINT_WARMUP_INSNS ahead of every point: the
+ * functional state and a copy of data memory there. A translated run gets
+ * to them all in one go. Returns FALSE if the program halts first.
+ */
+static int
+take_checkpoints(const char *filename, const Sim_Points *points,
+                 Func_State *states, Mem_Snapshot *snapshots)
+{
+    Data_Memory *memory = calloc(1, sizeof(Data_Memory));
+    DBT_Engine *dbt = malloc(sizeof(DBT_Engine));
+    unsigned char *code = NULL;
+    long long start;
+    int size, i, ok;
 
-    for (i = 0; i < REG_FILE_SIZE; i++)
+    if (!dbt || !dbt_init(dbt))
     {
-        cpu->status[i] = FREE;
+        fprintf(stderr, "APEX_CPU: No binary translation on this host, fast-forwarding with the interpreter\n");
+        free(dbt);
+        dbt = NULL;
     }
 
-    /* Parse input file and create code memory */
-    cpu->code_memory = create_code_memory(filename, &cpu->code_memory_size);
-    if (!cpu->code_memory)
+    if (memory)
     {
-        free(cpu);
-        return NULL;
+        code = create_code_memory(filename, &size, memory);
+    }
+    ok = code != NULL;
+    if (!ok)
+    {
+        fprintf(stderr, "APEX_Error: Unable to load %s\n", filename);
+    }
+    else
+    {
+        func_init(&states[0], code, size, memory);
     }
 
-    if (ENABLE_DEBUG_MESSAGES)
+    for (i = 0; ok && i < points->count; ++i)
     {
-        fprintf(stderr,
-                "APEX_CPU: Initialized APEX CPU, loaded %d instructions\n",
-                cpu->code_memory_size);
-        fprintf(stderr, "APEX_CPU: PC initialized to %d\n", cpu->pc);
-        fprintf(stderr, "APEX_CPU: Printing Code Memory\n");
-        printf("%-9s %-9s %-9s %-9s %-9s\n", "opcode_str", "rd", "rs1", "rs2",
-               "imm");
+        if (i)
+        {
+            states[i] = states[i - 1];
+        }
 
-        for (i = 0; i < cpu->code_memory_size; ++i)
+        start = (long long)points->points[i].interval * points->interval_insns
+                - SIMPOINT_WARMUP_INSNS;
+        start = (start > 0) ? start : 0;
+        fast_forward(dbt, &states[i], start - states[i].insn_count);
+        if (states[i].halted)
+        {
+            fprintf(stderr, "APEX_Error: Interval %d is past the end of %s\n",
+                    points->points[i].interval, filename);
+            ok = FALSE;
+        }
+        else if (!mem_snapshot(memory, &snapshots[i]))
         {
-            printf("%-9s %-9d %-9d %-9d %-9d\n", cpu->code_memory[i].opcode_str,
-                   cpu->code_memory[i].rd, cpu->code_memory[i].rs1,
-                   cpu->code_memory[i].rs2, cpu->code_memory[i].imm);
+            fprintf(stderr, "APEX_Error: Out of memory for checkpoints\n");
+            ok = FALSE;
         }
     }
 
-    /* To start fetch stage */
-    cpu->fetch.has_insn = TRUE;
-    return cpu;
+    if (dbt)
+    {
+        dbt_free(dbt);
+    }
+    free(dbt);
+    free(code);
+    if (memory)
+    {
+        mem_free(memory);
+    }
+    free(memory);
+    return ok;
 }
 
 /*
- * APEX CPU simulation loop
- *
- * Note: You are free to edit this function according to your implementation
+ * Runs the simulation points of a program in detail, each on a new core
+ * from its checkpoint, and weighs their CPIs into one for the whole run.
+ * Returns 0 on success.
  */
-void
-APEX_cpu_run(APEX_CPU *cpu)
+int
+APEX_simpoint_run(const char *filename, const char *path)
 {
-    char user_prompt_val;
+    Func_State states[SIMPOINT_MAX_K];
+    Mem_Snapshot snapshots[SIMPOINT_MAX_K];
+    Sim_Points points;
+    APEX_System *sys;
+    APEX_CPU *cpu;
+    double start = host_seconds(), cpi = 0.0, weights = 0.0, point_cpi;
+    long long detailed = 0;
+    int i, cycle, first, insns, status = 1;
 
-    while (TRUE)
+    if (!simpoint_read(&points, path))
     {
-        if (ENABLE_DEBUG_MESSAGES)
-        {
-            printf("--------------------------------------------\n");
-            printf("Clock Cycle #: %d\n", cpu->clock);
-            printf("--------------------------------------------\n");
-        }
+        fprintf(stderr, "APEX_Error: Unable to read simulation points from %s\n",
+                path);
+        return 1;
+    }
 
-        if (APEX_writeback(cpu))
+    memset(snapshots, 0, sizeof(snapshots));
+    if (take_checkpoints(filename, &points, states, snapshots))
+    {
+        status = 0;
+    }
+
+    for (i = 0; !status && i < points.count; ++i)
+    {
+        sys = APEX_cpu_init(&filename, 1, 1, 0);
+        if (!sys)
         {
-            /* Halt in writeback stage */
-            printf("APEX_CPU: Simulation Complete, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
+            fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
+            status = 1;
             break;
         }
 
-        APEX_memory(cpu);
-        APEX_execute(cpu);
-        APEX_decode(cpu);
-        APEX_fetch(cpu);
-
-        print_reg_file(cpu);
-
-        if (cpu->single_step)
+        cpu = sys->cores[0];
+        mem_restore(&sys->data_memory, &snapshots[i]);
+        core_restart(cpu, &states[i]);
+        first = cpu->insn_completed;
+        cycle = cpu->clock;
+        insns = 0;
+        if (run_detailed(cpu, (int)((long long)points.points[i].interval
+                                    * points.interval_insns
+                                    - states[i].insn_count)))
         {
-            printf("Press any key to advance CPU Clock or <q> to quit:\n");
-            scanf("%c", &user_prompt_val);
-
-            if ((user_prompt_val == 'Q') || (user_prompt_val == 'q'))
-            {
-                printf("APEX_CPU: Simulation Stopped, cycles = %d instructions = %d\n", cpu->clock, cpu->insn_completed);
-                break;
-            }
+            cycle = cpu->clock;
+            insns = cpu->insn_completed;
+            run_detailed(cpu, points.interval_insns);
+            insns = cpu->insn_completed - insns;
         }
+        detailed += cpu->insn_completed - first;
+
+        point_cpi = insns ? (double)(cpu->clock - cycle) / insns : 0.0;
+        cpi += points.points[i].weight * point_cpi;
+        weights += points.points[i].weight;
+        printf("APEX_CPU: Point %d interval = %d weight = %.3f instructions = %d cycles = %d CPI = %.3f\n",
+               i, points.points[i].interval, points.points[i].weight, insns,
+               cpu->clock - cycle, point_cpi);
+        APEX_cpu_stop(sys);
+    }
 
-        cpu->clock++;
+    if (!status)
+    {
+        cpi = (weights > 0.0) ? cpi / weights : 0.0;
+        printf("APEX_CPU: Simulation points Complete, instructions = %lld\n",
+               points.insns);
+        printf("APEX_CPU: Estimated CPI = %.3f cycles = %.0f from %d points of %d instructions\n",
+               cpi, cpi * points.insns, points.count, points.interval_insns);
+        printf("APEX_CPU: Detailed instructions = %lld (%.2f%% of the run) host time = %.3f s\n",
+               detailed, 100.0 * detailed / points.insns,
+               host_seconds() - start);
     }
-}
 
-/*
- * This function deallocates APEX CPU.
- *
- * Note: You are free to edit this function according to your implementation
- */
-void
-APEX_cpu_stop(APEX_CPU *cpu)
-{
-    free(cpu->code_memory);
-    free(cpu);
-}
\ No newline at end of file
+    for (i = 0; i < points.count; ++i)
+    {
+        mem_snapshot_free(&snapshots[i]);
+    }
+    return status;
+}
@@ -9,71 +9,252 @@
 #ifndef _APEX_CPU_H_
 #define _APEX_CPU_H_
 
-#include "apex_macros.h"
+#include <pthread.h>
 
-/* Format of an APEX instruction  */
-typedef struct APEX_Instruction
-{
-    char opcode_str[128];
-    int opcode;
-    int rd;
-    int rs1;
-    int rs2;
-    int imm;
-} APEX_Instruction;
+#include "apex_macros.h"
+#include "apex_cache.h"
+#include "apex_prefetch.h"
+#include "apex_lvp.h"
+#include "apex_mem.h"
+#include "apex_bus.h"
+#include "apex_tlb.h"
+#include "apex_dma.h"
+#include "apex_vector.h"
+#include "apex_isa.h"
+#include "apex_func.h"
 
 enum RegStatus
 {   FREE,
     BUSY
 };
 
+/* What fetching an instruction did to the innermost hardware loop */
+enum LoopUpdate
+{   LOOP_NONE,
+    LOOP_BACK,                     /* Last body instruction, went to start */
+    LOOP_DONE                      /* Last instruction of the last iteration */
+};
+
+enum LoopBufferState
+{   LB_IDLE,
+    LB_CAPTURE,                    /* Filling in the body as Fetch reads it */
+    LB_ACTIVE                      /* Fetch replays the body from the buffer */
+};
+
+/* Small buffer holding the encoded body of one tight loop */
+typedef struct Loop_Buffer
+{
+    enum LoopBufferState state;
+    int start;                     /* PC of the branch target */
+    int end;                       /* PC of the backward branch */
+    int length;                    /* Bytes held, up to the end of the branch */
+    unsigned char code[LOOP_BUFFER_SIZE * 4];
+    int captures;                  /* Loops captured */
+    int hits;                      /* Fetches served by the buffer */
+} Loop_Buffer;
 
 /* Model of CPU stage latch */
 typedef struct CPU_Stage
 {
+    int thread;                    /* Hardware thread the instruction belongs to */
     int pc;
+    unsigned long long insn;       /* Encoding read by Fetch */
+    int size;                      /* Bytes the encoding takes */
     char opcode_str[128];
     int opcode;
     int rs1;
     int rs2;
     int rd;
     int imm;
+    int literal;
     int rs1_value;
     int rs2_value;
+    int rd_value;                  /* Old rd, read by MAC and CMOVs */
     int result_buffer;
+    int vs1_value[VECTOR_LENGTH];
+    int vs2_value[VECTOR_LENGTH];
+    int vector_result[VECTOR_LENGTH];
     int memory_address;
+    int mshr_pending;              /* Load result will be written by an MSHR */
+    int translated;                /* Address already went through the D-TLB */
+    int spm_ready_cycle;           /* Cycle a scratchpad access completes */
+    int fu_ready_cycle;            /* Cycle a multi-cycle operation completes */
+    enum LoopUpdate loop_update;   /* Undone if this instruction is squashed */
+    int fused;                     /* Carries the branch that followed a compare */
+    int fused_opcode;
+    int fused_imm;
+    int value_predicted;           /* Load handed predicted_value to Decode */
+    int predicted_value;
+    int verify_cycle;              /* Cycle a predicted value is confirmed */
+    int value_verified;            /* rd already holds the confirmed value */
+    int runahead;                  /* Executed past a miss, never retires */
+    int invalid;                   /* Runahead result has no real value */
     int has_insn;
 } CPU_Stage;
 
-/* Model of APEX CPU */
-typedef struct APEX_CPU
+/* Checkpoint taken when a thread enters runahead, and the validity of the
+ * registers while it runs ahead */
+typedef struct Runahead
+{
+    int active;
+    int pc;                        /* Blocked instruction, fetched again */
+    enum LoopUpdate loop_update;   /* Loop progress made by fetching it */
+    int entry_cycle;
+    int exit_cycle;                /* Last miss it waits on is filled */
+    int regs[REG_FILE_SIZE];
+    enum RegStatus status[REG_FILE_SIZE];
+    int zero_flag;
+    int positive_flag;
+    int negative_flag;
+    HW_Loop loop_stack[HW_LOOP_DEPTH];
+    int loop_depth;
+    int inv[REG_FILE_SIZE];        /* Register holds no real value */
+    int flags_inv;
+} Runahead;
+
+/* Architectural state of a hardware thread, and the front end state that
+ * follows its instruction stream */
+typedef struct APEX_Thread
 {
     int pc;                        /* Current program counter */
-    int clock;                     /* Clock cycles elapsed */
-    int insn_completed;            /* Instructions retired */
     int regs[REG_FILE_SIZE];       /* Integer register file */
-    int code_memory_size;          /* Number of instruction in the input file */
-    APEX_Instruction *code_memory; /* Code Memory */
-    int data_memory[DATA_MEMORY_SIZE]; /* Data Memory */
-    int single_step;               /* Wait for user input after every cycle */
-    int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
-    int fetch_from_next_cycle;
-    int stall;
     enum RegStatus status[REG_FILE_SIZE];
+    int zero_flag;                 /* {TRUE, FALSE} Used by BZ and BNZ to branch */
     int positive_flag;
     int negative_flag;
+    int vregs[VECTOR_REG_FILE_SIZE][VECTOR_LENGTH]; /* Vector register file */
+    enum RegStatus vstatus[VECTOR_REG_FILE_SIZE];
+    int code_memory_size;          /* Bytes of encoded instructions */
+    unsigned char *code_memory;    /* Code Memory */
+    int fetching;                  /* Cleared once HALT has been fetched */
+    int fetch_from_next_cycle;
+    int itlb_pc;                   /* PC the I-TLB mapped for Fetch, 0 for none */
+    HW_Loop loop_stack[HW_LOOP_DEPTH]; /* Active hardware loops, innermost last */
+    int loop_depth;
+    Loop_Buffer loop_buffer;
+    CPU_Stage decode;              /* Decode latch, one per thread */
+    Runahead runahead;
+    int predicted[REG_FILE_SIZE];  /* Holds a load value not yet checked */
+    int first_use[REG_FILE_SIZE];  /* Cycle a dependent first read it */
+    int insn_completed;            /* Instructions retired */
+    int halted;                    /* HALT has retired */
+    int halt_cycle;
+} APEX_Thread;
+
+/* Model of APEX CPU */
+typedef struct APEX_CPU
+{
+    int core;                      /* Position among the cores */
+    int clock;                     /* Clock cycles elapsed */
+    int insn_completed;            /* Instructions retired by all threads */
+    APEX_Thread threads[SMT_MAX_THREADS];
+    int num_threads;
+    int fetch_thread;              /* Thread that fetched last */
+    int issue_thread;              /* Thread that last left Decode */
+    int halted_threads;            /* Threads whose HALT has retired */
+    Data_Memory *data_memory;      /* Data Memory, shared by all cores */
+    Mem_Log mem_log;               /* Stores not yet in data memory */
+    Memory_Bus *bus;               /* Bus to memory, NULL for a single core */
+    int hold_stores;               /* Stores go to mem_log, not data memory */
+    int halted;                    /* Last HALT of the core has retired */
+    int bus_stall;                 /* Cycles owed to waits on a busy bus */
+    int stall;
+    int vector_insns;              /* Vector instructions retired */
+    DCache dcache;                 /* Data cache tag store */
+    MSHR mshr[NUM_MSHRS];          /* Outstanding data cache misses */
+    /* Lines filled this cycle that other cores asked for while they were
+     * in flight, snooped once Memory has had the cycle to use them */
+    int snoop_lines[NUM_MSHRS];
+    enum Bus_Request snoop_requests[NUM_MSHRS];
+    int num_snoops;
+    Store_Buffer store_buffer;     /* Retired stores waiting for the cache */
+    int dcache_busy;               /* Memory stage used the cache this cycle */
+    Prefetcher prefetcher;         /* Stride prefetcher and stream buffer */
+    Value_Predictor lvp;           /* Load value predictor */
+    TLB dtlb;                      /* Data TLB, used by Memory */
+    TLB itlb;                      /* Instruction TLB, used by Fetch */
+    int walk_accesses;             /* Page table entries read by walks */
+    int walk_cache_misses;         /* Of which missed in the data cache */
+    int sw_prefetches;             /* PREFETCH instructions sent to memory */
+    int sw_prefetch_redundant;     /* PREFETCH of a present or in-flight line */
+    int sw_prefetch_dropped;       /* PREFETCH that found no free MSHR */
+    int sw_prefetch_late;          /* Demand misses caught a PREFETCH in flight */
+    DMA_Engine dma;                /* Background block copies started by COPY */
+    int spm_accesses;              /* Loads and stores served by the scratchpad */
+
+    int fu_stall_cycles;           /* Cycles Execute spent in a multiplier */
+    int mac_shadd_insns;           /* MAC and SHADD instructions retired */
+    int branch_flushes;            /* Taken branches and jumps */
+    int cmov_insns;                /* Conditional moves retired */
+    int fused_pairs;               /* Compare and branch pairs fused in Decode */
+    int loop_backs;                /* Iterations started by Fetch */
+    int loop_branch_exits;         /* Loops left early through a taken branch */
+    int fetches;                   /* Instructions sent down by Fetch */
+    int fetch_bytes;               /* Bytes of those instructions */
+    int runahead_periods;          /* Times a thread entered runahead */
+    int runahead_cycles;
+    int runahead_insns;            /* Instructions executed in runahead */
+    int runahead_prefetches;       /* Misses runahead sent to memory */
+    int runahead_late;             /* Demand misses that caught one in flight */
+    int runahead_hidden;           /* Miss cycles those late ones saved */
+
+    /* Memory system statistics */
+    int mem_stall_cycles;          /* Cycles Memory stage could not advance */
+    int mshr_full_stalls;          /* Cycles a miss found no MSHR or target */
+    int mshr_merges;               /* Loads merged into an in-flight MSHR */
+    int hits_under_miss;           /* Load hits while a miss was outstanding */
 
     /* Pipeline stages */
     CPU_Stage fetch;
-    CPU_Stage decode;
     CPU_Stage execute;
     CPU_Stage memory;
     CPU_Stage writeback;
 } APEX_CPU;
 
+/* Host thread stepping one core */
+typedef struct Host_Thread
+{
+    struct APEX_System *sys;
+    int core;
+    pthread_t id;
+} Host_Thread;
+
+/*
+ * Cores sharing data memory and the bus. They run quantum cycles at a time,
+ * each on its own host thread in parallel mode. Between quanta the bus
+ * grants their misses cycle by cycle, or replays them after a longer
+ * quantum, and their stores reach data memory.
+ */
+typedef struct APEX_System
+{
+    int clock;                     /* First cycle of the current quantum */
+    APEX_CPU *cores[MAX_CORES];
+    int num_cores;
+    int halted_cores;
+    Data_Memory data_memory;
+    Memory_Bus bus;
+    int quantum;
+    int parallel;                  /* One host thread per core */
+    Host_Thread threads[MAX_CORES];
+    pthread_barrier_t start;       /* Threads wait here for the next quantum */
+    pthread_barrier_t done;        /* and here for each other to finish it */
+    int running;
+    double wall_seconds;           /* Host time of the run */
+    double step_seconds[MAX_CORES]; /* Host time spent stepping each core */
+    double serial_seconds;         /* Host time of the run on one host thread */
+    const char *const *filenames;  /* Programs, to repeat the run */
+    int num_files;
+    int single_step;               /* Wait for user input after every quantum */
+} APEX_System;
 
-APEX_Instruction *create_code_memory(const char *filename, int *size);
-APEX_CPU *APEX_cpu_init(const char *filename);
-void APEX_cpu_run(APEX_CPU *cpu);
-void APEX_cpu_stop(APEX_CPU *cpu);
+unsigned char *create_code_memory(const char *filename, int *size,
+                                  Data_Memory *data_memory);
+APEX_System *APEX_cpu_init(const char *const *filenames, int num_files,
+                           int num_cores, int quantum);
+void APEX_cpu_run(APEX_System *sys);
+void APEX_cpu_stop(APEX_System *sys);
+int APEX_func_run(const char *filename, const char *engine);
+int APEX_sample_run(const char *filename, double error);
+int APEX_simpoint_pick(const char *filename, const char *path);
+int APEX_simpoint_run(const char *filename, const char *path);
 #endif
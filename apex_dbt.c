@@ -0,0 +1,813 @@
+/*
+ * apex_dbt.c
+ * Contains the APEX dynamic binary translator, which turns the basic
+ * blocks of a functional run into x86-64 code
+ *
+ * A block is translated the first time the dispatcher reaches its PC and
+ * kept in the code cache. The state of the run stays in its Func_State,
+ * whose address translated code holds in rbx, and every APEX register is
+ * read from and written back to it. Memory accesses and the less common
+ * operations call back into C. A block leaves through an exit that stores
+ * the next PC and returns to the dispatcher. Exits to a known PC are then
+ * patched to jump straight to the block there, so loops run without
+ * coming back to C until their instruction budget runs out.
+ *
+ * Code memory never changes during a run, so blocks are only thrown away
+ * when the cache fills up or dbt_flush is called for a new program.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "apex_dbt.h"
+#include "apex_isa.h"
+#include "apex_macros.h"
+
+/* Host registers by encoding, rbx holds the Func_State */
+#define EAX 0
+#define ECX 1
+#define EDX 2
+#define ESI 6
+
+/* Entry and exit code at the start of the cache */
+#define ENTER_OFFSET 0
+#define LEAVE_OFFSET 6
+
+/* Room a translated instruction, and the exits that end a block, can take */
+#define MAX_INSN_BYTES 64
+#define MAX_EXIT_BYTES 256
+
+#define FIELD(name) ((int)offsetof(Func_State, name))
+#define REG(r) (FIELD(regs) + (r) * (int)sizeof(int))
+
+/* Why translated code returned to the dispatcher */
+enum DBT_Exit
+{   EXIT_CHAIN,                    /* Next PC is known, the exit can be chained */
+    EXIT_BRANCH,                   /* Taken branch, may leave hardware loops */
+    EXIT_LOOP_DONE,                /* Innermost hardware loop ran its count */
+    EXIT_HALT,
+    EXIT_BUDGET                    /* Block has more instructions than allowed */
+};
+
+typedef void (*Enter_Code)(Func_State *state, unsigned char *code);
+
+static int
+load_word(Func_State *state, int address)
+{
+    return mem_read(state->data_memory, address);
+}
+
+static void
+store_word(Func_State *state, int address, int value)
+{
+    mem_write(state->data_memory, address, value);
+}
+
+static void
+emit(DBT_Engine *dbt, int byte)
+{
+    dbt->cache[dbt->cache_used++] = (unsigned char)byte;
+}
+
+static void
+emit32(DBT_Engine *dbt, int value)
+{
+    memcpy(dbt->cache + dbt->cache_used, &value, sizeof(value));
+    dbt->cache_used += sizeof(value);
+}
+
+static void
+emit64(DBT_Engine *dbt, uint64_t value)
+{
+    memcpy(dbt->cache + dbt->cache_used, &value, sizeof(value));
+    dbt->cache_used += sizeof(value);
+}
+
+/* Emits an instruction whose memory operand is [rbx + offset], opcodes
+ * above 0xff take two bytes */
+static void
+emit_field(DBT_Engine *dbt, int opcode, int reg, int offset)
+{
+    if (opcode > 0xff)
+    {
+        emit(dbt, opcode >> 8);
+    }
+    emit(dbt, opcode & 0xff);
+    emit(dbt, 0x83 | reg << 3);
+    emit32(dbt, offset);
+}
+
+/* Emits a jump or conditional jump with a 32-bit displacement, and
+ * returns where the displacement is so it can be set later */
+static int
+emit_jump(DBT_Engine *dbt, int condition)
+{
+    if (condition)
+    {
+        emit(dbt, 0x0f);
+        emit(dbt, condition);
+    }
+    else
+    {
+        emit(dbt, 0xe9);
+    }
+    emit32(dbt, 0);
+    return dbt->cache_used - 4;
+}
+
+/* Points the jump whose displacement is at site to target */
+static void
+patch_jump(unsigned char *site, const unsigned char *target)
+{
+    int displacement = (int)(target - (site + 4));
+
+    memcpy(site, &displacement, sizeof(displacement));
+}
+
+/* Calls a C function with the Func_State as its first argument */
+static void
+emit_call(DBT_Engine *dbt, uint64_t function)
+{
+    emit(dbt, 0x48);               /* mov rdi, rbx */
+    emit(dbt, 0x89);
+    emit(dbt, 0xdf);
+    emit(dbt, 0x48);               /* mov rax, function */
+    emit(dbt, 0xb8);
+    emit64(dbt, function);
+    emit(dbt, 0xff);               /* call rax */
+    emit(dbt, 0xd0);
+}
+
+/* Sets the flags from the result in eax */
+static void
+emit_flags(DBT_Engine *dbt)
+{
+    static const int conditions[3] = {0x94, 0x9f, 0x9c}; /* sete, setg, setl */
+    static const int fields[3] = {FIELD(zero_flag), FIELD(positive_flag),
+                                  FIELD(negative_flag)};
+    int i;
+
+    emit(dbt, 0x31);               /* xor ecx, ecx */
+    emit(dbt, 0xc9);
+    emit(dbt, 0x85);               /* test eax, eax */
+    emit(dbt, 0xc0);
+    for (i = 0; i < 3; ++i)
+    {
+        emit(dbt, 0x0f);           /* setcc cl */
+        emit(dbt, conditions[i]);
+        emit(dbt, 0xc1);
+        emit_field(dbt, 0x89, ECX, fields[i]);
+    }
+}
+
+/*
+ * Leaves the block for target. A chainable exit also leaves the address of
+ * its jump, which the dispatcher points at the target block once that is
+ * translated.
+ */
+static void
+emit_exit(DBT_Engine *dbt, int target, enum DBT_Exit reason)
+{
+    int site;
+
+    emit_field(dbt, 0xc7, 0, FIELD(pc));
+    emit32(dbt, target);
+    emit_field(dbt, 0xc7, 0, FIELD(exit));
+    emit32(dbt, reason);
+    if (reason == EXIT_CHAIN)
+    {
+        /* mov rax, site then mov [rbx + chain], rax, the jump follows */
+        emit(dbt, 0x48);
+        emit(dbt, 0xb8);
+        emit64(dbt, (uint64_t)(uintptr_t)(dbt->cache + dbt->cache_used + 8 + 7 + 1));
+        emit(dbt, 0x48);
+        emit_field(dbt, 0x89, EAX, FIELD(chain));
+    }
+    site = emit_jump(dbt, 0);
+    patch_jump(dbt->cache + site, dbt->cache + LEAVE_OFFSET);
+}
+
+/* Goes on to the next instruction. Past the end of the innermost loop body
+ * that is its start again, until the loop has run its count */
+static void
+emit_next(DBT_Engine *dbt, const DBT_Block *block, int next_pc)
+{
+    int done;
+
+    if (!block->loop_depth || next_pc != block->loop_end)
+    {
+        emit_exit(dbt, next_pc, EXIT_CHAIN);
+        return;
+    }
+
+    emit_field(dbt, 0x83, 5, FIELD(loop_stack[block->loop_depth - 1].remaining));
+    emit(dbt, 1);                  /* sub dword [remaining], 1 */
+    done = emit_jump(dbt, 0x84);
+    emit_exit(dbt, block->loop_start, EXIT_CHAIN);
+    patch_jump(dbt->cache + done, dbt->cache + dbt->cache_used);
+    emit_exit(dbt, next_pc, EXIT_LOOP_DONE);
+}
+
+/* Takes a branch, a target outside the innermost loop body leaves it */
+static void
+emit_branch(DBT_Engine *dbt, const DBT_Block *block, int target)
+{
+    if (!block->loop_depth
+        || (target >= block->loop_start && target < block->loop_end))
+    {
+        emit_exit(dbt, target, EXIT_CHAIN);
+        return;
+    }
+
+    emit_exit(dbt, target, EXIT_BRANCH);
+}
+
+/* Returns TRUE for the instructions that read the flags */
+static int
+reads_flags(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        case OPCODE_CMOVZ:
+        case OPCODE_CMOVNZ:
+        case OPCODE_CMOVP:
+        case OPCODE_CMOVN:
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Returns TRUE for the instructions that end a block */
+static int
+ends_block(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_HALT:
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        case OPCODE_BEQ:
+        case OPCODE_BNE:
+        case OPCODE_BLT:
+        case OPCODE_BGE:
+        case OPCODE_BEQL:
+        case OPCODE_BNEL:
+        case OPCODE_BLTL:
+        case OPCODE_BGEL:
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Translates an instruction that does not change control flow. Flags are
+ * only written when a later instruction can see them */
+static void
+translate_operation(DBT_Engine *dbt, const APEX_Instruction *ins,
+                    int set_flags)
+{
+    int alu;
+
+    switch (ins->opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_CMP:
+        {
+            alu = (ins->opcode == OPCODE_ADD) ? 0x03
+                  : (ins->opcode == OPCODE_MUL) ? 0x0faf
+                  : (ins->opcode == OPCODE_AND) ? 0x23
+                  : (ins->opcode == OPCODE_OR) ? 0x0b
+                  : (ins->opcode == OPCODE_XOR) ? 0x33 : 0x2b;
+            if (ins->opcode == OPCODE_CMP && !set_flags)
+            {
+                return;
+            }
+            emit_field(dbt, 0x8b, EAX, REG(ins->rs1));
+            emit_field(dbt, alu, EAX, REG(ins->rs2));
+            break;
+        }
+
+        case OPCODE_ADDL:
+        case OPCODE_SUBL:
+        case OPCODE_CML:
+        {
+            if (ins->opcode == OPCODE_CML && !set_flags)
+            {
+                return;
+            }
+            emit_field(dbt, 0x8b, EAX, REG(ins->rs1));
+            emit(dbt, (ins->opcode == OPCODE_ADDL) ? 0x05 : 0x2d);
+            emit32(dbt, ins->imm);
+            break;
+        }
+
+        case OPCODE_MAC:
+        {
+            emit_field(dbt, 0x8b, EAX, REG(ins->rs1));
+            emit_field(dbt, 0x0faf, EAX, REG(ins->rs2));
+            emit_field(dbt, 0x03, EAX, REG(ins->rd));
+            break;
+        }
+
+        case OPCODE_SHADD:
+        {
+            emit_field(dbt, 0x8b, EAX, REG(ins->rs2));
+            emit(dbt, 0xc1);       /* shl eax, imm */
+            emit(dbt, 0xe0);
+            emit(dbt, ins->imm & 31);
+            emit_field(dbt, 0x03, EAX, REG(ins->rs1));
+            break;
+        }
+
+        case OPCODE_MOVC:
+        {
+            emit_field(dbt, 0xc7, 0, REG(ins->rd));
+            emit32(dbt, ins->imm);
+            return;
+        }
+
+        /* rd keeps its value unless the flag asks for rs1 */
+        case OPCODE_CMOVZ:
+        case OPCODE_CMOVNZ:
+        case OPCODE_CMOVP:
+        case OPCODE_CMOVN:
+        {
+            emit_field(dbt, 0x8b, EAX, REG(ins->rd));
+            emit_field(dbt, 0x8b, ECX, REG(ins->rs1));
+            emit_field(dbt, 0x83, 7,
+                       (ins->opcode == OPCODE_CMOVP) ? FIELD(positive_flag)
+                       : (ins->opcode == OPCODE_CMOVN) ? FIELD(negative_flag)
+                       : FIELD(zero_flag));
+            emit(dbt, 0);
+            emit(dbt, 0x0f);       /* cmovne or cmove eax, ecx */
+            emit(dbt, (ins->opcode == OPCODE_CMOVNZ) ? 0x44 : 0x45);
+            emit(dbt, 0xc1);
+            emit_field(dbt, 0x89, EAX, REG(ins->rd));
+            return;
+        }
+
+        case OPCODE_LOAD:
+        case OPCODE_LOADP:
+        {
+            /* The pointer update has to win when it is also rd */
+            if (ins->opcode == OPCODE_LOADP && ins->rd == ins->rs1)
+            {
+                break;
+            }
+            emit_field(dbt, 0x8b, ESI, REG(ins->rs1));
+            emit(dbt, 0x81);       /* add esi, imm */
+            emit(dbt, 0xc6);
+            emit32(dbt, ins->imm);
+            emit_call(dbt, (uint64_t)(uintptr_t)load_word);
+            emit_field(dbt, 0x89, EAX, REG(ins->rd));
+            if (ins->opcode == OPCODE_LOADP)
+            {
+                emit_field(dbt, 0x83, 0, REG(ins->rs1));
+                emit(dbt, 4);      /* add dword [rs1], 4 */
+            }
+            return;
+        }
+
+        case OPCODE_STORE:
+        case OPCODE_STOREP:
+        {
+            emit_field(dbt, 0x8b, ESI, REG(ins->rs2));
+            emit(dbt, 0x81);
+            emit(dbt, 0xc6);
+            emit32(dbt, ins->imm);
+            emit_field(dbt, 0x8b, EDX, REG(ins->rs1));
+            emit_call(dbt, (uint64_t)(uintptr_t)store_word);
+            if (ins->opcode == OPCODE_STOREP)
+            {
+                emit_field(dbt, 0x83, 0, REG(ins->rs2));
+                emit(dbt, 4);
+            }
+            return;
+        }
+
+        case OPCODE_NOP:
+        case OPCODE_DIV:
+        case OPCODE_PREFETCH:
+        case OPCODE_DMAWAIT:
+        {
+            return;
+        }
+
+        default:
+        {
+            break;
+        }
+    }
+
+    /* Everything else, such as the vector unit and COPY, goes through the
+     * interpreter's own code */
+    if (!func_sets_flags(ins->opcode))
+    {
+        emit(dbt, 0xbe);           /* mov esi, opcode */
+        emit32(dbt, ins->opcode);
+        emit(dbt, 0xba);           /* mov edx, rd */
+        emit32(dbt, ins->rd);
+        emit(dbt, 0xb9);           /* mov ecx, rs1 */
+        emit32(dbt, ins->rs1);
+        emit(dbt, 0x41);           /* mov r8d, rs2 */
+        emit(dbt, 0xb8);
+        emit32(dbt, ins->rs2);
+        emit(dbt, 0x41);           /* mov r9d, imm */
+        emit(dbt, 0xb9);
+        emit32(dbt, ins->imm);
+        emit_call(dbt, (uint64_t)(uintptr_t)func_operate);
+        return;
+    }
+
+    if (ins->opcode != OPCODE_CMP && ins->opcode != OPCODE_CML)
+    {
+        emit_field(dbt, 0x89, EAX, REG(ins->rd));
+    }
+    if (set_flags)
+    {
+        emit_flags(dbt);
+    }
+}
+
+/* Translates the instruction that ends a block */
+static void
+translate_control(DBT_Engine *dbt, const DBT_Block *block,
+                  const APEX_Instruction *ins, int pc, int next_pc)
+{
+    int taken, condition, flag;
+
+    switch (ins->opcode)
+    {
+        case OPCODE_HALT:
+        {
+            emit_field(dbt, 0xc7, 0, FIELD(halted));
+            emit32(dbt, TRUE);
+            emit_exit(dbt, pc, EXIT_HALT);
+            return;
+        }
+
+        /* The target is computed before JALR overwrites rd */
+        case OPCODE_JUMP:
+        case OPCODE_JALR:
+        {
+            emit_field(dbt, 0x8b, EAX, REG(ins->rs1));
+            emit(dbt, 0x05);
+            emit32(dbt, ins->imm);
+            if (ins->opcode == OPCODE_JALR)
+            {
+                emit_field(dbt, 0xc7, 0, REG(ins->rd));
+                emit32(dbt, next_pc);
+            }
+            emit_field(dbt, 0x89, EAX, FIELD(pc));
+            emit_field(dbt, 0xc7, 0, FIELD(exit));
+            emit32(dbt, EXIT_BRANCH);
+            taken = emit_jump(dbt, 0);
+            patch_jump(dbt->cache + taken, dbt->cache + LEAVE_OFFSET);
+            return;
+        }
+
+        /* Flag branches: cmp dword [flag], 0 then jne when the flag has to
+         * be set, je when it has to be clear */
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            flag = (ins->opcode == OPCODE_BZ || ins->opcode == OPCODE_BNZ)
+                   ? FIELD(zero_flag)
+                   : (ins->opcode == OPCODE_BP || ins->opcode == OPCODE_BNP)
+                   ? FIELD(positive_flag) : FIELD(negative_flag);
+            emit_field(dbt, 0x83, 7, flag);
+            emit(dbt, 0);
+            condition = (ins->opcode == OPCODE_BZ || ins->opcode == OPCODE_BP
+                         || ins->opcode == OPCODE_BN) ? 0x85 : 0x84;
+            break;
+        }
+
+        default:
+        {
+            emit_field(dbt, 0x8b, EAX, REG(ins->rs1));
+            if (ins->opcode >= OPCODE_BEQL)
+            {
+                emit(dbt, 0x3d);   /* cmp eax, literal */
+                emit32(dbt, ins->literal);
+            }
+            else
+            {
+                emit_field(dbt, 0x3b, EAX, REG(ins->rs2));
+            }
+            switch (ins->opcode)
+            {
+                case OPCODE_BEQ:
+                case OPCODE_BEQL:
+                    condition = 0x84;
+                    break;
+                case OPCODE_BNE:
+                case OPCODE_BNEL:
+                    condition = 0x85;
+                    break;
+                case OPCODE_BLT:
+                case OPCODE_BLTL:
+                    condition = 0x8c;
+                    break;
+                default:
+                    condition = 0x8d;
+                    break;
+            }
+            break;
+        }
+    }
+
+    taken = emit_jump(dbt, condition);
+    emit_next(dbt, block, next_pc);
+    patch_jump(dbt->cache + taken, dbt->cache + dbt->cache_used);
+    emit_branch(dbt, block, pc + ins->imm);
+}
+
+/* Hashes a PC and the hardware loop around it */
+static unsigned int
+block_hash(int pc, int loop_depth, int loop_end)
+{
+    return ((unsigned int)pc * 2654435761u ^ (unsigned int)loop_end * 40503u
+            ^ (unsigned int)loop_depth) & (DBT_TABLE_SIZE - 1);
+}
+
+/* Finds the block for the state's PC and loop, NULL if not translated */
+static DBT_Block *
+find_block(DBT_Engine *dbt, const Func_State *state, unsigned int *slot)
+{
+    const HW_Loop *loop = state->loop_depth
+                          ? &state->loop_stack[state->loop_depth - 1] : NULL;
+    int start = loop ? loop->start : 0, end = loop ? loop->end : 0;
+    DBT_Block *block;
+
+    *slot = block_hash(state->pc, state->loop_depth, end);
+    while (dbt->table[*slot])
+    {
+        block = &dbt->blocks[dbt->table[*slot] - 1];
+        if (block->pc == state->pc && block->loop_depth == state->loop_depth
+            && block->loop_start == start && block->loop_end == end)
+        {
+            return block;
+        }
+        *slot = (*slot + 1) & (DBT_TABLE_SIZE - 1);
+    }
+
+    return NULL;
+}
+
+/*
+ * Translates the block at the state's PC. It runs to the first branch,
+ * JUMP/JALR or HALT, or to the end of the innermost loop body, and stops
+ * short of a LOOP, which the interpreter sets up. On entry it checks that
+ * the run may still take all of its instructions.
+ */
+static DBT_Block *
+translate(DBT_Engine *dbt, const Func_State *state)
+{
+    APEX_Instruction ins[DBT_MAX_BLOCK_INSNS];
+    int pcs[DBT_MAX_BLOCK_INSNS + 1], set_flags[DBT_MAX_BLOCK_INSNS];
+    DBT_Block *block;
+    unsigned int slot;
+    int i, n, size, live, budget;
+
+    if (dbt->num_blocks == DBT_MAX_BLOCKS
+        || dbt->cache_used + DBT_MAX_BLOCK_INSNS * MAX_INSN_BYTES
+           + MAX_EXIT_BYTES > DBT_CACHE_SIZE)
+    {
+        dbt_flush(dbt);
+    }
+    find_block(dbt, state, &slot);
+
+    block = &dbt->blocks[dbt->num_blocks];
+    dbt->table[slot] = ++dbt->num_blocks;
+    block->pc = state->pc;
+    block->loop_depth = state->loop_depth;
+    block->loop_start = state->loop_depth
+                        ? state->loop_stack[state->loop_depth - 1].start : 0;
+    block->loop_end = state->loop_depth
+                      ? state->loop_stack[state->loop_depth - 1].end : 0;
+    dbt->translations++;
+
+    pcs[0] = state->pc;
+    for (n = 0; n < DBT_MAX_BLOCK_INSNS; )
+    {
+        isa_decode(isa_fetch(state->code_memory, state->code_memory_size,
+                             pcs[n] - CODE_MEMORY_BASE, &size), &ins[n]);
+        if (ins[n].opcode == OPCODE_LOOP)
+        {
+            break;
+        }
+        pcs[n + 1] = pcs[n] + size;
+        n++;
+        if (ends_block(ins[n - 1].opcode)
+            || (block->loop_depth && pcs[n] == block->loop_end))
+        {
+            break;
+        }
+    }
+
+    block->insns = n;
+    block->code = NULL;
+    if (!n)
+    {
+        return block;
+    }
+
+    /* The flags of the last setter are seen after the block */
+    for (i = n - 1, live = TRUE; i >= 0; --i)
+    {
+        set_flags[i] = live;
+        if (func_sets_flags(ins[i].opcode))
+        {
+            live = FALSE;
+        }
+        if (reads_flags(ins[i].opcode))
+        {
+            live = TRUE;
+        }
+    }
+
+    block->code = dbt->cache + dbt->cache_used;
+    emit(dbt, 0x48);               /* cmp qword [budget], n */
+    emit_field(dbt, 0x81, 7, FIELD(budget));
+    emit32(dbt, n);
+    budget = emit_jump(dbt, 0x8c);
+    emit(dbt, 0x48);               /* sub qword [budget], n */
+    emit_field(dbt, 0x81, 5, FIELD(budget));
+    emit32(dbt, n);
+    emit(dbt, 0x48);               /* add qword [insn_count], n */
+    emit_field(dbt, 0x81, 0, FIELD(insn_count));
+    emit32(dbt, n);
+
+    for (i = 0; i < n; ++i)
+    {
+        if (ends_block(ins[i].opcode))
+        {
+            translate_control(dbt, block, &ins[i], pcs[i], pcs[i + 1]);
+            break;
+        }
+        translate_operation(dbt, &ins[i], set_flags[i]);
+    }
+    if (i == n)
+    {
+        emit_next(dbt, block, pcs[n]);
+    }
+
+    patch_jump(dbt->cache + budget, dbt->cache + dbt->cache_used);
+    emit_exit(dbt, block->pc, EXIT_BUDGET);
+    return block;
+}
+
+/* Sets up the code cache, returns FALSE when the host cannot run the code */
+int
+dbt_init(DBT_Engine *dbt)
+{
+    static const unsigned char entry[] = {
+        0x53,                      /* push rbx */
+        0x48, 0x89, 0xfb,          /* mov rbx, rdi */
+        0xff, 0xe6,                /* jmp rsi */
+        0x5b,                      /* leave: pop rbx */
+        0xc3                       /* ret */
+    };
+
+    memset(dbt, 0, sizeof(DBT_Engine));
+
+#if defined(__x86_64__)
+    dbt->cache = mmap(NULL, DBT_CACHE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (dbt->cache == MAP_FAILED)
+    {
+        dbt->cache = NULL;
+        return FALSE;
+    }
+
+    memcpy(dbt->cache, entry, sizeof(entry));
+    dbt->cache_base = dbt->cache_used = sizeof(entry);
+    return TRUE;
+#else
+    (void)entry;
+    return FALSE;
+#endif
+}
+
+/* Throws away every translated block, needed when code memory changes */
+void
+dbt_flush(DBT_Engine *dbt)
+{
+    dbt->cache_used = dbt->cache_base;
+    dbt->num_blocks = 0;
+    memset(dbt->table, 0, sizeof(dbt->table));
+    dbt->flushes++;
+}
+
+/*
+ * Runs the program until HALT or max_insns instructions, and returns how
+ * many ran. Blocks are entered from here, and the exit a block left
+ * through is chained to the next one as soon as that is translated. The
+ * instructions of a block that would overrun the budget, and LOOPs, are
+ * run by the interpreter.
+ */
+long long
+dbt_run(DBT_Engine *dbt, Func_State *state, long long max_insns)
+{
+    Enter_Code enter = (Enter_Code)(uintptr_t)(dbt->cache + ENTER_OFFSET);
+    long long start = state->insn_count;
+    unsigned char *chain = NULL;
+    DBT_Block *block;
+    unsigned int slot;
+    int flushes;
+
+    state->budget = max_insns;
+    while (!state->halted && state->budget > 0)
+    {
+        flushes = dbt->flushes;
+        block = find_block(dbt, state, &slot);
+        if (!block)
+        {
+            block = translate(dbt, state);
+        }
+
+        if (chain && block->code && flushes == dbt->flushes)
+        {
+            patch_jump(chain, block->code);
+            dbt->chains++;
+        }
+        chain = NULL;
+
+        if (!block->code || block->insns > state->budget)
+        {
+            func_step(state);
+            state->budget--;
+            dbt->interpreted++;
+            continue;
+        }
+
+        state->chain = NULL;
+        enter(state, block->code);
+        dbt->dispatches++;
+
+        switch (state->exit)
+        {
+            case EXIT_CHAIN:
+            {
+                chain = state->chain;
+                break;
+            }
+
+            case EXIT_BRANCH:
+            {
+                func_redirect(state, state->pc);
+                break;
+            }
+
+            case EXIT_LOOP_DONE:
+            {
+                state->loop_depth--;
+                break;
+            }
+        }
+    }
+
+    return state->insn_count - start;
+}
+
+void
+dbt_free(DBT_Engine *dbt)
+{
+    if (dbt->cache)
+    {
+        munmap(dbt->cache, DBT_CACHE_SIZE);
+        dbt->cache = NULL;
+    }
+}
@@ -0,0 +1,52 @@
+/*
+ * apex_dbt.h
+ * Contains APEX dynamic binary translator declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_DBT_H_
+#define _APEX_DBT_H_
+
+#include "apex_func.h"
+#include "apex_macros.h"
+
+#define DBT_TABLE_SIZE (2 * DBT_MAX_BLOCKS)
+
+/*
+ * Basic block translated into host code. The hardware loop it runs in is
+ * part of its identity, since the end of the innermost body ends a block
+ * and sends it back to the start.
+ */
+typedef struct DBT_Block
+{
+    int pc;
+    int loop_depth;
+    int loop_start;
+    int loop_end;
+    int insns;                     /* Instructions the block runs */
+    unsigned char *code;           /* NULL when its first one is interpreted */
+} DBT_Block;
+
+/* Code cache holding the translated blocks, looked up by PC */
+typedef struct DBT_Engine
+{
+    unsigned char *cache;
+    int cache_used;
+    int cache_base;                /* End of the entry and exit code */
+    DBT_Block blocks[DBT_MAX_BLOCKS];
+    int num_blocks;
+    int table[DBT_TABLE_SIZE];     /* Block index + 1, 0 when empty */
+    long long translations;        /* Blocks translated */
+    long long chains;              /* Exits patched to jump straight on */
+    long long dispatches;          /* Returns to the dispatcher */
+    long long interpreted;         /* Instructions left to the interpreter */
+    int flushes;                   /* Times the code cache was emptied */
+} DBT_Engine;
+
+int dbt_init(DBT_Engine *dbt);
+void dbt_flush(DBT_Engine *dbt);
+long long dbt_run(DBT_Engine *dbt, Func_State *state, long long max_insns);
+void dbt_free(DBT_Engine *dbt);
+#endif
@@ -0,0 +1,95 @@
+/*
+ * apex_dma.c
+ * Contains APEX DMA engine implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_dma.h"
+#include "apex_macros.h"
+
+/* Queues a copy of words locations, laid out DATA_WORD_STRIDE apart.
+ * Returns FALSE when the queue is full */
+int
+dma_enqueue(DMA_Engine *dma, int source, int destination, int words)
+{
+    DMA_Transfer *transfer;
+
+    if (words <= 0)
+    {
+        return TRUE;
+    }
+
+    if (dma->count == DMA_QUEUE_SIZE)
+    {
+        return FALSE;
+    }
+
+    transfer = &dma->queue[(dma->head + dma->count) % DMA_QUEUE_SIZE];
+    transfer->source = source;
+    transfer->destination = destination;
+    transfer->words = words;
+    transfer->moved = 0;
+    transfer->start_cycle = -1;
+    dma->count++;
+    return TRUE;
+}
+
+/*
+ * Advances the oldest transfer by one cycle. A transfer first waits out the
+ * setup latency, then copies up to DMA_WORDS_PER_CYCLE words and leaves the
+ * queue once all of them have moved. With several cores the words go
+ * through the core's store log, which is NULL for a single core.
+ */
+void
+dma_step(DMA_Engine *dma, Data_Memory *mem, Mem_Log *log, int clock)
+{
+    DMA_Transfer *transfer;
+    int offset, i;
+
+    if (!dma->count)
+    {
+        return;
+    }
+
+    dma->busy_cycles++;
+    transfer = &dma->queue[dma->head];
+    if (transfer->start_cycle < 0)
+    {
+        transfer->start_cycle = clock + DMA_SETUP_LATENCY;
+    }
+
+    if (clock < transfer->start_cycle)
+    {
+        return;
+    }
+
+    for (i = 0; i < DMA_WORDS_PER_CYCLE && transfer->moved < transfer->words; ++i)
+    {
+        offset = transfer->moved * DATA_WORD_STRIDE;
+        if (log)
+        {
+            mem_log_write(log, transfer->destination + offset,
+                          mem_log_read(mem, log, transfer->source + offset));
+        }
+        else
+        {
+            mem_write(mem, transfer->destination + offset,
+                      mem_read(mem, transfer->source + offset));
+        }
+        transfer->moved++;
+        dma->words_moved++;
+    }
+
+    if (transfer->moved == transfer->words)
+    {
+        dma->head = (dma->head + 1) % DMA_QUEUE_SIZE;
+        dma->count--;
+        dma->transfers++;
+    }
+}
@@ -0,0 +1,41 @@
+/*
+ * apex_dma.h
+ * Contains APEX DMA engine declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_DMA_H_
+#define _APEX_DMA_H_
+
+#include "apex_macros.h"
+#include "apex_mem.h"
+
+/* Block copy queued by a COPY instruction */
+typedef struct DMA_Transfer
+{
+    int source;
+    int destination;
+    int words;
+    int moved;                     /* Words copied so far */
+    int start_cycle;               /* Cycle the first word moves, -1 if queued */
+} DMA_Transfer;
+
+/* Copies blocks of data memory while the pipeline keeps running. Nothing
+ * tracks the copied ranges, programs wait for completion with DMAWAIT */
+typedef struct DMA_Engine
+{
+    DMA_Transfer queue[DMA_QUEUE_SIZE];
+    int head;                      /* Index of the transfer in progress */
+    int count;
+    int transfers;                 /* Transfers completed */
+    int words_moved;
+    int busy_cycles;               /* Cycles with a transfer queued */
+    int wait_cycles;               /* Cycles the pipeline waited for the engine */
+    int full_stalls;               /* Cycles a COPY found the queue full */
+} DMA_Engine;
+
+int dma_enqueue(DMA_Engine *dma, int source, int destination, int words);
+void dma_step(DMA_Engine *dma, Data_Memory *mem, Mem_Log *log, int clock);
+#endif
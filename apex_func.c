@@ -0,0 +1,460 @@
+/*
+ * apex_func.c
+ * Contains the APEX functional interpreter, which runs a program without
+ * the pipeline and serves as the reference for the binary translator
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "apex_func.h"
+#include "apex_isa.h"
+#include "apex_macros.h"
+#include "apex_vector.h"
+
+void
+func_init(Func_State *state, const unsigned char *code_memory,
+          int code_memory_size, Data_Memory *data_memory)
+{
+    memset(state, 0, sizeof(Func_State));
+    state->pc = CODE_MEMORY_BASE;
+    state->code_memory = code_memory;
+    state->code_memory_size = code_memory_size;
+    state->data_memory = data_memory;
+}
+
+/* Returns TRUE for the operations that set the flags from their result */
+int
+func_sets_flags(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        case OPCODE_ADDL:
+        case OPCODE_SUB:
+        case OPCODE_SUBL:
+        case OPCODE_MUL:
+        case OPCODE_MAC:
+        case OPCODE_SHADD:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        case OPCODE_CMP:
+        case OPCODE_CML:
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static void
+set_flags(Func_State *state, int result)
+{
+    state->zero_flag = (result == 0) ? TRUE : FALSE;
+    state->positive_flag = (result > 0) ? TRUE : FALSE;
+    state->negative_flag = (result < 0) ? TRUE : FALSE;
+}
+
+/*
+ * Carries out an instruction that does not change control flow. Results
+ * are those Execute, Memory and Writeback produce for it. DIV has no
+ * datapath and, as in the pipeline, does nothing. A COPY is done at once,
+ * so DMAWAIT has nothing to wait for.
+ */
+void
+func_operate(Func_State *state, int opcode, int rd, int rs1, int rs2, int imm)
+{
+    Data_Memory *mem = state->data_memory;
+    int *regs = state->regs;
+    int result, i;
+
+    switch (opcode)
+    {
+        case OPCODE_ADD:
+        {
+            result = regs[rs1] + regs[rs2];
+            break;
+        }
+
+        case OPCODE_ADDL:
+        {
+            result = regs[rs1] + imm;
+            break;
+        }
+
+        case OPCODE_SUB:
+        case OPCODE_CMP:
+        {
+            result = regs[rs1] - regs[rs2];
+            break;
+        }
+
+        case OPCODE_SUBL:
+        case OPCODE_CML:
+        {
+            result = regs[rs1] - imm;
+            break;
+        }
+
+        case OPCODE_MUL:
+        {
+            result = regs[rs1] * regs[rs2];
+            break;
+        }
+
+        case OPCODE_MAC:
+        {
+            result = regs[rd] + regs[rs1] * regs[rs2];
+            break;
+        }
+
+        case OPCODE_SHADD:
+        {
+            result = regs[rs1] + (int)((unsigned int)regs[rs2] << (imm & 31));
+            break;
+        }
+
+        case OPCODE_AND:
+        {
+            result = regs[rs1] & regs[rs2];
+            break;
+        }
+
+        case OPCODE_OR:
+        {
+            result = regs[rs1] | regs[rs2];
+            break;
+        }
+
+        case OPCODE_XOR:
+        {
+            result = regs[rs1] ^ regs[rs2];
+            break;
+        }
+
+        case OPCODE_MOVC:
+        {
+            regs[rd] = imm;
+            return;
+        }
+
+        case OPCODE_CMOVZ:
+        {
+            regs[rd] = (state->zero_flag == TRUE) ? regs[rs1] : regs[rd];
+            return;
+        }
+
+        case OPCODE_CMOVNZ:
+        {
+            regs[rd] = (state->zero_flag == FALSE) ? regs[rs1] : regs[rd];
+            return;
+        }
+
+        case OPCODE_CMOVP:
+        {
+            regs[rd] = (state->positive_flag == TRUE) ? regs[rs1] : regs[rd];
+            return;
+        }
+
+        case OPCODE_CMOVN:
+        {
+            regs[rd] = (state->negative_flag == TRUE) ? regs[rs1] : regs[rd];
+            return;
+        }
+
+        case OPCODE_LOAD:
+        {
+            regs[rd] = mem_read(mem, regs[rs1] + imm);
+            return;
+        }
+
+        /* The pointer update is written back after rd, and wins over it */
+        case OPCODE_LOADP:
+        {
+            result = regs[rs1];
+            regs[rd] = mem_read(mem, result + imm);
+            regs[rs1] = result + 4;
+            return;
+        }
+
+        case OPCODE_STORE:
+        {
+            mem_write(mem, regs[rs2] + imm, regs[rs1]);
+            return;
+        }
+
+        case OPCODE_STOREP:
+        {
+            mem_write(mem, regs[rs2] + imm, regs[rs1]);
+            regs[rs2] += 4;
+            return;
+        }
+
+        case OPCODE_COPY:
+        {
+            for (i = 0; i < imm; ++i)
+            {
+                mem_write(mem, regs[rs1] + i * DATA_WORD_STRIDE,
+                          mem_read(mem, regs[rs2] + i * DATA_WORD_STRIDE));
+            }
+            return;
+        }
+
+        case OPCODE_VLOAD:
+        {
+            for (i = 0; i < VECTOR_LENGTH; ++i)
+            {
+                state->vregs[rd][i]
+                    = mem_read(mem, regs[rs1] + imm + i * DATA_WORD_STRIDE);
+            }
+            return;
+        }
+
+        case OPCODE_VSTORE:
+        {
+            for (i = 0; i < VECTOR_LENGTH; ++i)
+            {
+                mem_write(mem, regs[rs2] + imm + i * DATA_WORD_STRIDE,
+                          state->vregs[rs1][i]);
+            }
+            return;
+        }
+
+        case OPCODE_VADD:
+        {
+            vector_add(state->vregs[rd], state->vregs[rs1], state->vregs[rs2]);
+            return;
+        }
+
+        case OPCODE_VMUL:
+        {
+            vector_mul(state->vregs[rd], state->vregs[rs1], state->vregs[rs2]);
+            return;
+        }
+
+        case OPCODE_VRED:
+        {
+            regs[rd] = vector_reduce(state->vregs[rs1]);
+            return;
+        }
+
+        default:
+        {
+            return;
+        }
+    }
+
+    /* CMP and CML only set the flags */
+    if (opcode != OPCODE_CMP && opcode != OPCODE_CML)
+    {
+        regs[rd] = result;
+    }
+    set_flags(state, result);
+}
+
+/* Sends control to a branch target. Loops whose body does not hold it are
+ * left, as a break would */
+void
+func_redirect(Func_State *state, int target)
+{
+    HW_Loop *loop;
+
+    state->pc = target;
+    while (state->loop_depth)
+    {
+        loop = &state->loop_stack[state->loop_depth - 1];
+        if (target >= loop->start && target < loop->end)
+        {
+            break;
+        }
+        state->loop_depth--;
+    }
+}
+
+/* Returns TRUE when a branch other than JUMP/JALR is taken */
+static int
+branch_taken(const Func_State *state, const APEX_Instruction *ins)
+{
+    int a = state->regs[ins->rs1], b = state->regs[ins->rs2];
+
+    switch (ins->opcode)
+    {
+        case OPCODE_BZ:
+            return state->zero_flag == TRUE;
+        case OPCODE_BNZ:
+            return state->zero_flag == FALSE;
+        case OPCODE_BP:
+            return state->positive_flag == TRUE;
+        case OPCODE_BNP:
+            return state->positive_flag == FALSE;
+        case OPCODE_BN:
+            return state->negative_flag == TRUE;
+        case OPCODE_BNN:
+            return state->negative_flag == FALSE;
+        case OPCODE_BEQ:
+            return a == b;
+        case OPCODE_BNE:
+            return a != b;
+        case OPCODE_BLT:
+            return a < b;
+        case OPCODE_BGE:
+            return a >= b;
+        case OPCODE_BEQL:
+            return a == ins->literal;
+        case OPCODE_BNEL:
+            return a != ins->literal;
+        case OPCODE_BLTL:
+            return a < ins->literal;
+        case OPCODE_BGEL:
+            return a >= ins->literal;
+    }
+
+    return FALSE;
+}
+
+/*
+ * Runs the instruction at the PC. Past the last instruction of the
+ * innermost hardware loop body the PC goes back to its start, until the
+ * loop has run its count.
+ */
+void
+func_step(Func_State *state)
+{
+    APEX_Instruction ins;
+    HW_Loop *loop;
+    int size, next_pc, start;
+
+    isa_decode(isa_fetch(state->code_memory, state->code_memory_size,
+                         state->pc - CODE_MEMORY_BASE, &size), &ins);
+    next_pc = state->pc + size;
+    state->insn_count++;
+
+    switch (ins.opcode)
+    {
+        case OPCODE_HALT:
+        {
+            state->halted = TRUE;
+            return;
+        }
+
+        case OPCODE_JUMP:
+        {
+            func_redirect(state, state->regs[ins.rs1] + ins.imm);
+            return;
+        }
+
+        case OPCODE_JALR:
+        {
+            start = state->regs[ins.rs1] + ins.imm;
+            state->regs[ins.rd] = next_pc;
+            func_redirect(state, start);
+            return;
+        }
+
+        /* A loop that runs zero times skips its body */
+        case OPCODE_LOOP:
+        {
+            if (state->regs[ins.rs1] <= 0 || ins.imm <= 0)
+            {
+                state->pc = next_pc + ins.imm;
+                return;
+            }
+
+            assert(state->loop_depth < HW_LOOP_DEPTH && "Hardware loops nested too deep");
+            loop = &state->loop_stack[state->loop_depth++];
+            loop->start = next_pc;
+            loop->end = next_pc + ins.imm;
+            loop->remaining = state->regs[ins.rs1];
+            state->pc = next_pc;
+            return;
+        }
+
+        default:
+        {
+            if (branch_taken(state, &ins))
+            {
+                func_redirect(state, state->pc + ins.imm);
+                return;
+            }
+            func_operate(state, ins.opcode, ins.rd, ins.rs1, ins.rs2, ins.imm);
+            break;
+        }
+    }
+
+    state->pc = next_pc;
+    if (state->loop_depth)
+    {
+        loop = &state->loop_stack[state->loop_depth - 1];
+        if (next_pc == loop->end)
+        {
+            if (--loop->remaining > 0)
+            {
+                state->pc = loop->start;
+            }
+            else
+            {
+                state->loop_depth--;
+            }
+        }
+    }
+}
+
+/* Runs until HALT or max_insns instructions, returns how many ran */
+long long
+func_run(Func_State *state, long long max_insns)
+{
+    long long count = 0;
+
+    while (!state->halted && count < max_insns)
+    {
+        func_step(state);
+        count++;
+    }
+
+    return count;
+}
+
+/* Compares the architectural state of two runs */
+int
+func_state_equal(const Func_State *a, const Func_State *b)
+{
+    return !memcmp(a->regs, b->regs, sizeof(a->regs))
+           && a->zero_flag == b->zero_flag
+           && a->positive_flag == b->positive_flag
+           && a->negative_flag == b->negative_flag
+           && !memcmp(a->vregs, b->vregs, sizeof(a->vregs))
+           && a->pc == b->pc && a->halted == b->halted
+           && a->loop_depth == b->loop_depth
+           && !memcmp(a->loop_stack, b->loop_stack,
+                      a->loop_depth * sizeof(HW_Loop))
+           && a->insn_count == b->insn_count;
+}
+
+/* Prints the registers in the layout the pipeline uses */
+void
+func_print_state(const Func_State *state)
+{
+    int i;
+
+    printf("----------\n%s\n----------\n", "Registers:");
+
+    for (i = 0; i < REG_FILE_SIZE; ++i)
+    {
+        printf("R%-3d[%-3d] ", i, state->regs[i]);
+        if (i == REG_FILE_SIZE / 2 - 1 || i == REG_FILE_SIZE - 1)
+        {
+            printf("\n");
+        }
+    }
+
+    printf("P = %d\n", state->positive_flag);
+    printf("N = %d\n", state->negative_flag);
+    printf("Z = %d\n", state->zero_flag);
+    printf("\n");
+}
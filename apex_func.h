@@ -0,0 +1,59 @@
+/*
+ * apex_func.h
+ * Contains APEX functional execution declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_FUNC_H_
+#define _APEX_FUNC_H_
+
+#include "apex_macros.h"
+#include "apex_mem.h"
+
+/* Hardware loop set up by LOOP, run by Fetch */
+typedef struct HW_Loop
+{
+    int start;                     /* PC of the first body instruction */
+    int end;                       /* PC just past the last body instruction */
+    int remaining;                 /* Iterations left, including this one */
+} HW_Loop;
+
+/*
+ * Architectural state of a program run without the pipeline. Instructions
+ * take effect one at a time, in program order, so the results are those
+ * the pipeline retires without any of its timing.
+ */
+typedef struct Func_State
+{
+    int regs[REG_FILE_SIZE];
+    int zero_flag;
+    int positive_flag;
+    int negative_flag;
+    int vregs[VECTOR_REG_FILE_SIZE][VECTOR_LENGTH];
+    int pc;
+    int halted;
+    HW_Loop loop_stack[HW_LOOP_DEPTH]; /* Active hardware loops, innermost last */
+    int loop_depth;
+    long long insn_count;          /* Instructions executed, HALT included */
+    const unsigned char *code_memory;
+    int code_memory_size;
+    Data_Memory *data_memory;
+    /* Kept up to date by translated code, see apex_dbt.c */
+    long long budget;              /* Instructions it may still run */
+    int exit;                      /* Why it returned to the dispatcher */
+    unsigned char *chain;          /* Jump it left through, to be chained */
+} Func_State;
+
+void func_init(Func_State *state, const unsigned char *code_memory,
+               int code_memory_size, Data_Memory *data_memory);
+int func_sets_flags(int opcode);
+void func_operate(Func_State *state, int opcode, int rd, int rs1, int rs2,
+                  int imm);
+void func_redirect(Func_State *state, int target);
+void func_step(Func_State *state);
+long long func_run(Func_State *state, long long max_insns);
+int func_state_equal(const Func_State *a, const Func_State *b);
+void func_print_state(const Func_State *state);
+#endif
@@ -0,0 +1,712 @@
+/*
+ * apex_isa.c
+ * Contains the APEX binary instruction encoding, and the assembler that
+ * lays a parsed program out in code memory
+ *
+ * Instructions are stored little endian. The low two bits of the first
+ * halfword give the size, 11 marks a 32-bit instruction and anything else
+ * a 16-bit compressed one.
+ *
+ * 32-bit: [1:0] = 11, [7:2] opcode, then from bit 8 on the operands the
+ * opcode has, in the order rd, rs1, rs2 (5 bits each) and literal
+ * (LITERAL_BITS). The signed immediate takes all the bits left above them.
+ *
+ * 64-bit, for immediates the 32-bit form cannot hold: [1:0] = 11, [7:2] =
+ * LONG_ESCAPE, [13:8] opcode, the operands packed from bit 14 as above, and
+ * the immediate in the upper word. The literal compares instead keep their
+ * whole literal in the upper word, and their branch offset in the bits left
+ * above rs1.
+ *
+ * 16-bit: [1:0] quadrant, [4:2] function
+ *   Q0, a = [9:5], imm = [15:10]: NOP (HALT with bit 5 set), MOVC a,#imm,
+ *       ADDL a,a,#imm, SUBL a,a,#imm, CML a,#imm and ADDL a,b,#0 with
+ *       b = [14:10]
+ *   Q1, a = [9:5], b = [14:10]: ADD, SUB, MUL, AND, OR, EX-OR as a,a,b,
+ *       CMP a,b, then LOAD a,b,#0 or, with bit 15 set, STORE a,b,#0
+ *   Q2, imm = [15:5]: BZ, BNZ, BP, BNP, BN, BNN
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_isa.h"
+#include "apex_macros.h"
+
+#define USES_RD 0x1
+#define USES_RS1 0x2
+#define USES_RS2 0x4
+#define USES_LITERAL 0x8
+
+#define LITERAL_BITS 9
+
+/* Opcode field value that marks the 64-bit form */
+#define LONG_ESCAPE 0x3f
+
+/* Mnemonic and the operands each opcode carries in its 32-bit encoding */
+static const struct
+{
+    const char *mnemonic;
+    int operands;
+} isa_table[OPCODE_LOOP + 1] = {
+    [OPCODE_ADD] = {"ADD", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_SUB] = {"SUB", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_MUL] = {"MUL", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_DIV] = {"DIV", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_AND] = {"AND", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_OR] = {"OR", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_XOR] = {"EX-OR", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_MOVC] = {"MOVC", USES_RD},
+    [OPCODE_LOAD] = {"LOAD", USES_RD | USES_RS1},
+    [OPCODE_STORE] = {"STORE", USES_RS1 | USES_RS2},
+    [OPCODE_BZ] = {"BZ", 0},
+    [OPCODE_BNZ] = {"BNZ", 0},
+    [OPCODE_HALT] = {"HALT", 0},
+    [OPCODE_NOP] = {"NOP", 0},
+    [OPCODE_ADDL] = {"ADDL", USES_RD | USES_RS1},
+    [OPCODE_SUBL] = {"SUBL", USES_RD | USES_RS1},
+    [OPCODE_STOREP] = {"STOREP", USES_RS1 | USES_RS2},
+    [OPCODE_LOADP] = {"LOADP", USES_RD | USES_RS1},
+    [OPCODE_CMP] = {"CMP", USES_RS1 | USES_RS2},
+    [OPCODE_CML] = {"CML", USES_RS1},
+    [OPCODE_BP] = {"BP", 0},
+    [OPCODE_BNP] = {"BNP", 0},
+    [OPCODE_BN] = {"BN", 0},
+    [OPCODE_BNN] = {"BNN", 0},
+    [OPCODE_JUMP] = {"JUMP", USES_RS1},
+    [OPCODE_JALR] = {"JALR", USES_RD | USES_RS1},
+    [OPCODE_PREFETCH] = {"PREFETCH", USES_RS1},
+    [OPCODE_COPY] = {"COPY", USES_RS1 | USES_RS2},
+    [OPCODE_DMAWAIT] = {"DMAWAIT", 0},
+    [OPCODE_VLOAD] = {"VLOAD", USES_RD | USES_RS1},
+    [OPCODE_VSTORE] = {"VSTORE", USES_RS1 | USES_RS2},
+    [OPCODE_VADD] = {"VADD", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_VMUL] = {"VMUL", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_VRED] = {"VRED", USES_RD | USES_RS1},
+    [OPCODE_MAC] = {"MAC", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_SHADD] = {"SHADD", USES_RD | USES_RS1 | USES_RS2},
+    [OPCODE_CMOVZ] = {"CMOVZ", USES_RD | USES_RS1},
+    [OPCODE_CMOVNZ] = {"CMOVNZ", USES_RD | USES_RS1},
+    [OPCODE_CMOVP] = {"CMOVP", USES_RD | USES_RS1},
+    [OPCODE_CMOVN] = {"CMOVN", USES_RD | USES_RS1},
+    [OPCODE_BEQ] = {"BEQ", USES_RS1 | USES_RS2},
+    [OPCODE_BNE] = {"BNE", USES_RS1 | USES_RS2},
+    [OPCODE_BLT] = {"BLT", USES_RS1 | USES_RS2},
+    [OPCODE_BGE] = {"BGE", USES_RS1 | USES_RS2},
+    [OPCODE_BEQL] = {"BEQL", USES_RS1 | USES_LITERAL},
+    [OPCODE_BNEL] = {"BNEL", USES_RS1 | USES_LITERAL},
+    [OPCODE_BLTL] = {"BLTL", USES_RS1 | USES_LITERAL},
+    [OPCODE_BGEL] = {"BGEL", USES_RS1 | USES_LITERAL},
+    [OPCODE_LOOP] = {"LOOP", USES_RS1},
+};
+
+/* Register operations and flag branches by compressed function number */
+static const int q1_opcodes[] = {OPCODE_ADD, OPCODE_SUB, OPCODE_MUL,
+                                 OPCODE_AND, OPCODE_OR, OPCODE_XOR};
+static const int q2_opcodes[] = {OPCODE_BZ, OPCODE_BNZ, OPCODE_BP,
+                                 OPCODE_BNP, OPCODE_BN, OPCODE_BNN};
+
+static int
+sign_extend(unsigned long long value, int bits)
+{
+    return (int)((unsigned int)value << (32 - bits)) >> (32 - bits);
+}
+
+/* Returns TRUE if value fits a signed field of the given width */
+static int
+fits(int value, int bits)
+{
+    return value >= -(1 << (bits - 1)) && value < (1 << (bits - 1));
+}
+
+/* Returns TRUE for branches whose immediate is relative to their own PC */
+static int
+is_pc_relative(int opcode)
+{
+    switch (opcode)
+    {
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        case OPCODE_BEQ:
+        case OPCODE_BNE:
+        case OPCODE_BLT:
+        case OPCODE_BGE:
+        case OPCODE_BEQL:
+        case OPCODE_BNEL:
+        case OPCODE_BLTL:
+        case OPCODE_BGEL:
+        {
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+static unsigned int
+compressed(int quadrant, int function, int a, int b)
+{
+    return (unsigned int)(quadrant | function << 2 | (a & 0x1f) << 5
+                          | (b & 0x3f) << 10);
+}
+
+/* Picks the 16-bit form of an instruction, returns FALSE if it has none */
+static int
+encode_16(const APEX_Instruction *ins, unsigned long long *bits)
+{
+    int i, rs;
+
+    switch (ins->opcode)
+    {
+        case OPCODE_NOP:
+        {
+            *bits = compressed(0, 0, 0, 0);
+            return TRUE;
+        }
+
+        case OPCODE_HALT:
+        {
+            *bits = compressed(0, 0, 1, 0);
+            return TRUE;
+        }
+
+        case OPCODE_MOVC:
+        {
+            *bits = compressed(0, 1, ins->rd, ins->imm);
+            return fits(ins->imm, 6);
+        }
+
+        case OPCODE_ADDL:
+        {
+            if (ins->imm == 0)
+            {
+                *bits = compressed(0, 5, ins->rd, ins->rs1);
+                return TRUE;
+            }
+            *bits = compressed(0, 2, ins->rd, ins->imm);
+            return ins->rd == ins->rs1 && fits(ins->imm, 6);
+        }
+
+        case OPCODE_SUBL:
+        {
+            *bits = compressed(0, 3, ins->rd, ins->imm);
+            return ins->rd == ins->rs1 && fits(ins->imm, 6);
+        }
+
+        case OPCODE_CML:
+        {
+            *bits = compressed(0, 4, ins->rs1, ins->imm);
+            return fits(ins->imm, 6);
+        }
+
+        case OPCODE_ADD:
+        case OPCODE_SUB:
+        case OPCODE_MUL:
+        case OPCODE_AND:
+        case OPCODE_OR:
+        case OPCODE_XOR:
+        {
+            /* Two address form, commutative operations may swap sources */
+            rs = ins->rs2;
+            if (ins->rd != ins->rs1)
+            {
+                if (ins->opcode == OPCODE_SUB || ins->rd != ins->rs2)
+                {
+                    return FALSE;
+                }
+                rs = ins->rs1;
+            }
+
+            for (i = 0; q1_opcodes[i] != ins->opcode; ++i)
+            {
+            }
+            *bits = compressed(1, i, ins->rd, rs);
+            return TRUE;
+        }
+
+        case OPCODE_CMP:
+        {
+            *bits = compressed(1, 6, ins->rs1, ins->rs2);
+            return TRUE;
+        }
+
+        case OPCODE_LOAD:
+        {
+            *bits = compressed(1, 7, ins->rd, ins->rs1);
+            return ins->imm == 0;
+        }
+
+        case OPCODE_STORE:
+        {
+            *bits = compressed(1, 7, ins->rs1, ins->rs2) | 1 << 15;
+            return ins->imm == 0;
+        }
+
+        case OPCODE_BZ:
+        case OPCODE_BNZ:
+        case OPCODE_BP:
+        case OPCODE_BNP:
+        case OPCODE_BN:
+        case OPCODE_BNN:
+        {
+            for (i = 0; q2_opcodes[i] != ins->opcode; ++i)
+            {
+            }
+            *bits = (unsigned int)(2 | i << 2 | (ins->imm & 0x7ff) << 5);
+            return fits(ins->imm, 11);
+        }
+    }
+
+    return FALSE;
+}
+
+/* Packs the operands of an instruction from bit pos on, the literal in a
+ * field of literal_bits or not at all for none. Returns the first bit left
+ * for the immediate, or -1 if the literal does not fit */
+static int
+pack_operands(const APEX_Instruction *ins, int pos, int literal_bits,
+              unsigned long long *bits)
+{
+    int operands = isa_table[ins->opcode].operands;
+
+    if (operands & USES_RD)
+    {
+        *bits |= (unsigned long long)(ins->rd & 0x1f) << pos;
+        pos += 5;
+    }
+    if (operands & USES_RS1)
+    {
+        *bits |= (unsigned long long)(ins->rs1 & 0x1f) << pos;
+        pos += 5;
+    }
+    if (operands & USES_RS2)
+    {
+        *bits |= (unsigned long long)(ins->rs2 & 0x1f) << pos;
+        pos += 5;
+    }
+    if ((operands & USES_LITERAL) && literal_bits)
+    {
+        if (!fits(ins->literal, literal_bits))
+        {
+            return -1;
+        }
+        *bits |= (unsigned long long)(ins->literal & ((1 << literal_bits) - 1))
+                 << pos;
+        pos += literal_bits;
+    }
+
+    return pos;
+}
+
+static int
+unpack_operands(unsigned long long bits, int pos, int literal_bits,
+                APEX_Instruction *ins)
+{
+    int operands;
+
+    assert(ins->opcode <= OPCODE_LOOP && "Invalid opcode in code memory");
+    operands = isa_table[ins->opcode].operands;
+    if (operands & USES_RD)
+    {
+        ins->rd = (bits >> pos) & 0x1f;
+        pos += 5;
+    }
+    if (operands & USES_RS1)
+    {
+        ins->rs1 = (bits >> pos) & 0x1f;
+        pos += 5;
+    }
+    if (operands & USES_RS2)
+    {
+        ins->rs2 = (bits >> pos) & 0x1f;
+        pos += 5;
+    }
+    if ((operands & USES_LITERAL) && literal_bits)
+    {
+        ins->literal = sign_extend(bits >> pos, literal_bits);
+        pos += literal_bits;
+    }
+
+    return pos;
+}
+
+/* Builds the 32-bit form, returns FALSE if an immediate does not fit */
+static int
+encode_32(const APEX_Instruction *ins, unsigned long long *bits)
+{
+    int pos;
+
+    *bits = 0x3 | (unsigned int)ins->opcode << 2;
+    pos = pack_operands(ins, 8, LITERAL_BITS, bits);
+    if (pos < 0 || !fits(ins->imm, 32 - pos))
+    {
+        return FALSE;
+    }
+
+    *bits |= (unsigned long long)((unsigned int)ins->imm << pos);
+    return TRUE;
+}
+
+/* Builds the 64-bit form, which only fails on the branch offset of a
+ * literal compare that does not fit the lower word */
+static int
+encode_64(const APEX_Instruction *ins, unsigned long long *bits)
+{
+    int pos;
+
+    *bits = 0x3 | LONG_ESCAPE << 2 | (unsigned int)ins->opcode << 8;
+    pos = pack_operands(ins, 14, 0, bits);
+    if (isa_table[ins->opcode].operands & USES_LITERAL)
+    {
+        if (!fits(ins->imm, 32 - pos))
+        {
+            return FALSE;
+        }
+        *bits |= (unsigned long long)((unsigned int)ins->imm << pos);
+        *bits |= (unsigned long long)(unsigned int)ins->literal << 32;
+        return TRUE;
+    }
+
+    *bits |= (unsigned long long)(unsigned int)ins->imm << 32;
+    return TRUE;
+}
+
+static void
+decode_32(unsigned long long bits, APEX_Instruction *ins)
+{
+    int pos;
+
+    ins->opcode = (bits >> 2) & 0x3f;
+    if (ins->opcode == LONG_ESCAPE)
+    {
+        ins->opcode = (bits >> 8) & 0x3f;
+        pos = unpack_operands(bits, 14, 0, ins);
+        if (isa_table[ins->opcode].operands & USES_LITERAL)
+        {
+            ins->imm = sign_extend(bits >> pos, 32 - pos);
+            ins->literal = (int)(unsigned int)(bits >> 32);
+            return;
+        }
+        ins->imm = (int)(unsigned int)(bits >> 32);
+        return;
+    }
+
+    pos = unpack_operands(bits, 8, LITERAL_BITS, ins);
+    ins->imm = sign_extend(bits >> pos, 32 - pos);
+}
+
+static void
+decode_16(unsigned long long bits, APEX_Instruction *ins)
+{
+    int function = (bits >> 2) & 0x7;
+    int a = (bits >> 5) & 0x1f;
+    int b = (bits >> 10) & 0x1f;
+
+    switch (bits & 0x3)
+    {
+        case 0:
+        {
+            ins->imm = sign_extend(bits >> 10, 6);
+            switch (function)
+            {
+                case 0:
+                    ins->opcode = (a & 1) ? OPCODE_HALT : OPCODE_NOP;
+                    ins->imm = 0;
+                    break;
+                case 1:
+                    ins->opcode = OPCODE_MOVC;
+                    ins->rd = a;
+                    break;
+                case 2:
+                case 3:
+                    ins->opcode = function == 2 ? OPCODE_ADDL : OPCODE_SUBL;
+                    ins->rd = a;
+                    ins->rs1 = a;
+                    break;
+                case 4:
+                    ins->opcode = OPCODE_CML;
+                    ins->rs1 = a;
+                    break;
+                case 5:
+                    ins->opcode = OPCODE_ADDL;
+                    ins->rd = a;
+                    ins->rs1 = b;
+                    ins->imm = 0;
+                    break;
+                default:
+                    assert(0 && "Invalid compressed instruction");
+            }
+            break;
+        }
+
+        case 1:
+        {
+            if (function < 6)
+            {
+                ins->opcode = q1_opcodes[function];
+                ins->rd = a;
+                ins->rs1 = a;
+                ins->rs2 = b;
+            }
+            else if (function == 6)
+            {
+                ins->opcode = OPCODE_CMP;
+                ins->rs1 = a;
+                ins->rs2 = b;
+            }
+            else if (bits & 1 << 15)
+            {
+                ins->opcode = OPCODE_STORE;
+                ins->rs1 = a;
+                ins->rs2 = b;
+            }
+            else
+            {
+                ins->opcode = OPCODE_LOAD;
+                ins->rd = a;
+                ins->rs1 = b;
+            }
+            break;
+        }
+
+        case 2:
+        {
+            assert(function < 6 && "Invalid compressed instruction");
+            ins->opcode = q2_opcodes[function];
+            ins->imm = sign_extend(bits >> 5, 11);
+            break;
+        }
+    }
+}
+
+/* Expands an encoded instruction into its fields */
+void
+isa_decode(unsigned long long bits, APEX_Instruction *ins)
+{
+    memset(ins, 0, sizeof(APEX_Instruction));
+    if ((bits & 0x3) == 0x3)
+    {
+        decode_32(bits, ins);
+    }
+    else
+    {
+        decode_16(bits & 0xffff, ins);
+    }
+    strcpy(ins->opcode_str, isa_table[ins->opcode].mnemonic);
+}
+
+/* Predecode used by Fetch, which only needs to spot HALT */
+int
+isa_opcode(unsigned long long bits)
+{
+    APEX_Instruction ins;
+
+    isa_decode(bits, &ins);
+    return ins.opcode;
+}
+
+/* Returns the size of the instruction whose first halfword is given */
+static int
+encoded_size(unsigned int halfword)
+{
+    if ((halfword & 0x3) != 0x3)
+    {
+        return 2;
+    }
+
+    return ((halfword >> 2) & 0x3f) == LONG_ESCAPE ? 8 : 4;
+}
+
+/*
+ * Reads the instruction at a byte offset into code, returning its encoding
+ * and size. Past the end of the program code memory reads as NOPs.
+ */
+unsigned long long
+isa_fetch(const unsigned char *code, int size, int offset, int *insn_size)
+{
+    unsigned long long bits = 0;
+    int i;
+
+    *insn_size = 2;
+    if (offset < 0 || offset + 2 > size)
+    {
+        return compressed(0, 0, 0, 0);
+    }
+
+    *insn_size = encoded_size(code[offset] | code[offset + 1] << 8);
+    assert(offset + *insn_size <= size && "Instruction runs past code memory");
+    for (i = *insn_size - 1; i >= 0; --i)
+    {
+        bits = bits << 8 | code[offset + i];
+    }
+    return bits;
+}
+
+/* Encodes an instruction in the form of the given size */
+static int
+encode(const APEX_Instruction *ins, int size, unsigned long long *bits)
+{
+    switch (size)
+    {
+        case 2:
+            return encode_16(ins, bits);
+        case 4:
+            return encode_32(ins, bits);
+    }
+
+    return encode_64(ins, bits);
+}
+
+/*
+ * Lays out and encodes a parsed program. Branch offsets and LOOP lengths
+ * are written in the source as if every instruction took 4 bytes, the
+ * assembler turns them into byte distances in the final layout.
+ *
+ * Each instruction gets the smallest form that holds it: 16 bits with
+ * ENABLE_COMPRESSED_ISA, else 32, or 64 for a long immediate. Growing one
+ * instruction can push a branch offset out of its form, so the layout is
+ * redone until it settles. Programs with JUMP or JALR are not compressed,
+ * their targets are absolute addresses the program computes itself, and
+ * are rejected if any instruction needs the 64-bit form, since that would
+ * break their 4 byte stride.
+ */
+unsigned char *
+isa_assemble(const APEX_Instruction *insns, int count, int *size)
+{
+    APEX_Instruction *work = calloc(count, sizeof(APEX_Instruction));
+    int *target = calloc(count, sizeof(int));
+    int *address = calloc(count + 1, sizeof(int));
+    unsigned char *code = NULL;
+    unsigned long long bits;
+    int i, j, compress = ENABLE_COMPRESSED_ISA, jumps = FALSE, changed;
+
+    if (!work || !target || !address)
+    {
+        goto out;
+    }
+
+    /* Resolve what branches and LOOPs refer to as instruction numbers */
+    for (i = 0; i < count; ++i)
+    {
+        work[i] = insns[i];
+        if (insns[i].opcode == OPCODE_JUMP || insns[i].opcode == OPCODE_JALR)
+        {
+            compress = FALSE;
+            jumps = TRUE;
+        }
+
+        if (is_pc_relative(insns[i].opcode))
+        {
+            target[i] = i + insns[i].imm / 4;
+            if (insns[i].imm % 4 || target[i] < 0 || target[i] > count)
+            {
+                fprintf(stderr, "APEX_Error: %s at instruction %d branches outside the program\n",
+                        insns[i].opcode_str, i);
+                goto out;
+            }
+        }
+        else if (insns[i].opcode == OPCODE_LOOP)
+        {
+            target[i] = i + 1 + (insns[i].imm > 0 ? insns[i].imm : 0);
+            if (target[i] > count)
+            {
+                fprintf(stderr, "APEX_Error: LOOP at instruction %d runs past the end of the program\n",
+                        i);
+                goto out;
+            }
+        }
+    }
+
+    /* Start with everything as small as allowed, sizes only grow from here.
+     * The address array doubles as the size of each instruction until the
+     * layout is computed */
+    for (i = 0; i < count; ++i)
+    {
+        address[i + 1] = compress ? 2 : 4;
+    }
+
+    do
+    {
+        changed = FALSE;
+        for (i = 0; i < count; ++i)
+        {
+            address[i + 1] += address[i];
+        }
+
+        for (i = 0; i < count; ++i)
+        {
+            if (is_pc_relative(work[i].opcode))
+            {
+                work[i].imm = address[target[i]] - address[i];
+            }
+            else if (work[i].opcode == OPCODE_LOOP)
+            {
+                work[i].imm = address[target[i]] - address[i + 1];
+            }
+        }
+
+        /* Back to sizes, growing anything its current form cannot hold */
+        for (i = count; i > 0; --i)
+        {
+            address[i] -= address[i - 1];
+            while (address[i] < 8 && !encode(&work[i - 1], address[i], &bits))
+            {
+                address[i] *= 2;
+                changed = TRUE;
+            }
+        }
+    } while (changed);
+
+    for (i = 0; i < count; ++i)
+    {
+        address[i + 1] += address[i];
+    }
+
+    code = calloc(address[count] ? address[count] : 1, 1);
+    if (!code)
+    {
+        goto out;
+    }
+
+    for (i = 0; i < count; ++i)
+    {
+        if (!encode(&work[i], address[i + 1] - address[i], &bits))
+        {
+            fprintf(stderr, "APEX_Error: Branch offset of %s at instruction %d does not fit its encoding\n",
+                    work[i].opcode_str, i);
+            free(code);
+            code = NULL;
+            goto out;
+        }
+
+        if (jumps && address[i + 1] - address[i] == 8)
+        {
+            fprintf(stderr, "APEX_Error: %s at instruction %d needs a 64-bit form, which would move the JUMP targets after it\n",
+                    work[i].opcode_str, i);
+            free(code);
+            code = NULL;
+            goto out;
+        }
+
+        for (j = address[i]; j < address[i + 1]; ++j)
+        {
+            code[j] = bits & 0xff;
+            bits >>= 8;
+        }
+    }
+    *size = address[count];
+
+out:
+    free(work);
+    free(target);
+    free(address);
+    return code;
+}
@@ -0,0 +1,32 @@
+/*
+ * apex_isa.h
+ * Contains APEX instruction encoding declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_ISA_H_
+#define _APEX_ISA_H_
+
+#include "apex_macros.h"
+
+/* Format of an APEX instruction  */
+typedef struct APEX_Instruction
+{
+    char opcode_str[128];
+    int opcode;
+    int rd;
+    int rs1;
+    int rs2;
+    int imm;
+    int literal;                   /* Compared against by BEQL and friends */
+} APEX_Instruction;
+
+unsigned char *isa_assemble(const APEX_Instruction *insns, int count,
+                            int *size);
+unsigned long long isa_fetch(const unsigned char *code, int size, int offset,
+                             int *insn_size);
+int isa_opcode(unsigned long long bits);
+void isa_decode(unsigned long long bits, APEX_Instruction *ins);
+#endif
@@ -0,0 +1,71 @@
+/*
+ * apex_lvp.c
+ * Contains APEX load value predictor implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_lvp.h"
+#include "apex_macros.h"
+
+static LVP_Entry *
+lvp_entry(const Value_Predictor *vp, int pc)
+{
+    return (LVP_Entry *)&vp->table[((unsigned int)pc / 2) % LVP_TABLE_SIZE];
+}
+
+/* Returns TRUE and the next value in the load's sequence once it has been
+ * right LVP_CONFIDENCE times in a row */
+int
+lvp_predict(const Value_Predictor *vp, int pc, int *value)
+{
+    const LVP_Entry *entry = lvp_entry(vp, pc);
+
+    if (!entry->valid || entry->pc != pc || entry->confidence < LVP_CONFIDENCE)
+    {
+        return FALSE;
+    }
+
+    *value = entry->last_value + entry->stride;
+    return TRUE;
+}
+
+/*
+ * Trains the entry of a load PC with the value it actually read. A value
+ * off the sequence resets the confidence, since a wrong prediction costs
+ * far more than a missed one, and starts over with the new stride.
+ */
+void
+lvp_update(Value_Predictor *vp, int pc, int value)
+{
+    LVP_Entry *entry = lvp_entry(vp, pc);
+
+    if (!entry->valid || entry->pc != pc)
+    {
+        entry->valid = TRUE;
+        entry->pc = pc;
+        entry->last_value = value;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return;
+    }
+
+    if (value == entry->last_value + entry->stride)
+    {
+        if (entry->confidence < LVP_CONFIDENCE)
+        {
+            entry->confidence++;
+        }
+    }
+    else
+    {
+        entry->stride = value - entry->last_value;
+        entry->confidence = 0;
+    }
+    entry->last_value = value;
+}
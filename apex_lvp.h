@@ -0,0 +1,36 @@
+/*
+ * apex_lvp.h
+ * Contains APEX load value predictor declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_LVP_H_
+#define _APEX_LVP_H_
+
+#include "apex_macros.h"
+
+/* Value history of one load PC. A stride of 0 predicts the last value */
+typedef struct LVP_Entry
+{
+    int valid;
+    int pc;
+    int last_value;
+    int stride;
+    int confidence;                /* Correct predictions in a row */
+} LVP_Entry;
+
+typedef struct Value_Predictor
+{
+    LVP_Entry table[LVP_TABLE_SIZE];
+    int loads;                     /* Loads that could have been predicted */
+    int predictions;
+    int correct;
+    int replays;                   /* Instructions sent back to Decode */
+    int cycles_gained;             /* Dependents issued ahead of the value */
+} Value_Predictor;
+
+int lvp_predict(const Value_Predictor *vp, int pc, int *value);
+void lvp_update(Value_Predictor *vp, int pc, int value);
+#endif
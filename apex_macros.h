@@ -12,12 +12,185 @@
 #define FALSE 0x0
 #define TRUE 0x1
 
-/* Integers */
-#define DATA_MEMORY_SIZE 4096
+/* Data memory is sparse over the 32-bit address space. Pages hold
+ * 2^MEM_PAGE_BITS integers (4 KB), and each second level table maps
+ * 2^MEM_TABLE_BITS pages */
+#define MEM_PAGE_BITS 10
+#define MEM_TABLE_BITS 11
+
+/* Address distance between consecutive words laid out by the .word, .fill
+ * and .incbin directives, matching the LOADP/STOREP post-increment */
+#define DATA_WORD_STRIDE 4
+
+/* Maximum number of .incbin files mapped into data memory */
+#define MEM_MAX_REGIONS 16
+
+/* Set this flag to 1 to model address translation. Data accesses go
+ * through a D-TLB in Memory and instruction fetch through an I-TLB. A miss
+ * walks a VM_WALK_LEVELS deep page table whose entries are read through
+ * the data cache. Pages span 2^VM_PAGE_BITS addresses. The mapping itself
+ * is identity, only its timing is modelled */
+#define ENABLE_VIRTUAL_MEMORY 0
+#define VM_PAGE_BITS 10
+#define VM_WALK_LEVELS 2
+#define DTLB_ENTRIES 16
+#define ITLB_ENTRIES 8
+
+/* Address where the page table entries read by the walker live */
+#define PAGE_TABLE_BASE 0x7f000000
+
+/* Address of the first instruction, the PC every thread starts at */
+#define CODE_MEMORY_BASE 4000
+
+/* Functional runs (-f) translate basic blocks of up to DBT_MAX_BLOCK_INSNS
+ * instructions into host code, kept in a DBT_CACHE_SIZE byte code cache
+ * that is emptied when it or its DBT_MAX_BLOCKS block table fills up. A
+ * checking run compares the state with the interpreter's every
+ * DBT_CHECK_INSNS instructions */
+#define DBT_CACHE_SIZE (4 << 20)
+#define DBT_MAX_BLOCKS 8192
+#define DBT_MAX_BLOCK_INSNS 32
+#define DBT_CHECK_INSNS 1000
+
+/* Sampled runs (-s <error %>) fast-forward with the translator and time
+ * units of SAMPLE_UNIT_INSNS instructions spread evenly over the program,
+ * each after SAMPLE_WARMUP_INSNS detailed instructions. The first pass
+ * takes SAMPLE_INITIAL_COUNT units, later ones as many as the variation
+ * seen calls for, up to SAMPLE_MAX_PASSES passes. Confidence intervals are
+ * SAMPLE_CONFIDENCE_Z standard errors wide on either side, 3 is 99.7% */
+#define SAMPLE_UNIT_INSNS 1000
+#define SAMPLE_WARMUP_INSNS 2000
+#define SAMPLE_INITIAL_COUNT 50
+#define SAMPLE_MAX_PASSES 3
+#define SAMPLE_CONFIDENCE_Z 3.0
+
+/* Phase analysis (-b <points file>) splits a functional run into intervals
+ * of SIMPOINT_INTERVAL_INSNS instructions and counts the instructions each
+ * basic block ran in each of them. The vectors are projected down to
+ * SIMPOINT_DIMENSIONS random dimensions and clustered with k-means for
+ * every k up to SIMPOINT_MAX_K, keeping the best of SIMPOINT_SEEDS random
+ * starts. The smallest k whose BIC score is within SIMPOINT_BIC_THRESHOLD
+ * of the range from the worst to the best wins. Running the points
+ * (-p <points file>) starts SIMPOINT_WARMUP_INSNS ahead of each one */
+#define SIMPOINT_INTERVAL_INSNS 10000
+#define SIMPOINT_DIMENSIONS 15
+#define SIMPOINT_MAX_K 10
+#define SIMPOINT_SEEDS 5
+#define SIMPOINT_MAX_ITERATIONS 100
+#define SIMPOINT_BIC_THRESHOLD 0.9
+#define SIMPOINT_RANDOM_SEED 1
+#define SIMPOINT_WARMUP_INSNS 10000
 
 /* Size of integer register file */
 #define REG_FILE_SIZE 32
 
+/* Hardware threads sharing the pipeline. Each program file on the command
+ * line runs on its own thread, up to SMT_MAX_THREADS of them, and
+ * SMT_FETCH_POLICY picks the thread that fetches each cycle */
+#define SMT_MAX_THREADS 4
+#define FETCH_ROUND_ROBIN 0
+#define FETCH_ICOUNT 1
+#define SMT_FETCH_POLICY FETCH_ICOUNT
+
+/* Cores sharing one data memory. With -c <cores> on the command line the
+ * program files are split evenly across the cores, in order, and each core
+ * runs its share as hardware threads. Every thread starts with its core's
+ * number in CORE_ID_REG, so one program can divide the work. Cache misses
+ * of all cores queue for one bus to memory, and each line transfer holds
+ * it for BUS_LINE_CYCLES. The private data caches are kept coherent with
+ * MESI by snooping that bus, an upgrade of a shared line to write it only
+ * needs the address and holds the bus for BUS_UPGRADE_CYCLES */
+#define MAX_CORES 8
+#define CORE_ID_REG 31
+#define BUS_LINE_CYCLES 4
+#define BUS_UPGRADE_CYCLES 1
+
+/* Set this flag to 1 to let the loader use 16-bit encodings for the
+ * instructions that have one, see apex_isa.c. Everything else takes 32 bits */
+#define ENABLE_COMPRESSED_ISA 1
+
+/* Set this flag to 1 to let Decode fuse a CMP/CML with the flag branch
+ * right after it, so the pair takes a single pipeline slot */
+#define ENABLE_MACRO_FUSION 1
+
+/* Set this flag to 1 to enable the loop buffer. A taken backward branch
+ * whose body fits in LOOP_BUFFER_SIZE 32-bit instructions is captured on
+ * its next iteration, then Fetch replays it without reading code memory */
+#define ENABLE_LOOP_BUFFER 1
+#define LOOP_BUFFER_SIZE 16
+
+/* Maximum nesting depth of LOOP hardware loops */
+#define HW_LOOP_DEPTH 4
+
+/* Cycles MUL and MAC spend in Execute, every other operation takes one */
+#define MUL_LATENCY 3
+
+/* Vector register file, each register holds VECTOR_LENGTH integers */
+#define VECTOR_REG_FILE_SIZE 8
+#define VECTOR_LENGTH 4
+
+/* Data cache geometry, line size is counted in data memory locations */
+#define DCACHE_NUM_SETS 16
+#define DCACHE_ASSOC 2
+#define DCACHE_LINE_SIZE 16
+
+/* Cycles taken by memory to service a data cache miss */
+#define DCACHE_MISS_LATENCY 20
+
+/* Number of miss status holding registers, and the number of loads each
+ * one can hold while its line is in flight */
+#define NUM_MSHRS 4
+#define MSHR_MAX_TARGETS 4
+
+/* Set this flag to 1 to enable runahead execution. When Decode is blocked
+ * by a load miss with at least RUNAHEAD_MIN_CYCLES left, the thread
+ * checkpoints its registers and runs ahead with the missing values marked
+ * invalid, so the misses it meets become prefetches. It returns to the
+ * blocked instruction when the miss is filled */
+#define ENABLE_RUNAHEAD 1
+#define RUNAHEAD_MIN_CYCLES 8
+
+/* Set this flag to 1 to enable load value prediction. Once the values a
+ * LOAD/LOADP returns have followed a fixed stride LVP_CONFIDENCE times in
+ * a row, Decode hands the next one to its dependents. Memory checks it,
+ * and a dependent that read a wrong value goes back to Decode */
+#define ENABLE_VALUE_PREDICTION 1
+#define LVP_TABLE_SIZE 32
+#define LVP_CONFIDENCE 3
+
+/* Set this flag to 1 to let stores retire into a store buffer that drains
+ * to the data cache in the background */
+#define ENABLE_STORE_BUFFER 1
+#define STORE_BUFFER_SIZE 8
+
+/* Set this flag to 1 to enable the PC indexed stride prefetcher. Once a
+ * load repeats its stride, lines PREFETCH_DISTANCE to PREFETCH_DISTANCE +
+ * PREFETCH_DEGREE - 1 strides ahead are fetched into the data cache */
+#define ENABLE_STRIDE_PREFETCHER 1
+#define PREFETCH_TABLE_SIZE 16
+#define PREFETCH_DISTANCE 4
+#define PREFETCH_DEGREE 2
+
+/* Set this flag to 1 to enable a sequential stream buffer, started on a
+ * load miss and holding the next STREAM_BUFFER_DEPTH lines */
+#define ENABLE_STREAM_BUFFER 0
+#define STREAM_BUFFER_DEPTH 4
+
+/* Set this flag to 1 to turn SCRATCHPAD_SIZE addresses from SCRATCHPAD_BASE
+ * into a software managed scratchpad. Its loads and stores bypass the data
+ * cache and always take SCRATCHPAD_LATENCY cycles in Memory */
+#define ENABLE_SCRATCHPAD 1
+#define SCRATCHPAD_BASE 0x8000
+#define SCRATCHPAD_SIZE 0x1000
+#define SCRATCHPAD_LATENCY 1
+
+/* DMA engine behind COPY. Transfers run one at a time in the background,
+ * each starts after DMA_SETUP_LATENCY cycles and then moves
+ * DMA_WORDS_PER_CYCLE words every cycle */
+#define DMA_QUEUE_SIZE 4
+#define DMA_SETUP_LATENCY DCACHE_MISS_LATENCY
+#define DMA_WORDS_PER_CYCLE 1
+
 /* Numeric OPCODE identifiers for instructions */
 #define OPCODE_ADD 0x0
 #define OPCODE_SUB 0x1
@@ -45,6 +218,29 @@
 #define OPCODE_BNN 0x17
 #define OPCODE_JUMP 0x18
 #define OPCODE_JALR 0x19
+#define OPCODE_PREFETCH 0x1a
+#define OPCODE_COPY 0x1b
+#define OPCODE_DMAWAIT 0x1c
+#define OPCODE_VLOAD 0x1d
+#define OPCODE_VSTORE 0x1e
+#define OPCODE_VADD 0x1f
+#define OPCODE_VMUL 0x20
+#define OPCODE_VRED 0x21
+#define OPCODE_MAC 0x22
+#define OPCODE_SHADD 0x23
+#define OPCODE_CMOVZ 0x24
+#define OPCODE_CMOVNZ 0x25
+#define OPCODE_CMOVP 0x26
+#define OPCODE_CMOVN 0x27
+#define OPCODE_BEQ 0x28
+#define OPCODE_BNE 0x29
+#define OPCODE_BLT 0x2a
+#define OPCODE_BGE 0x2b
+#define OPCODE_BEQL 0x2c
+#define OPCODE_BNEL 0x2d
+#define OPCODE_BLTL 0x2e
+#define OPCODE_BGEL 0x2f
+#define OPCODE_LOOP 0x30
 
 /* Set this flag to 1 to enable debug messages */
 #define ENABLE_DEBUG_MESSAGES 1
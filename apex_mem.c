@@ -0,0 +1,492 @@
+/*
+ * apex_mem.c
+ * Contains APEX sparse data memory implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "apex_mem.h"
+#include "apex_macros.h"
+
+/* Copies the words of a mapped file that land in this page */
+static void
+load_page_from_region(const Mem_Region *region, unsigned int page_number,
+                      int *page)
+{
+    unsigned int first = page_number << MEM_PAGE_BITS;
+    unsigned int address, i;
+
+    for (i = 0; i < MEM_PAGE_SIZE; ++i)
+    {
+        address = first + i;
+        if (address >= region->base
+            && (address - region->base) % DATA_WORD_STRIDE == 0
+            && (address - region->base) / DATA_WORD_STRIDE < region->count)
+        {
+            page[i] = region->words[(address - region->base) / DATA_WORD_STRIDE];
+        }
+    }
+}
+
+/* Returns TRUE if any word of the region lands in this page */
+static int
+region_covers_page(const Mem_Region *region, unsigned int page_number)
+{
+    unsigned long long first = (unsigned long long)page_number << MEM_PAGE_BITS;
+    unsigned long long end = (unsigned long long)region->base
+                             + (unsigned long long)region->count * DATA_WORD_STRIDE;
+
+    return region->count && first + MEM_PAGE_SIZE > region->base && first < end;
+}
+
+/*
+ * Walks the page table for a page number. Missing tables and pages are
+ * created when allocate is set, otherwise NULL is returned for them. A page
+ * covered by a mapped file is always created, filled from the mapping. The
+ * page found becomes the last page used.
+ */
+int *
+mem_page_lookup(Data_Memory *mem, unsigned int page_number, int allocate)
+{
+    int ***table = &mem->directory[page_number >> MEM_TABLE_BITS];
+    int **page;
+    int i;
+
+    for (i = 0; !allocate && i < mem->num_regions; ++i)
+    {
+        allocate = region_covers_page(&mem->regions[i], page_number);
+    }
+
+    if (!*table)
+    {
+        if (!allocate)
+        {
+            return NULL;
+        }
+
+        *table = calloc(MEM_TABLE_SIZE, sizeof(int *));
+        if (!*table)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for page table\n");
+            exit(1);
+        }
+    }
+
+    page = &(*table)[page_number & (MEM_TABLE_SIZE - 1)];
+    if (!*page)
+    {
+        if (!allocate)
+        {
+            return NULL;
+        }
+
+        *page = calloc(MEM_PAGE_SIZE, sizeof(int));
+        if (!*page)
+        {
+            fprintf(stderr, "APEX_Error: Out of memory for data page\n");
+            exit(1);
+        }
+        mem->pages_allocated++;
+
+        for (i = 0; i < mem->num_regions; ++i)
+        {
+            if (region_covers_page(&mem->regions[i], page_number))
+            {
+                load_page_from_region(&mem->regions[i], page_number, *page);
+            }
+        }
+    }
+
+    mem->last_page_number = page_number;
+    mem->last_page = *page;
+    return *page;
+}
+
+/*
+ * Maps a binary file of native 32-bit words at address. Nothing is copied
+ * here, pages pick up their words from the mapping when first touched.
+ * Pages that already exist take the file's words now. Returns the number
+ * of words in the file, or -1 if it cannot be mapped.
+ */
+int
+mem_map_file(Data_Memory *mem, int address, const char *path)
+{
+    Mem_Region *region;
+    struct stat st;
+    unsigned int page_number, last_page_number;
+    int **table;
+    void *map;
+    int fd;
+
+    if (mem->num_regions == MEM_MAX_REGIONS)
+    {
+        fprintf(stderr, "APEX_Error: Too many .incbin files, limit is %d\n",
+                MEM_MAX_REGIONS);
+        return -1;
+    }
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) < 0)
+    {
+        fprintf(stderr, "APEX_Error: Unable to open %s\n", path);
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        return -1;
+    }
+
+    region = &mem->regions[mem->num_regions];
+    region->base = (unsigned int)address;
+    region->count = st.st_size / sizeof(int);
+    region->map_length = st.st_size;
+    region->words = NULL;
+    if (region->count)
+    {
+        map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED)
+        {
+            fprintf(stderr, "APEX_Error: Unable to map %s\n", path);
+            close(fd);
+            return -1;
+        }
+        region->words = map;
+    }
+    close(fd);
+    mem->num_regions++;
+
+    if (!region->count)
+    {
+        return 0;
+    }
+
+    page_number = region->base >> MEM_PAGE_BITS;
+    last_page_number = (unsigned int)((region->base
+                                       + (unsigned long long)(region->count - 1)
+                                             * DATA_WORD_STRIDE)
+                                      >> MEM_PAGE_BITS);
+    for (;; ++page_number)
+    {
+        table = mem->directory[page_number >> MEM_TABLE_BITS];
+        if (table && table[page_number & (MEM_TABLE_SIZE - 1)])
+        {
+            load_page_from_region(region, page_number,
+                                  table[page_number & (MEM_TABLE_SIZE - 1)]);
+        }
+
+        if (page_number == last_page_number)
+        {
+            break;
+        }
+    }
+
+    return region->count;
+}
+
+void
+mem_free(Data_Memory *mem)
+{
+    int i, j;
+
+    for (i = 0; i < mem->num_regions; ++i)
+    {
+        if (mem->regions[i].words)
+        {
+            munmap((void *)mem->regions[i].words, mem->regions[i].map_length);
+        }
+    }
+
+    for (i = 0; i < MEM_DIRECTORY_SIZE; ++i)
+    {
+        if (!mem->directory[i])
+        {
+            continue;
+        }
+
+        for (j = 0; j < MEM_TABLE_SIZE; ++j)
+        {
+            free(mem->directory[i][j]);
+        }
+        free(mem->directory[i]);
+    }
+
+    memset(mem, 0, sizeof(Data_Memory));
+}
+
+/*
+ * Reads a location without changing anything, not even the last page used,
+ * so several threads can read at once. Words of a mapped file that no page
+ * holds yet come straight from the mapping.
+ */
+int
+mem_peek(const Data_Memory *mem, int address)
+{
+    unsigned int page_number = (unsigned int)address >> MEM_PAGE_BITS;
+    int **table = mem->directory[page_number >> MEM_TABLE_BITS];
+    const Mem_Region *region;
+    unsigned int offset;
+    int i;
+
+    if (table && table[page_number & (MEM_TABLE_SIZE - 1)])
+    {
+        return table[page_number & (MEM_TABLE_SIZE - 1)]
+                    [(unsigned int)address & (MEM_PAGE_SIZE - 1)];
+    }
+
+    for (i = mem->num_regions - 1; i >= 0; --i)
+    {
+        region = &mem->regions[i];
+        offset = (unsigned int)address - region->base;
+        if ((unsigned int)address >= region->base
+            && offset % DATA_WORD_STRIDE == 0
+            && offset / DATA_WORD_STRIDE < region->count)
+        {
+            return region->words[offset / DATA_WORD_STRIDE];
+        }
+    }
+
+    return 0;
+}
+
+/* Returns TRUE when one page is allocated in mem and reads the same from
+ * other */
+static int
+page_equal(const Data_Memory *mem, const Data_Memory *other, int i, int j)
+{
+    unsigned int base = ((unsigned int)i << MEM_TABLE_BITS | j) << MEM_PAGE_BITS;
+    int k;
+
+    for (k = 0; k < MEM_PAGE_SIZE; ++k)
+    {
+        if (mem->directory[i][j][k] != mem_peek(other, (int)(base + k)))
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+/* Checks whether two memories hold the same values everywhere, whichever
+ * pages each has allocated */
+int
+mem_equal(const Data_Memory *a, const Data_Memory *b)
+{
+    int i, j;
+
+    for (i = 0; i < MEM_DIRECTORY_SIZE; ++i)
+    {
+        for (j = 0; j < MEM_TABLE_SIZE; ++j)
+        {
+            if ((a->directory[i] && a->directory[i][j]
+                 && !page_equal(a, b, i, j))
+                || (b->directory[i] && b->directory[i][j]
+                    && !page_equal(b, a, i, j)))
+            {
+                return FALSE;
+            }
+
+            if (!a->directory[i] && !b->directory[i])
+            {
+                break;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+/* Returns the slot holding address, or the free slot it would take */
+static int
+log_slot(const Mem_Log *log, int address)
+{
+    unsigned int slot = ((unsigned int)address * 2654435761u)
+                        & (log->capacity - 1);
+
+    while (log->used[slot] && log->addresses[slot] != address)
+    {
+        slot = (slot + 1) & (log->capacity - 1);
+    }
+
+    return slot;
+}
+
+/* Reads a location as the core owning the log sees it, its own held back
+ * stores first */
+int
+mem_log_read(const Data_Memory *mem, const Mem_Log *log, int address)
+{
+    int slot;
+
+    if (log->count)
+    {
+        slot = log_slot(log, address);
+        if (log->used[slot])
+        {
+            return log->values[slot];
+        }
+    }
+
+    return mem_peek(mem, address);
+}
+
+/* Doubles the hash, keeping the order the locations were first stored */
+static void
+log_grow(Mem_Log *log)
+{
+    Mem_Log old = *log;
+    int i, slot;
+
+    log->capacity = old.capacity ? old.capacity * 2 : 64;
+    log->addresses = malloc(log->capacity * sizeof(int));
+    log->values = malloc(log->capacity * sizeof(int));
+    log->used = calloc(log->capacity, 1);
+    log->slots = malloc(log->capacity * sizeof(int));
+    if (!log->addresses || !log->values || !log->used || !log->slots)
+    {
+        fprintf(stderr, "APEX_Error: Out of memory for store log\n");
+        exit(1);
+    }
+
+    for (i = 0; i < old.count; ++i)
+    {
+        slot = log_slot(log, old.addresses[old.slots[i]]);
+        log->used[slot] = TRUE;
+        log->addresses[slot] = old.addresses[old.slots[i]];
+        log->values[slot] = old.values[old.slots[i]];
+        log->slots[i] = slot;
+    }
+    mem_log_free(&old);
+}
+
+void
+mem_log_write(Mem_Log *log, int address, int value)
+{
+    int slot;
+
+    if (2 * (log->count + 1) > log->capacity)
+    {
+        log_grow(log);
+    }
+
+    slot = log_slot(log, address);
+    if (!log->used[slot])
+    {
+        log->used[slot] = TRUE;
+        log->addresses[slot] = address;
+        log->slots[log->count++] = slot;
+    }
+    log->values[slot] = value;
+}
+
+/* Writes the held back stores to data memory and empties the log */
+void
+mem_log_commit(Mem_Log *log, Data_Memory *mem)
+{
+    int i, slot;
+
+    for (i = 0; i < log->count; ++i)
+    {
+        slot = log->slots[i];
+        mem_write(mem, log->addresses[slot], log->values[slot]);
+        log->used[slot] = FALSE;
+    }
+    log->count = 0;
+}
+
+/* Empties the log without writing anything to data memory */
+void
+mem_log_discard(Mem_Log *log)
+{
+    int i;
+
+    for (i = 0; i < log->count; ++i)
+    {
+        log->used[log->slots[i]] = FALSE;
+    }
+    log->count = 0;
+}
+
+void
+mem_log_free(Mem_Log *log)
+{
+    free(log->addresses);
+    free(log->values);
+    free(log->used);
+    free(log->slots);
+}
+
+/* Copies every allocated page of mem. Returns FALSE when out of memory */
+int
+mem_snapshot(const Data_Memory *mem, Mem_Snapshot *snapshot)
+{
+    int i, j, n = 0, size = mem->pages_allocated + 1;
+
+    memset(snapshot, 0, sizeof(Mem_Snapshot));
+    snapshot->page_numbers = malloc(size * sizeof(unsigned int));
+    snapshot->pages = malloc(size * sizeof(int *));
+    if (!snapshot->page_numbers || !snapshot->pages)
+    {
+        mem_snapshot_free(snapshot);
+        return FALSE;
+    }
+
+    for (i = 0; i < MEM_DIRECTORY_SIZE; ++i)
+    {
+        for (j = 0; mem->directory[i] && j < MEM_TABLE_SIZE; ++j)
+        {
+            if (!mem->directory[i][j])
+            {
+                continue;
+            }
+
+            snapshot->pages[n] = malloc(MEM_PAGE_SIZE * sizeof(int));
+            if (!snapshot->pages[n])
+            {
+                mem_snapshot_free(snapshot);
+                return FALSE;
+            }
+            memcpy(snapshot->pages[n], mem->directory[i][j],
+                   MEM_PAGE_SIZE * sizeof(int));
+            snapshot->page_numbers[n] = (unsigned int)i << MEM_TABLE_BITS | j;
+            snapshot->count = ++n;
+        }
+    }
+
+    return TRUE;
+}
+
+void
+mem_restore(Data_Memory *mem, const Mem_Snapshot *snapshot)
+{
+    int i;
+
+    for (i = 0; i < snapshot->count; ++i)
+    {
+        memcpy(mem_page_lookup(mem, snapshot->page_numbers[i], TRUE),
+               snapshot->pages[i], MEM_PAGE_SIZE * sizeof(int));
+    }
+}
+
+void
+mem_snapshot_free(Mem_Snapshot *snapshot)
+{
+    int i;
+
+    for (i = 0; i < snapshot->count; ++i)
+    {
+        free(snapshot->pages[i]);
+    }
+    free(snapshot->pages);
+    free(snapshot->page_numbers);
+    memset(snapshot, 0, sizeof(Mem_Snapshot));
+}
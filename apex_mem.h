@@ -0,0 +1,119 @@
+/*
+ * apex_mem.h
+ * Contains APEX sparse data memory declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_MEM_H_
+#define _APEX_MEM_H_
+
+#include <stddef.h>
+
+#include "apex_macros.h"
+
+#define MEM_PAGE_SIZE (1 << MEM_PAGE_BITS)
+#define MEM_TABLE_SIZE (1 << MEM_TABLE_BITS)
+#define MEM_DIRECTORY_SIZE (1 << (32 - MEM_PAGE_BITS - MEM_TABLE_BITS))
+
+/* Binary file mapped into data memory by .incbin. Its words are read
+ * straight from the mapping when a page covering them is first touched */
+typedef struct Mem_Region
+{
+    unsigned int base;
+    unsigned int count;            /* Words in the file */
+    const int *words;
+    size_t map_length;
+} Mem_Region;
+
+/*
+ * Sparse model of the 32-bit data address space. A directory points to
+ * tables of page pointers, and pages are only allocated when first
+ * written, so memory costs only what the program touches. The last page
+ * used is kept aside so streaming accesses skip the table walk.
+ */
+typedef struct Data_Memory
+{
+    int **directory[MEM_DIRECTORY_SIZE];
+    unsigned int last_page_number;
+    int *last_page;
+    int pages_allocated;
+    Mem_Region regions[MEM_MAX_REGIONS];
+    int num_regions;
+} Data_Memory;
+
+/*
+ * Stores of one core held back while the cores run in parallel, and
+ * written to data memory in core order once they stop. Memory itself is
+ * then only read while they run, and every run sees the other cores'
+ * stores in the same order. A hash on the address keeps the last value
+ * stored to each location.
+ */
+typedef struct Mem_Log
+{
+    int *addresses;
+    int *values;
+    char *used;
+    int *slots;                    /* Used slots, in the order first stored */
+    int count;
+    int capacity;                  /* Power of two, 0 before the first store */
+} Mem_Log;
+
+/* Copy of the allocated pages of a data memory. Restored into memory
+ * that holds the same program, it gives the same values everywhere */
+typedef struct Mem_Snapshot
+{
+    unsigned int *page_numbers;
+    int **pages;
+    int count;
+} Mem_Snapshot;
+
+int *mem_page_lookup(Data_Memory *mem, unsigned int page_number, int allocate);
+int mem_map_file(Data_Memory *mem, int address, const char *path);
+void mem_free(Data_Memory *mem);
+int mem_peek(const Data_Memory *mem, int address);
+int mem_equal(const Data_Memory *a, const Data_Memory *b);
+int mem_log_read(const Data_Memory *mem, const Mem_Log *log, int address);
+void mem_log_write(Mem_Log *log, int address, int value);
+void mem_log_commit(Mem_Log *log, Data_Memory *mem);
+void mem_log_discard(Mem_Log *log);
+void mem_log_free(Mem_Log *log);
+int mem_snapshot(const Data_Memory *mem, Mem_Snapshot *snapshot);
+void mem_restore(Data_Memory *mem, const Mem_Snapshot *snapshot);
+void mem_snapshot_free(Mem_Snapshot *snapshot);
+
+/* Reads a location, untouched memory outside mapped files reads as zero */
+static inline int
+mem_read(Data_Memory *mem, int address)
+{
+    unsigned int page_number = (unsigned int)address >> MEM_PAGE_BITS;
+    int *page = mem->last_page;
+
+    if (!page || page_number != mem->last_page_number)
+    {
+        page = mem_page_lookup(mem, page_number, FALSE);
+        if (!page)
+        {
+            return 0;
+        }
+    }
+
+    return page[(unsigned int)address & (MEM_PAGE_SIZE - 1)];
+}
+
+/* Writes a location, allocating its page on first touch */
+static inline void
+mem_write(Data_Memory *mem, int address, int value)
+{
+    unsigned int page_number = (unsigned int)address >> MEM_PAGE_BITS;
+    int *page = mem->last_page;
+
+    if (!page || page_number != mem->last_page_number)
+    {
+        page = mem_page_lookup(mem, page_number, TRUE);
+    }
+
+    page[(unsigned int)address & (MEM_PAGE_SIZE - 1)] = value;
+}
+#endif
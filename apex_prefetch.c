@@ -0,0 +1,107 @@
+/*
+ * apex_prefetch.c
+ * Contains APEX stride prefetcher and stream buffer implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_prefetch.h"
+#include "apex_macros.h"
+
+/*
+ * Trains the table entry of a load PC with the address it just accessed.
+ * Once the same non-zero stride has been seen twice in a row, fills
+ * addresses with the locations to prefetch and returns how many there are.
+ */
+int
+prefetch_train(Prefetcher *pf, int pc, int address, int *addresses)
+{
+    Stride_Entry *entry = &pf->table[(pc / 4) % PREFETCH_TABLE_SIZE];
+    int stride, i;
+
+    if (!entry->valid || entry->pc != pc)
+    {
+        entry->valid = TRUE;
+        entry->pc = pc;
+        entry->last_address = address;
+        entry->stride = 0;
+        entry->confidence = 0;
+        return 0;
+    }
+
+    stride = address - entry->last_address;
+    entry->last_address = address;
+    if (stride != 0 && stride == entry->stride)
+    {
+        if (entry->confidence < 3)
+        {
+            entry->confidence++;
+        }
+    }
+    else
+    {
+        if (entry->confidence > 0)
+        {
+            entry->confidence--;
+        }
+        if (entry->confidence == 0)
+        {
+            entry->stride = stride;
+        }
+    }
+
+    if (entry->confidence < 2)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < PREFETCH_DEGREE; ++i)
+    {
+        addresses[i] = address + entry->stride * (PREFETCH_DISTANCE + i);
+    }
+    return PREFETCH_DEGREE;
+}
+
+Stream_Entry *
+stream_buffer_find(Prefetcher *pf, int line)
+{
+    int i;
+
+    for (i = 0; i < STREAM_BUFFER_DEPTH; ++i)
+    {
+        if (pf->stream[i].valid && pf->stream[i].line == line)
+        {
+            return &pf->stream[i];
+        }
+    }
+
+    return NULL;
+}
+
+/* Restarts the stream at the line after a miss that the buffer did not hold */
+void
+stream_buffer_start(Prefetcher *pf, int line, int ready_cycle)
+{
+    int i;
+
+    pf->next_stream_line = line + 1;
+    for (i = 0; i < STREAM_BUFFER_DEPTH; ++i)
+    {
+        pf->stream[i].valid = TRUE;
+        pf->stream[i].line = pf->next_stream_line++;
+        pf->stream[i].ready_cycle = ready_cycle;
+    }
+}
+
+/* Hands out a line to the cache and reuses its slot for the next one */
+void
+stream_buffer_advance(Prefetcher *pf, Stream_Entry *entry, int ready_cycle)
+{
+    entry->line = pf->next_stream_line++;
+    entry->ready_cycle = ready_cycle;
+}
@@ -0,0 +1,48 @@
+/*
+ * apex_prefetch.h
+ * Contains APEX data prefetcher declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_PREFETCH_H_
+#define _APEX_PREFETCH_H_
+
+#include "apex_macros.h"
+
+/* Reference prediction table entry, one per load PC */
+typedef struct Stride_Entry
+{
+    int valid;
+    int pc;
+    int last_address;
+    int stride;
+    int confidence;                /* Saturating, prefetch once it reaches 2 */
+} Stride_Entry;
+
+/* Line held by the stream buffer, usable once ready_cycle is reached */
+typedef struct Stream_Entry
+{
+    int valid;
+    int line;
+    int ready_cycle;
+} Stream_Entry;
+
+typedef struct Prefetcher
+{
+    Stride_Entry table[PREFETCH_TABLE_SIZE];
+    Stream_Entry stream[STREAM_BUFFER_DEPTH];
+    int next_stream_line;          /* Next sequential line to stream in */
+    int issued;                    /* Prefetches sent to memory */
+    int dropped;                   /* Prefetches skipped for lack of MSHRs */
+    int late;                      /* Demand misses caught a prefetch in flight */
+    int stream_hits;               /* Demand misses served by the stream buffer */
+    int stream_late;               /* Found their line still streaming in */
+} Prefetcher;
+
+int prefetch_train(Prefetcher *pf, int pc, int address, int *addresses);
+Stream_Entry *stream_buffer_find(Prefetcher *pf, int line);
+void stream_buffer_start(Prefetcher *pf, int line, int ready_cycle);
+void stream_buffer_advance(Prefetcher *pf, Stream_Entry *entry, int ready_cycle);
+#endif
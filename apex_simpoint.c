@@ -0,0 +1,503 @@
+/*
+ * apex_simpoint.c
+ * Contains APEX phase analysis, which picks the intervals of a program
+ * worth simulating in detail, as SimPoint does
+ *
+ * A functional run is cut into intervals of equal instruction count, each
+ * summed up by its basic block vector: the instructions every basic block
+ * ran in it, over the length of the interval. Intervals with close vectors
+ * run the same code in the same proportions and behave alike, so
+ * clustering them finds the phases of the program. The vectors are first
+ * projected onto a few random dimensions, which roughly keeps distances
+ * and makes k-means cheap. The interval closest to the centre of each
+ * cluster becomes a simulation point, weighted by the cluster's share of
+ * the run.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_isa.h"
+#include "apex_macros.h"
+#include "apex_simpoint.h"
+
+#define DIMS SIMPOINT_DIMENSIONS
+
+/* Projected basic block vectors of the intervals of a run */
+typedef struct BBV_Profile
+{
+    double *vectors;               /* DIMS values per interval */
+    int *insns;                    /* Instructions each interval ran */
+    int count;
+    int capacity;
+    int blocks;                    /* Basic blocks seen */
+} BBV_Profile;
+
+/* xorshift64*, so runs pick the same points on every host */
+static unsigned long long
+next_random(unsigned long long *seed)
+{
+    *seed ^= *seed >> 12;
+    *seed ^= *seed << 25;
+    *seed ^= *seed >> 27;
+    return *seed * 2685821657736338717ULL;
+}
+
+/* Uniform in [-1, 1) */
+static double
+random_unit(unsigned long long *seed)
+{
+    return (next_random(seed) >> 11) * (2.0 / 9007199254740992.0) - 1.0;
+}
+
+static double
+distance(const double *a, const double *b)
+{
+    double sum = 0.0, d;
+    int i;
+
+    for (i = 0; i < DIMS; ++i)
+    {
+        d = a[i] - b[i];
+        sum += d * d;
+    }
+
+    return sum;
+}
+
+/*
+ * Runs the program to HALT with the interpreter, and projects the basic
+ * block vector of every interval. A basic block starts wherever control
+ * does not simply fall through, and its instructions count towards it. The
+ * first time a block is seen it gets a random row of the projection
+ * matrix. Returns FALSE when out of memory.
+ */
+static int
+profile_run(Func_State *state, int interval_insns, BBV_Profile *profile)
+{
+    int size = state->code_memory_size;
+    int *ids = malloc((size + 1) * sizeof(int));
+    int *counts = calloc(size + 1, sizeof(int));
+    int *touched = malloc((size + 1) * sizeof(int));
+    double *rows = malloc((size + 1) * DIMS * sizeof(double));
+    unsigned long long seed = SIMPOINT_RANDOM_SEED;
+    int num_touched = 0, in_interval = 0, block = -1, pc, insn_size, i, d;
+    int offset, ok = ids && counts && touched && rows;
+    double *vector;
+
+    for (i = 0; ok && i <= size; ++i)
+    {
+        ids[i] = -1;
+    }
+
+    while (ok && !state->halted)
+    {
+        /* Code past the end reads as NOPs, lumped into one block */
+        if (block < 0)
+        {
+            offset = state->pc - CODE_MEMORY_BASE;
+            offset = (offset < 0 || offset > size) ? size : offset;
+            if (ids[offset] < 0)
+            {
+                ids[offset] = profile->blocks++;
+                for (d = 0; d < DIMS; ++d)
+                {
+                    rows[ids[offset] * DIMS + d] = random_unit(&seed);
+                }
+            }
+            block = ids[offset];
+        }
+
+        pc = state->pc;
+        isa_fetch(state->code_memory, size, pc - CODE_MEMORY_BASE, &insn_size);
+        func_step(state);
+        if (!counts[block]++)
+        {
+            touched[num_touched++] = block;
+        }
+
+        if (state->pc != pc + insn_size)
+        {
+            block = -1;
+        }
+
+        if (++in_interval < interval_insns && !state->halted)
+        {
+            continue;
+        }
+
+        if (profile->count == profile->capacity)
+        {
+            profile->capacity = profile->capacity ? 2 * profile->capacity : 256;
+            profile->vectors = realloc(profile->vectors,
+                                       profile->capacity * DIMS * sizeof(double));
+            profile->insns = realloc(profile->insns,
+                                     profile->capacity * sizeof(int));
+            if (!profile->vectors || !profile->insns)
+            {
+                ok = FALSE;
+                break;
+            }
+        }
+
+        vector = &profile->vectors[profile->count * DIMS];
+        memset(vector, 0, DIMS * sizeof(double));
+        for (i = 0; i < num_touched; ++i)
+        {
+            for (d = 0; d < DIMS; ++d)
+            {
+                vector[d] += counts[touched[i]] * rows[touched[i] * DIMS + d];
+            }
+            counts[touched[i]] = 0;
+        }
+        for (d = 0; d < DIMS; ++d)
+        {
+            vector[d] /= in_interval;
+        }
+        profile->insns[profile->count++] = in_interval;
+        num_touched = 0;
+        in_interval = 0;
+    }
+
+    free(ids);
+    free(counts);
+    free(touched);
+    free(rows);
+    return ok;
+}
+
+/*
+ * Clusters the intervals around k centres from k distinct random intervals,
+ * moving each centre to the mean of its members until no interval changes
+ * cluster. A cluster left empty keeps its centre. Returns the sum of
+ * squared distances to the centres.
+ */
+static double
+kmeans(const BBV_Profile *profile, int k, unsigned long long *seed,
+       double *centers, int *assign, int *sizes)
+{
+    const double *vector;
+    double best, d, sse = 0.0;
+    int changed = TRUE, iteration, i, j, c, n = profile->count;
+
+    for (c = 0; c < k; ++c)
+    {
+        do
+        {
+            i = (int)(next_random(seed) % n);
+            for (j = 0; j < c && assign[j] != i; ++j)
+            {
+            }
+        } while (j < c);
+        assign[c] = i;
+    }
+    for (c = 0; c < k; ++c)
+    {
+        memcpy(&centers[c * DIMS], &profile->vectors[assign[c] * DIMS],
+               DIMS * sizeof(double));
+    }
+    for (i = 0; i < n; ++i)
+    {
+        assign[i] = -1;
+    }
+
+    for (iteration = 0; changed && iteration < SIMPOINT_MAX_ITERATIONS;
+         ++iteration)
+    {
+        changed = FALSE;
+        for (i = 0; i < n; ++i)
+        {
+            vector = &profile->vectors[i * DIMS];
+            best = -1.0;
+            for (c = 0, j = 0; c < k; ++c)
+            {
+                d = distance(vector, &centers[c * DIMS]);
+                if (best < 0.0 || d < best)
+                {
+                    best = d;
+                    j = c;
+                }
+            }
+            if (assign[i] != j)
+            {
+                assign[i] = j;
+                changed = TRUE;
+            }
+        }
+
+        memset(sizes, 0, k * sizeof(int));
+        for (i = 0; i < n; ++i)
+        {
+            sizes[assign[i]]++;
+        }
+        for (c = 0; c < k; ++c)
+        {
+            if (sizes[c])
+            {
+                memset(&centers[c * DIMS], 0, DIMS * sizeof(double));
+            }
+        }
+        for (i = 0; i < n; ++i)
+        {
+            for (j = 0; j < DIMS; ++j)
+            {
+                centers[assign[i] * DIMS + j]
+                    += profile->vectors[i * DIMS + j] / sizes[assign[i]];
+            }
+        }
+    }
+
+    for (i = 0; i < n; ++i)
+    {
+        sse += distance(&profile->vectors[i * DIMS],
+                        &centers[assign[i] * DIMS]);
+    }
+
+    return sse;
+}
+
+/*
+ * Bayesian information criterion of a clustering, the log likelihood of
+ * the intervals under spherical Gaussians around the centres with one
+ * shared variance, less a penalty for the parameters of k clusters
+ */
+static double
+bic(int n, int k, const int *sizes, double sse)
+{
+    double variance, likelihood = 0.0;
+    int c, free_points = (n > k) ? n - k : 1;
+
+    variance = sse / ((double)DIMS * free_points);
+    if (variance < 1e-12)
+    {
+        variance = 1e-12;
+    }
+
+    for (c = 0; c < k; ++c)
+    {
+        if (sizes[c])
+        {
+            likelihood += sizes[c] * log((double)sizes[c] / n);
+        }
+    }
+    likelihood -= n * DIMS / 2.0 * log(2.0 * M_PI * variance);
+    likelihood -= sse / (2.0 * variance);
+
+    return likelihood - ((k - 1) + k * DIMS + 1) / 2.0 * log((double)n);
+}
+
+static int
+compare_points(const void *a, const void *b)
+{
+    return ((const Sim_Point *)a)->interval - ((const Sim_Point *)b)->interval;
+}
+
+/*
+ * Runs the program from state to HALT and picks its simulation points.
+ * Every k up to SIMPOINT_MAX_K keeps its best clustering of SIMPOINT_SEEDS,
+ * and the smallest k scoring within SIMPOINT_BIC_THRESHOLD of the best
+ * gives the points. Returns FALSE when out of memory.
+ */
+int
+simpoint_analyze(Func_State *state, int interval_insns, Sim_Points *points)
+{
+    BBV_Profile profile;
+    unsigned long long seed = SIMPOINT_RANDOM_SEED;
+    double scores[SIMPOINT_MAX_K], sse, best_sse, low, high, d;
+    double *centers = malloc(SIMPOINT_MAX_K * DIMS * sizeof(double));
+    int *assign = NULL, *trial = NULL, sizes[SIMPOINT_MAX_K];
+    int max_k, k, chosen = 0, s, i, c, n, ok;
+
+    memset(&profile, 0, sizeof(BBV_Profile));
+    memset(points, 0, sizeof(Sim_Points));
+    ok = centers && profile_run(state, interval_insns, &profile);
+    n = profile.count;
+    max_k = (n < SIMPOINT_MAX_K) ? n : SIMPOINT_MAX_K;
+    if (ok)
+    {
+        assign = malloc(max_k * n * sizeof(int));
+        trial = malloc(n * sizeof(int));
+        ok = assign && trial;
+    }
+
+    for (k = 1; ok && k <= max_k; ++k)
+    {
+        best_sse = -1.0;
+        for (s = 0; s < SIMPOINT_SEEDS; ++s)
+        {
+            sse = kmeans(&profile, k, &seed, centers, trial, sizes);
+            if (best_sse < 0.0 || sse < best_sse)
+            {
+                best_sse = sse;
+                memcpy(&assign[(k - 1) * n], trial, n * sizeof(int));
+            }
+        }
+
+        memset(sizes, 0, k * sizeof(int));
+        for (i = 0; i < n; ++i)
+        {
+            sizes[assign[(k - 1) * n + i]]++;
+        }
+        scores[k - 1] = bic(n, k, sizes, best_sse);
+    }
+
+    if (ok)
+    {
+        low = high = scores[0];
+        for (k = 1; k < max_k; ++k)
+        {
+            low = (scores[k] < low) ? scores[k] : low;
+            high = (scores[k] > high) ? scores[k] : high;
+        }
+        for (k = max_k; k >= 1; --k)
+        {
+            if (scores[k - 1] >= low + SIMPOINT_BIC_THRESHOLD * (high - low))
+            {
+                chosen = k;
+            }
+        }
+
+        /* Centres of the chosen clustering, then the interval nearest each */
+        memcpy(trial, &assign[(chosen - 1) * n], n * sizeof(int));
+        memset(centers, 0, chosen * DIMS * sizeof(double));
+        memset(sizes, 0, chosen * sizeof(int));
+        for (i = 0; i < n; ++i)
+        {
+            sizes[trial[i]]++;
+        }
+        for (i = 0; i < n; ++i)
+        {
+            for (s = 0; s < DIMS; ++s)
+            {
+                centers[trial[i] * DIMS + s]
+                    += profile.vectors[i * DIMS + s] / sizes[trial[i]];
+            }
+        }
+
+        points->interval_insns = interval_insns;
+        points->insns = state->insn_count;
+        for (c = 0; c < chosen; ++c)
+        {
+            if (!sizes[c])
+            {
+                continue;
+            }
+
+            /* The short last interval only stands for a cluster of its own */
+            best_sse = -1.0;
+            for (i = 0; i < n; ++i)
+            {
+                if (trial[i] != c)
+                {
+                    continue;
+                }
+
+                d = distance(&profile.vectors[i * DIMS], &centers[c * DIMS]);
+                if (profile.insns[i] < interval_insns && sizes[c] > 1)
+                {
+                    d = -1.0;
+                }
+                if (d >= 0.0 && (best_sse < 0.0 || d < best_sse))
+                {
+                    best_sse = d;
+                    points->points[points->count].interval = i;
+                }
+                points->points[points->count].weight
+                    += (double)profile.insns[i] / state->insn_count;
+            }
+            points->count++;
+        }
+        qsort(points->points, points->count, sizeof(Sim_Point),
+              compare_points);
+
+        printf("APEX_CPU: Intervals = %d of %d instructions, basic blocks = %d\n",
+               n, interval_insns, profile.blocks);
+        for (k = 1; k <= max_k; ++k)
+        {
+            printf("APEX_CPU: k = %-2d BIC = %.1f%s\n", k, scores[k - 1],
+                   k == chosen ? " (chosen)" : "");
+        }
+    }
+
+    free(profile.vectors);
+    free(profile.insns);
+    free(centers);
+    free(assign);
+    free(trial);
+    return ok;
+}
+
+/* Writes the points as text, see simpoint_read. Returns FALSE if the file
+ * cannot be written */
+int
+simpoint_write(const Sim_Points *points, const char *path, const char *program)
+{
+    FILE *fp = fopen(path, "w");
+    int i;
+
+    if (!fp)
+    {
+        return FALSE;
+    }
+
+    fprintf(fp, "# Simulation points of %s\n", program);
+    fprintf(fp, "interval %d\n", points->interval_insns);
+    fprintf(fp, "instructions %lld\n", points->insns);
+    for (i = 0; i < points->count; ++i)
+    {
+        fprintf(fp, "point %d %.6f\n", points->points[i].interval,
+                points->points[i].weight);
+    }
+
+    return fclose(fp) == 0;
+}
+
+/*
+ * Reads a points file: the interval length, the instructions of the whole
+ * run and a "point <interval> <weight>" line per point. Lines starting
+ * with # are comments. Returns FALSE if the file is missing or malformed.
+ */
+int
+simpoint_read(Sim_Points *points, const char *path)
+{
+    FILE *fp = fopen(path, "r");
+    char line[256];
+    Sim_Point *point;
+    int ok = fp != NULL;
+
+    memset(points, 0, sizeof(Sim_Points));
+    while (ok && fgets(line, sizeof(line), fp))
+    {
+        point = &points->points[points->count];
+        if (line[0] == '#' || line[0] == '\n')
+        {
+            continue;
+        }
+
+        if (sscanf(line, "interval %d", &points->interval_insns) == 1
+            || sscanf(line, "instructions %lld", &points->insns) == 1)
+        {
+            continue;
+        }
+
+        ok = points->count < SIMPOINT_MAX_K
+             && sscanf(line, "point %d %lf", &point->interval,
+                       &point->weight) == 2
+             && point->interval >= 0 && point->weight >= 0.0;
+        points->count += ok;
+    }
+
+    if (fp)
+    {
+        fclose(fp);
+    }
+
+    qsort(points->points, points->count, sizeof(Sim_Point), compare_points);
+    return ok && points->count && points->interval_insns > 0
+           && points->insns > 0;
+}
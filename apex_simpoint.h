@@ -0,0 +1,35 @@
+/*
+ * apex_simpoint.h
+ * Contains APEX phase analysis declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_SIMPOINT_H_
+#define _APEX_SIMPOINT_H_
+
+#include "apex_func.h"
+#include "apex_macros.h"
+
+/* Interval that stands for a cluster of them */
+typedef struct Sim_Point
+{
+    int interval;                  /* Index of the interval, from 0 */
+    double weight;                 /* Share of all instructions its cluster ran */
+} Sim_Point;
+
+/* Simulation points of a program, in interval order */
+typedef struct Sim_Points
+{
+    int interval_insns;            /* Instructions per interval */
+    long long insns;               /* Instructions the whole program runs */
+    Sim_Point points[SIMPOINT_MAX_K];
+    int count;
+} Sim_Points;
+
+int simpoint_analyze(Func_State *state, int interval_insns, Sim_Points *points);
+int simpoint_write(const Sim_Points *points, const char *path,
+                   const char *program);
+int simpoint_read(Sim_Points *points, const char *path);
+#endif
@@ -0,0 +1,65 @@
+/*
+ * apex_tlb.c
+ * Contains APEX TLB implementation
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apex_tlb.h"
+#include "apex_macros.h"
+
+void
+tlb_init(TLB *tlb, int num_entries)
+{
+    memset(tlb, 0, sizeof(TLB));
+    tlb->num_entries = num_entries;
+}
+
+/* Returns TRUE if the page is mapped, making its entry most recently used */
+int
+tlb_lookup(TLB *tlb, unsigned int vpn)
+{
+    int i;
+
+    for (i = 0; i < tlb->num_entries; ++i)
+    {
+        if (tlb->entries[i].valid && tlb->entries[i].vpn == vpn)
+        {
+            tlb->entries[i].last_used = ++tlb->access_count;
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+/* Installs a translation returned by the walker over the LRU entry */
+void
+tlb_insert(TLB *tlb, unsigned int vpn)
+{
+    TLB_Entry *victim = &tlb->entries[0];
+    int i;
+
+    for (i = 0; i < tlb->num_entries; ++i)
+    {
+        if (!tlb->entries[i].valid)
+        {
+            victim = &tlb->entries[i];
+            break;
+        }
+
+        if (tlb->entries[i].last_used < victim->last_used)
+        {
+            victim = &tlb->entries[i];
+        }
+    }
+
+    victim->valid = TRUE;
+    victim->vpn = vpn;
+    victim->last_used = ++tlb->access_count;
+}
@@ -0,0 +1,45 @@
+/*
+ * apex_tlb.h
+ * Contains APEX TLB declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_TLB_H_
+#define _APEX_TLB_H_
+
+#include "apex_macros.h"
+
+#define TLB_MAX_ENTRIES \
+    ((DTLB_ENTRIES > ITLB_ENTRIES) ? DTLB_ENTRIES : ITLB_ENTRIES)
+
+typedef struct TLB_Entry
+{
+    int valid;
+    unsigned int vpn;              /* Virtual page number */
+    int last_used;
+} TLB_Entry;
+
+/* Fully associative TLB with LRU replacement and a blocking walker */
+typedef struct TLB
+{
+    TLB_Entry entries[TLB_MAX_ENTRIES];
+    int num_entries;
+    int access_count;              /* Used as LRU timestamp */
+    int walking;                   /* Page walk in progress */
+    unsigned int walk_vpn;
+    int walk_level;                /* Page table level read next */
+    unsigned int walk_table;       /* Table that level reads from */
+    int walk_filling;              /* Waiting on an MSHR for the entry's line */
+    int walk_start_cycle;
+    int walk_done_cycle;           /* Cycle the last entry read completes */
+    int hits;
+    int misses;
+    int walk_cycles;               /* Cycles spent in page walks */
+} TLB;
+
+void tlb_init(TLB *tlb, int num_entries);
+int tlb_lookup(TLB *tlb, unsigned int vpn);
+void tlb_insert(TLB *tlb, unsigned int vpn);
+#endif
@@ -0,0 +1,121 @@
+/*
+ * apex_vector.c
+ * Contains APEX vector unit implementation
+ *
+ * Vector operations run on host SIMD when the compiler targets it (build
+ * with SIMD_FLAGS=-mavx2 or -msse4.1), and on plain loops otherwise.
+ * Elements wrap on overflow in every variant.
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__AVX2__) || defined(__SSE4_1__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#include "apex_vector.h"
+#include "apex_macros.h"
+
+void
+vector_add(int *result, const int *a, const int *b)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= VECTOR_LENGTH; i += 8)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)&a[i]);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)&b[i]);
+        _mm256_storeu_si256((__m256i *)&result[i], _mm256_add_epi32(va, vb));
+    }
+#endif
+#if defined(__SSE2__)
+    for (; i + 4 <= VECTOR_LENGTH; i += 4)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i *)&b[i]);
+        _mm_storeu_si128((__m128i *)&result[i], _mm_add_epi32(va, vb));
+    }
+#endif
+    for (; i < VECTOR_LENGTH; ++i)
+    {
+        result[i] = (int)((unsigned int)a[i] + (unsigned int)b[i]);
+    }
+}
+
+void
+vector_mul(int *result, const int *a, const int *b)
+{
+    int i = 0;
+
+#if defined(__AVX2__)
+    for (; i + 8 <= VECTOR_LENGTH; i += 8)
+    {
+        __m256i va = _mm256_loadu_si256((const __m256i *)&a[i]);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)&b[i]);
+        _mm256_storeu_si256((__m256i *)&result[i], _mm256_mullo_epi32(va, vb));
+    }
+#endif
+#if defined(__SSE4_1__)
+    for (; i + 4 <= VECTOR_LENGTH; i += 4)
+    {
+        __m128i va = _mm_loadu_si128((const __m128i *)&a[i]);
+        __m128i vb = _mm_loadu_si128((const __m128i *)&b[i]);
+        _mm_storeu_si128((__m128i *)&result[i], _mm_mullo_epi32(va, vb));
+    }
+#endif
+    for (; i < VECTOR_LENGTH; ++i)
+    {
+        result[i] = (int)((unsigned int)a[i] * (unsigned int)b[i]);
+    }
+}
+
+/* Sums all elements, used by VRED */
+int
+vector_reduce(const int *a)
+{
+    unsigned int sum = 0;
+    int i = 0;
+
+#if defined(__SSE2__)
+    if (VECTOR_LENGTH >= 4)
+    {
+        __m128i acc = _mm_setzero_si128();
+        int lanes[4];
+
+        for (; i + 4 <= VECTOR_LENGTH; i += 4)
+        {
+            acc = _mm_add_epi32(acc, _mm_loadu_si128((const __m128i *)&a[i]));
+        }
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        sum = (unsigned int)lanes[0] + (unsigned int)lanes[1]
+              + (unsigned int)lanes[2] + (unsigned int)lanes[3];
+    }
+#endif
+    for (; i < VECTOR_LENGTH; ++i)
+    {
+        sum += (unsigned int)a[i];
+    }
+
+    return (int)sum;
+}
+
+/* Names the host instruction set the vector unit was built for */
+const char *
+vector_isa(void)
+{
+#if defined(__AVX2__)
+    return "AVX2";
+#elif defined(__SSE4_1__)
+    return "SSE4.1";
+#elif defined(__SSE2__)
+    return "SSE2";
+#else
+    return "scalar";
+#endif
+}
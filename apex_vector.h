@@ -0,0 +1,18 @@
+/*
+ * apex_vector.h
+ * Contains APEX vector unit declarations
+ *
+ * Author:
+ * Copyright (c) 2020, Gaurav Kothari (gkothar1@binghamton.edu)
+ * State University of New York at Binghamton
+ */
+#ifndef _APEX_VECTOR_H_
+#define _APEX_VECTOR_H_
+
+#include "apex_macros.h"
+
+void vector_add(int *result, const int *a, const int *b);
+void vector_mul(int *result, const int *a, const int *b);
+int vector_reduce(const int *a);
+const char *vector_isa(void);
+#endif
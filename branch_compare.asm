@@ -0,0 +1,38 @@
+MOVC R1,#5
+MOVC R2,#7
+MOVC R8,#0
+MOVC R9,#0
+BEQ R1,R1,#8
+ADDL R9,R9,#1
+BNE R1,R2,#8
+ADDL R9,R9,#1
+BLT R1,R2,#8
+ADDL R9,R9,#1
+BGE R2,R1,#8
+ADDL R9,R9,#1
+BEQL R1,#5,#8
+ADDL R9,R9,#1
+BNEL R1,#6,#8
+ADDL R9,R9,#1
+BLTL R1,#6,#8
+ADDL R9,R9,#1
+BGEL R1,#5,#8
+ADDL R9,R9,#1
+BEQ R1,R2,#8
+ADDL R8,R8,#1
+BNE R1,R1,#8
+ADDL R8,R8,#1
+BLT R2,R1,#8
+ADDL R8,R8,#1
+BGE R1,R2,#8
+ADDL R8,R8,#1
+BEQL R1,#4,#8
+ADDL R8,R8,#1
+BNEL R1,#5,#8
+ADDL R8,R8,#1
+BLTL R1,#5,#8
+ADDL R8,R8,#1
+BGEL R1,#6,#8
+ADDL R8,R8,#1
+ADD R10,R8,R9
+HALT
@@ -0,0 +1,7 @@
+MOVC R1,#0
+MOVC R2,#0
+ADD R2,R2,R1
+ADDL R1,R1,#1
+BNEL R1,#100,#-8
+ADD R10,R2,R0
+HALT
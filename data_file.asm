@@ -0,0 +1,16 @@
+.data #1000
+.word 5,6,7
+
+.fill 3,9
+.data 0x100000
+.incbin "data_file.bin"
+MOVC R1,#1000
+LOADP R2,R1,#0
+LOADP R3,R1,#0
+LOADP R4,R1,#0
+LOADP R5,R1,#0
+MOVC R6,#1048576
+LOAD R7,R6,#400
+LOAD R8,R6,#4092
+ADD R9,R8,R7
+HALT 
\ No newline at end of file
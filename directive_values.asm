@@ -0,0 +1,12 @@
+.data 0100
+.word 010,0x10
+.fill 02,-07
+MOVC R1,#100
+LOADP R2,R1,#0
+LOADP R3,R1,#0
+LOADP R4,R1,#0
+LOADP R5,R1,#0
+ADD R6,R2,R3
+ADD R6,R6,R4
+ADD R6,R6,R5
+HALT 
\ No newline at end of file
@@ -0,0 +1,18 @@
+.data 1000
+.word 1,2,3,4,5,6,7,8,9,10,11,12,13,14,15,16,17,18,19,20,21,22,23,24,25,26,27,28,29,30,31,32,33,34,35,36,37,38,39,40,41,42,43,44,45,46,47,48,49,50,51,52,53,54,55,56,57,58,59,60,61,62,63,64
+.data 2000
+.word 2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2,2
+MOVC R1,#1000
+MOVC R2,#2000
+MOVC R3,#0
+MOVC R8,#3000
+MOVC R4,#64
+LOADP R5,R1,#0
+LOADP R6,R2,#0
+MAC R3,R5,R6
+SUBL R4,R4,#1
+BNZ #-16
+STORE R5,R8,#12
+LOAD R9,R8,#12
+ADD R10,R3,R0
+HALT
\ No newline at end of file
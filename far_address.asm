@@ -0,0 +1,9 @@
+MOVC R1,#9
+MOVC R2,#2000000000
+STORE R1,R2,#0
+MOVC R3,#-8
+STORE R1,R3,#0
+LOAD R4,R2,#0
+LOAD R5,R3,#0
+LOAD R6,R3,#4096
+HALT 
\ No newline at end of file
@@ -172,6 +172,98 @@ set_opcode_str(const char *opcode_str)
     {
         return OPCODE_JALR;
     }
+    if (strcmp(opcode_str, "PREFETCH") == 0)
+    {
+        return OPCODE_PREFETCH;
+    }
+    if (strcmp(opcode_str, "COPY") == 0)
+    {
+        return OPCODE_COPY;
+    }
+    if (strcmp(opcode_str, "DMAWAIT") == 0)
+    {
+        return OPCODE_DMAWAIT;
+    }
+    if (strcmp(opcode_str, "VLOAD") == 0)
+    {
+        return OPCODE_VLOAD;
+    }
+    if (strcmp(opcode_str, "VSTORE") == 0)
+    {
+        return OPCODE_VSTORE;
+    }
+    if (strcmp(opcode_str, "VADD") == 0)
+    {
+        return OPCODE_VADD;
+    }
+    if (strcmp(opcode_str, "VMUL") == 0)
+    {
+        return OPCODE_VMUL;
+    }
+    if (strcmp(opcode_str, "VRED") == 0)
+    {
+        return OPCODE_VRED;
+    }
+    if (strcmp(opcode_str, "MAC") == 0)
+    {
+        return OPCODE_MAC;
+    }
+    if (strcmp(opcode_str, "SHADD") == 0)
+    {
+        return OPCODE_SHADD;
+    }
+    if (strcmp(opcode_str, "CMOVZ") == 0)
+    {
+        return OPCODE_CMOVZ;
+    }
+    if (strcmp(opcode_str, "CMOVNZ") == 0)
+    {
+        return OPCODE_CMOVNZ;
+    }
+    if (strcmp(opcode_str, "CMOVP") == 0)
+    {
+        return OPCODE_CMOVP;
+    }
+    if (strcmp(opcode_str, "CMOVN") == 0)
+    {
+        return OPCODE_CMOVN;
+    }
+    if (strcmp(opcode_str, "BEQ") == 0)
+    {
+        return OPCODE_BEQ;
+    }
+    if (strcmp(opcode_str, "BNE") == 0)
+    {
+        return OPCODE_BNE;
+    }
+    if (strcmp(opcode_str, "BLT") == 0)
+    {
+        return OPCODE_BLT;
+    }
+    if (strcmp(opcode_str, "BGE") == 0)
+    {
+        return OPCODE_BGE;
+    }
+    if (strcmp(opcode_str, "BEQL") == 0)
+    {
+        return OPCODE_BEQL;
+    }
+    if (strcmp(opcode_str, "BNEL") == 0)
+    {
+        return OPCODE_BNEL;
+    }
+    if (strcmp(opcode_str, "BLTL") == 0)
+    {
+        return OPCODE_BLTL;
+    }
+    if (strcmp(opcode_str, "BGEL") == 0)
+    {
+        return OPCODE_BGEL;
+    }
+    if (strcmp(opcode_str, "LOOP") == 0)
+    {
+        return OPCODE_LOOP;
+    }
 
     assert(0 && "Invalid opcode");
     return 0;
@@ -230,6 +322,9 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         case OPCODE_AND:
         case OPCODE_OR:
         case OPCODE_XOR:
+        case OPCODE_VADD:
+        case OPCODE_VMUL:
+        case OPCODE_MAC:
         {
             ins->rd = get_num_from_string(tokens[0]);
             ins->rs1 = get_num_from_string(tokens[1]);
@@ -256,6 +351,7 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         case OPCODE_JALR:
         case OPCODE_LOADP:
         case OPCODE_LOAD:
+        case OPCODE_VLOAD:
         {
             ins->rd = get_num_from_string(tokens[0]);
             ins->rs1 = get_num_from_string(tokens[1]);
@@ -264,6 +360,12 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
         }
         case OPCODE_STOREP:
         case OPCODE_STORE:
+        case OPCODE_COPY:
+        case OPCODE_VSTORE:
+        case OPCODE_BEQ:
+        case OPCODE_BNE:
+        case OPCODE_BLT:
+        case OPCODE_BGE:
         {
             ins->rs1 = get_num_from_string(tokens[0]);
             ins->rs2 = get_num_from_string(tokens[1]);
@@ -288,8 +390,38 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
             ins->rs2 = get_num_from_string(tokens[1]);
             break;
         }
+        case OPCODE_VRED:
+        case OPCODE_CMOVZ:
+        case OPCODE_CMOVNZ:
+        case OPCODE_CMOVP:
+        case OPCODE_CMOVN:
+        {
+            ins->rd = get_num_from_string(tokens[0]);
+            ins->rs1 = get_num_from_string(tokens[1]);
+            break;
+        }
+        case OPCODE_BEQL:
+        case OPCODE_BNEL:
+        case OPCODE_BLTL:
+        case OPCODE_BGEL:
+        {
+            ins->rs1 = get_num_from_string(tokens[0]);
+            ins->literal = get_num_from_string(tokens[1]);
+            ins->imm = get_num_from_string(tokens[2]);
+            break;
+        }
+        case OPCODE_SHADD:
+        {
+            ins->rd = get_num_from_string(tokens[0]);
+            ins->rs1 = get_num_from_string(tokens[1]);
+            ins->rs2 = get_num_from_string(tokens[2]);
+            ins->imm = get_num_from_string(tokens[3]);
+            break;
+        }
         case OPCODE_JUMP:
         case OPCODE_CML:
+        case OPCODE_PREFETCH:
+        case OPCODE_LOOP:
         {
             ins->rs1 = get_num_from_string(tokens[0]);
             ins->imm = get_num_from_string(tokens[1]);
@@ -299,21 +431,158 @@ create_APEX_instruction(APEX_Instruction *ins, char *buffer)
     /* Fill in rest of the instructions accordingly */
 }
 
+/* Strips the line ending and trailing blanks, returns the first non-blank */
+static char *
+trim_line(char *line)
+{
+    size_t n = strlen(line);
+
+    while (n > 0 && (line[n - 1] == '\n' || line[n - 1] == '\r'
+                     || line[n - 1] == ' ' || line[n - 1] == '\t'))
+    {
+        line[--n] = '\0';
+    }
+
+    while (*line == ' ' || *line == '\t')
+    {
+        line++;
+    }
+    return line;
+}
+
+/* Reads a directive operand, the '#' used by instructions is optional.
+ * Values are decimal like instruction literals, or hex after 0x */
+static int
+get_directive_value(const char *token)
+{
+    while (*token == ' ' || *token == '\t')
+    {
+        token++;
+    }
+
+    if (*token == '#')
+    {
+        token++;
+    }
+
+    if (token[0] == '0' && (token[1] == 'x' || token[1] == 'X'))
+    {
+        return (int)strtoul(token + 2, NULL, 16);
+    }
+    return (int)strtol(token, NULL, 10);
+}
+
 /*
- * This function is related to parsing input file
+ * Handles one data directive, writing its words into data memory at the
+ * location counter data_address:
  *
- * Note : You are not supposed to edit this function
+ *   .data [addr]          move the location counter, 0 if omitted
+ *   .word v1[,v2...]      one word per value
+ *   .fill count[,value]   count copies of value, 0 if omitted
+ *   .incbin "file"        native 32-bit words of file, mapped not copied
+ *
+ * Each word advances the counter by DATA_WORD_STRIDE. A relative .incbin
+ * path is taken from the directory of the input file. Returns FALSE if the
+ * directive cannot be handled.
+ */
+static int
+create_data_directive(char *buffer, Data_Memory *data_memory, int *data_address,
+                      const char *filename)
+{
+    char path[1024];
+    char *name, *args, *token, *slash;
+    int count, value;
+
+    name = strtok(buffer, " \t");
+    args = strtok(NULL, "");
+    if (!args)
+    {
+        args = "";
+    }
+
+    if (strcmp(name, ".data") == 0)
+    {
+        *data_address = get_directive_value(args);
+        return TRUE;
+    }
+
+    if (strcmp(name, ".word") == 0)
+    {
+        for (token = strtok(args, ","); token; token = strtok(NULL, ","))
+        {
+            mem_write(data_memory, *data_address, get_directive_value(token));
+            *data_address += DATA_WORD_STRIDE;
+        }
+        return TRUE;
+    }
+
+    if (strcmp(name, ".fill") == 0)
+    {
+        token = strtok(args, ",");
+        count = token ? get_directive_value(token) : 0;
+        token = strtok(NULL, ",");
+        value = token ? get_directive_value(token) : 0;
+
+        while (count-- > 0)
+        {
+            mem_write(data_memory, *data_address, value);
+            *data_address += DATA_WORD_STRIDE;
+        }
+        return TRUE;
+    }
+
+    if (strcmp(name, ".incbin") == 0)
+    {
+        token = strtok(args, "\"");
+        if (!token)
+        {
+            fprintf(stderr, "APEX_Error: .incbin needs a file name\n");
+            return FALSE;
+        }
+
+        slash = strrchr(filename, '/');
+        if (token[0] != '/' && slash)
+        {
+            snprintf(path, sizeof(path), "%.*s/%s", (int)(slash - filename),
+                     filename, token);
+        }
+        else
+        {
+            snprintf(path, sizeof(path), "%s", token);
+        }
+
+        count = mem_map_file(data_memory, *data_address, path);
+        if (count < 0)
+        {
+            return FALSE;
+        }
+        *data_address += count * DATA_WORD_STRIDE;
+        return TRUE;
+    }
+
+    fprintf(stderr, "APEX_Error: Unknown directive %s\n", name);
+    return FALSE;
+}
+
+/*
+ * This function is related to parsing input file. Instructions are
+ * assembled into code memory, whose size in bytes is returned through
+ * size. Data directives are loaded into data_memory. Blank lines are
+ * skipped.
  */
-APEX_Instruction *
-create_code_memory(const char *filename, int *size)
+unsigned char *
+create_code_memory(const char *filename, int *size, Data_Memory *data_memory)
 {
     FILE *fp;
     ssize_t nread;
     size_t len = 0;
     char *line = NULL;
+    char *text;
     int code_memory_size = 0;
     int current_instruction = 0;
-    APEX_Instruction *code_memory;
+    int data_address = 0;
+    APEX_Instruction *program;
+    unsigned char *code_memory;
 
     if (!filename)
     {
@@ -328,17 +597,20 @@ create_code_memory(const char *filename, int *size)
 
     while ((nread = getline(&line, &len, fp)) != -1)
     {
-        code_memory_size++;
+        text = trim_line(line);
+        if (*text && *text != '.')
+        {
+            code_memory_size++;
+        }
     }
-    *size = code_memory_size;
     if (!code_memory_size)
     {
         fclose(fp);
         return NULL;
     }
 
-    code_memory = calloc(code_memory_size, sizeof(APEX_Instruction));
-    if (!code_memory)
+    program = calloc(code_memory_size, sizeof(APEX_Instruction));
+    if (!program)
     {
         fclose(fp);
         return NULL;
@@ -347,11 +619,33 @@ create_code_memory(const char *filename, int *size)
     rewind(fp);
     while ((nread = getline(&line, &len, fp)) != -1)
     {
-        create_APEX_instruction(&code_memory[current_instruction], line);
+        text = trim_line(line);
+        if (!*text)
+        {
+            continue;
+        }
+
+        if (*text == '.')
+        {
+            if (!create_data_directive(text, data_memory, &data_address,
+                                       filename))
+            {
+                free(program);
+                free(line);
+                fclose(fp);
+                return NULL;
+            }
+            continue;
+        }
+
+        create_APEX_instruction(&program[current_instruction], text);
         current_instruction++;
     }
 
     free(line);
     fclose(fp);
+
+    code_memory = isa_assemble(program, code_memory_size, size);
+    free(program);
     return code_memory;
 }
\ No newline at end of file
@@ -0,0 +1,32 @@
+.data #1000
+.word 77
+MOVC R30,#1000
+LOAD R1,R30,#0
+MOVC R1,#5
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R10,R10,#1
+ADDL R3,R1,#0
+HALT 
\ No newline at end of file
@@ -0,0 +1,76 @@
+.data 1000
+.word 2640,1232,3232,384,592,768,2992,464,1744,304,704,3552,3424,560,1968,736,3472,480,1008,1824,496,3248,400,1808,368,1088,2368,3424,1168,960,2512,1472
+.data 8496
+.word 20
+.data 8560
+.word 24
+.data 8576
+.word 25
+.data 8592
+.word 26
+.data 8656
+.word 30
+.data 8672
+.word 31
+.data 8688
+.word 32
+.data 8752
+.word 36
+.data 8784
+.word 38
+.data 8896
+.word 45
+.data 8928
+.word 47
+.data 8960
+.word 49
+.data 9152
+.word 61
+.data 9200
+.word 64
+.data 9280
+.word 69
+.data 9360
+.word 74
+.data 9424
+.word 78
+.data 9664
+.word 93
+.data 9936
+.word 110
+.data 10000
+.word 114
+.data 10016
+.word 115
+.data 10160
+.word 124
+.data 10560
+.word 149
+.data 10704
+.word 158
+.data 10832
+.word 166
+.data 11184
+.word 188
+.data 11424
+.word 203
+.data 11440
+.word 204
+.data 11616
+.word 215
+.data 11664
+.word 218
+.data 11744
+.word 223
+MOVC R1,#1000
+MOVC R6,#8192
+MOVC R3,#0
+MOVC R4,#32
+LOADP R9,R1,#0
+ADD R7,R6,R9
+LOAD R8,R7,#0
+ADD R3,R3,R8
+SUBL R4,R4,#1
+BNZ #-20
+ADD R10,R3,R0
+HALT 
\ No newline at end of file
@@ -0,0 +1,5 @@
+.data 1000
+.word 77
+MOVC R30,#1000
+LOAD R6,R30,#0
+HALT 
\ No newline at end of file
@@ -0,0 +1,8 @@
+MOVC R1,#0
+MOVC R2,#0
+MOVC R3,#100
+LOOP R3,#2
+ADD R2,R2,R1
+ADDL R1,R1,#1
+ADD R10,R2,R0
+HALT
@@ -0,0 +1,16 @@
+MOVC R1,#0
+MOVC R2,#0
+MOVC R3,#10
+LOOP R3,#5
+ADDL R1,R1,#1
+CML R1,#5
+BN #8
+ADDL R2,R2,#1
+NOP
+MOVC R6,#0
+MOVC R8,#7
+LOOP R6,#2
+ADDL R8,R8,#1
+ADDL R8,R8,#1
+ADD R10,R2,R8
+HALT
@@ -0,0 +1,9 @@
+MOVC R1,#0
+MOVC R3,#100
+LOOP R3,#3
+ADDL R1,R1,#1
+BEQL R1,#10,#12
+NOP
+MOVC R7,#55
+ADD R10,R1,R7
+HALT
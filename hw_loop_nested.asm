@@ -0,0 +1,11 @@
+MOVC R1,#0
+MOVC R3,#3
+MOVC R4,#4
+MOVC R5,#0
+LOOP R3,#4
+LOOP R4,#1
+ADDL R1,R1,#1
+ADDL R5,R5,#100
+NOP
+ADD R10,R1,R5
+HALT
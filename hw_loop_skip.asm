@@ -0,0 +1,9 @@
+MOVC R1,#0
+MOVC R2,#0
+MOVC R3,#5
+LOOP R3,#3
+ADDL R1,R1,#1
+BGEL R2,#0,#4
+ADDL R2,R2,#1
+ADD R10,R1,R2
+HALT
@@ -0,0 +1,16 @@
+MOVC R1,#0
+MOVC R2,#0
+ADDL R2,R2,#3
+ADDL R1,R1,#1
+BNEL R1,#1000,#-8
+MOVC R8,#0
+BEQL R1,#1000,#8
+ADDL R8,R8,#1
+BLTL R1,#70000,#8
+ADDL R8,R8,#1
+BGEL R1,#-70000,#8
+ADDL R8,R8,#1
+BEQL R1,#-256,#8
+ADDL R8,R8,#10
+ADD R10,R2,R8
+HALT 
\ No newline at end of file
@@ -0,0 +1,17 @@
+MOVC R1,#0
+MOVC R2,#30000
+MOVC R9,#1000
+MOVC R10,#100
+MOVC R4,#0
+MOVC R5,#3
+ADD R4,R4,R5
+MUL R6,R4,R5
+STORE R6,R9,#0
+LOAD R7,R9,#0
+ADD R1,R1,R7
+SUBL R10,R10,#1
+BNZ #-24
+MOVC R10,#100
+SUBL R2,R2,#1
+BNZ #-36
+HALT
@@ -0,0 +1,9 @@
+MOVC R6,#8
+MOVC R8,#0
+MOVC R9,#0
+LOOP R6,#3
+ADDL R8,R8,#1
+CML R8,#3
+BN #-8
+ADDL R9,R9,#1
+HALT 
\ No newline at end of file
@@ -0,0 +1,10 @@
+MOVC R4,#1000
+MOVC R6,#20
+LOAD R5,R4,#0
+ADDL R5,R5,#1
+ADD R7,R7,R5
+SUBL R6,R6,#1
+BNZ #-16
+HALT
+.data 1000
+.word 41
\ No newline at end of file
@@ -7,30 +7,105 @@
  */
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "apex_cpu.h"
 
 int
 main(int argc, char const *argv[])
 {
-    APEX_CPU *cpu;
+    APEX_System *sys;
+    const char *engine = NULL, *pick = NULL, *points = NULL;
+    double error = 0.0;
+    int first = 1, num_cores = 1, quantum = 0;
 
     fprintf(stderr, "APEX CPU Pipeline Simulator v%0.1lf\n", VERSION);
 
-    if (argc != 2)
+    while (argc - first > 2 && argv[first][0] == '-')
     {
-        fprintf(stderr, "APEX_Help: Usage %s <input_file>\n", argv[0]);
+        if (strcmp(argv[first], "-c") == 0)
+        {
+            num_cores = atoi(argv[first + 1]);
+        }
+        else if (strcmp(argv[first], "-q") == 0)
+        {
+            quantum = atoi(argv[first + 1]);
+        }
+        else if (strcmp(argv[first], "-f") == 0)
+        {
+            engine = argv[first + 1];
+        }
+        else if (strcmp(argv[first], "-s") == 0)
+        {
+            error = atof(argv[first + 1]);
+        }
+        else if (strcmp(argv[first], "-b") == 0)
+        {
+            pick = argv[first + 1];
+        }
+        else if (strcmp(argv[first], "-p") == 0)
+        {
+            points = argv[first + 1];
+        }
+        else
+        {
+            break;
+        }
+        first += 2;
+    }
+
+    /* Functional, sampled and simulation point runs take a single program,
+     * and one of them at a time */
+    if ((engine != NULL) + (error > 0.0) + (pick != NULL) + (points != NULL) == 1
+        && argc - first == 1)
+    {
+        if (engine)
+        {
+            return APEX_func_run(argv[first], engine);
+        }
+        if (pick)
+        {
+            return APEX_simpoint_pick(argv[first], pick);
+        }
+        if (points)
+        {
+            return APEX_simpoint_run(argv[first], points);
+        }
+        return APEX_sample_run(argv[first], error);
+    }
+
+    /* Each input file runs on its own hardware thread, the files are
+     * split evenly across the cores */
+    if (engine || error > 0.0 || pick || points
+        || argc - first < num_cores || num_cores < 1 || num_cores > MAX_CORES
+        || quantum < 0 || (argc - first) % num_cores
+        || (argc - first) / num_cores > SMT_MAX_THREADS)
+    {
+        fprintf(stderr, "APEX_Help: Usage %s [-c <cores>] [-q <quantum>] <input_file> [<input_file> ...]\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: Up to %d cores, each running an equal share of the files\n",
+                MAX_CORES);
+        fprintf(stderr, "APEX_Help: Up to %d input files per core, one per thread\n",
+                SMT_MAX_THREADS);
+        fprintf(stderr, "APEX_Help: -q runs each core on its own host thread, <quantum> cycles at a time\n");
+        fprintf(stderr, "APEX_Help: Or %s -f interp|dbt|check <input_file> runs it without the pipeline\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: -f pipeline runs it through the pipeline as well and compares their results\n");
+        fprintf(stderr, "APEX_Help: Or %s -s <error %%> <input_file> estimates its CPI from samples to within that error\n",
+                argv[0]);
+        fprintf(stderr, "APEX_Help: Or %s -b <points_file> <input_file> picks its simulation points, and -p <points_file> runs them\n",
+                argv[0]);
         exit(1);
     }
 
-    cpu = APEX_cpu_init(argv[1]);
-    if (!cpu)
+    sys = APEX_cpu_init(&argv[first], argc - first, num_cores, quantum);
+    if (!sys)
     {
         fprintf(stderr, "APEX_Error: Unable to initialize CPU\n");
         exit(1);
     }
 
-    APEX_cpu_run(cpu);
-    APEX_cpu_stop(cpu);
+    APEX_cpu_run(sys);
+    APEX_cpu_stop(sys);
     return 0;
-}
\ No newline at end of file
+}
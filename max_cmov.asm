@@ -0,0 +1,12 @@
+.data 1000
+.word -169,470,-346,-96,166,-451,-426,340,48,-404,-126,96,-441,431,19,-281,-462,-412,-56,-72,-429,-254,-408,64,-66,-440,346,79,-374,470,-272,145,142,96,470,-437,90,99,-94,-450,499,-274,-453,70,379,-364,-204,-71,-353,53,-380,84,-185,73,335,198,-315,-395,95,84,154,-308,-119,-401
+MOVC R1,#1000
+MOVC R3,#-1000
+MOVC R4,#64
+LOADP R5,R1,#0
+CMP R5,R3
+CMOVP R3,R5
+SUBL R4,R4,#1
+BNZ #-16
+ADD R10,R3,R0
+HALT
\ No newline at end of file
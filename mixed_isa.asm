@@ -0,0 +1,22 @@
+MOVC R1,#1000
+MOVC R2,#5
+MOVC R8,#4
+LOOP R2,#6
+LOADP R3,R1,#0
+SHADD R4,R4,R3,#2
+MAC R5,R3,R3
+CML R3,#3
+BEQL R3,#4,#8
+CMOVZ R6,R3
+MOVC R1,#1000
+LOADP R1,R1,#4
+MOVC R9,#4068
+JALR R10,R9,#0
+ADDL R11,R11,#1
+JUMP R10,#8
+HALT
+MOVC R12,#77
+ADDL R13,R13,#5
+JUMP R10,#0
+.data 1000
+.word 5,1,2,3,4,5,6,7
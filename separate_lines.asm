@@ -0,0 +1,9 @@
+MOVC R5,#50
+MOVC R6,#16
+MUL R6,R6,R31
+LOAD R3,R6,#3000
+ADDL R3,R3,#1
+STORE R3,R6,#3000
+SUBL R5,R5,#1
+BNZ #-16
+HALT
@@ -0,0 +1,10 @@
+MOVC R1,#5
+MOVC R2,#300
+STORE R1,R2,#0
+ADDL R1,R1,#1
+STORE R1,R2,#0
+LOAD R3,R2,#0
+STORE R3,R2,#64
+LOAD R4,R2,#64
+ADD R5,R3,R4
+HALT 
\ No newline at end of file
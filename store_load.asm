@@ -0,0 +1,11 @@
+MOVC R1,#100
+MOVC R2,#7
+STORE R2,R1,#0
+MOVC R3,#200
+LOADP R4,R3,#0
+LOADP R5,R3,#0
+ADDL R6,R2,#1
+ADDL R7,R6,#1
+LOAD R8,R1,#0
+ADD R9,R8,R4
+HALT 
\ No newline at end of file
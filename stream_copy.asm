@@ -0,0 +1,9 @@
+MOVC R1,#0
+MOVC R2,#1000
+MOVC R5,#16
+LOADP R3,R1,#0
+STOREP R3,R2,#0
+SUBL R5,R5,#1
+BNZ #-12
+LOAD R6,R2,#-4
+HALT 
\ No newline at end of file
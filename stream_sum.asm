@@ -0,0 +1,8 @@
+MOVC R1,#0
+MOVC R5,#128
+MOVC R6,#0
+LOADP R3,R1,#0
+ADD R6,R6,R3
+SUBL R5,R5,#1
+BNZ #-12
+HALT 
\ No newline at end of file
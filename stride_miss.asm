@@ -0,0 +1,9 @@
+MOVC R1,#40000
+MOVC R5,#40
+MOVC R6,#0
+LOAD R3,R1,#0
+ADD R6,R6,R3
+ADDL R1,R1,#1000
+SUBL R5,R5,#1
+BNZ #-16
+HALT
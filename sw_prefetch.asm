@@ -0,0 +1,9 @@
+MOVC R1,#0
+MOVC R5,#128
+MOVC R6,#0
+PREFETCH R1,#48
+LOADP R3,R1,#0
+ADD R6,R6,R3
+SUBL R5,R5,#1
+BNZ #-16
+HALT 
\ No newline at end of file
@@ -0,0 +1,23 @@
+MOVC R1,#1000
+MOVC R5,#16
+MOVC R6,#0
+LOADP R3,R1,#0
+ADD R6,R6,R3
+SUBL R5,R5,#1
+BNZ #-12
+MOVC R1,#1000
+MOVC R5,#16
+LOADP R3,R1,#0
+MOVC R3,#7
+ADD R6,R6,R3
+SUBL R5,R5,#1
+BNZ #-16
+MOVC R1,#1000
+MOVC R5,#16
+LOADP R3,R1,#0
+CMP R3,R6
+SUBL R5,R5,#1
+BNZ #-12
+HALT
+.data 1000
+.word 0,1,2,3,4,5,6,7,100,9,10,11,12,50,14,15,16,17